@@ -0,0 +1,86 @@
+#include "corpus.hpp"
+
+#include <random>
+
+namespace torq::bench {
+
+    namespace {
+        const char *words[] = {
+            "radius", "area", "total", "count", "index", "value", "result", "buffer",
+            "scale", "offset", "width", "height", "left", "right", "node", "next_item"
+        };
+
+        std::string word(std::mt19937 &rng) {
+            return words[rng() % std::size(words)];
+        }
+
+        std::string name(std::mt19937 &rng) {
+            return word(rng) + "_" + std::to_string(rng() % 1000);
+        }
+
+        std::string number(std::mt19937 &rng) {
+            switch(rng() % 4) {
+                case 0: return std::to_string(rng() % 1000000);
+                case 1: return std::to_string(rng() % 1000) + "." + std::to_string(rng() % 100000);
+                case 2: return "0x" + std::to_string(rng() % 90000 + 10000);
+                default: return std::to_string(rng() % 1000) + "_" + std::to_string(rng() % 900 + 100);
+            }
+        }
+
+        std::string sentence(std::mt19937 &rng, int min_words, int max_words) {
+            std::string text = word(rng);
+            int count = min_words + rng() % (max_words - min_words + 1);
+            for(int i = 1; i < count; i++)
+                text += " " + word(rng);
+            return text;
+        }
+
+        std::string line(CorpusKind kind, std::mt19937 &rng) {
+            switch(kind) {
+                case CorpusKind::IDENTIFIERS:
+                    return name(rng) + " = " + name(rng) + " * " + name(rng) + " + " + name(rng) + "(" + name(rng) + ")\n";
+
+                case CorpusKind::NUMBERS:
+                    return "[" + number(rng) + ", " + number(rng) + ", " + number(rng) + ", " + number(rng) + "]\n";
+
+                case CorpusKind::STRINGS:
+                    return "print(\"" + sentence(rng, 4, 16) + "\\n\", \"" + sentence(rng, 2, 8) + "\")\n";
+
+                case CorpusKind::COMMENTS:
+                    return "# " + sentence(rng, 6, 20) + "\n" + name(rng) + " = 1\n";
+
+                case CorpusKind::MIXED:
+                default:
+                    switch(rng() % 4) {
+                        case 0: return line(CorpusKind::IDENTIFIERS, rng);
+                        case 1: return line(CorpusKind::NUMBERS, rng);
+                        case 2: return line(CorpusKind::STRINGS, rng);
+                        default: return line(CorpusKind::COMMENTS, rng);
+                    }
+            }
+        }
+    }
+
+    const char* corpus_name(CorpusKind kind) {
+        switch(kind) {
+            case CorpusKind::IDENTIFIERS: return "identifiers";
+            case CorpusKind::NUMBERS: return "numbers";
+            case CorpusKind::STRINGS: return "strings";
+            case CorpusKind::COMMENTS: return "comments";
+            case CorpusKind::MIXED: return "mixed";
+        }
+        return "unknown";
+    }
+
+    std::string generate_corpus(CorpusKind kind, std::size_t bytes, unsigned seed) {
+        std::mt19937 rng(seed);
+        std::string source;
+        source.reserve(bytes + 256);
+
+        while(source.size() < bytes)
+            source += line(kind, rng);
+
+        return source;
+    }
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace torq::bench {
+
+    enum class CorpusKind { IDENTIFIERS, NUMBERS, STRINGS, COMMENTS, MIXED };
+
+    const char* corpus_name(CorpusKind kind);
+
+    //deterministic, syntactically plausible torq source of roughly the requested size.
+    //Lines are never split, so the result can run a line past bytes
+    std::string generate_corpus(CorpusKind kind, std::size_t bytes, unsigned seed = 1);
+
+}
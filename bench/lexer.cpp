@@ -0,0 +1,231 @@
+#include <catch2/catch_session.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "corpus.hpp"
+#include "../src/parser/incremental.hpp"
+#include "../src/parser/lexer.hpp"
+#include "../src/parser/source.hpp"
+
+int main( int argc, char* argv[] ) {
+  int result = Catch::Session().run( argc, argv );
+  return result;
+}
+
+using torq::bench::CorpusKind;
+
+namespace {
+
+    const std::vector<CorpusKind> kinds = {
+        CorpusKind::IDENTIFIERS, CorpusKind::NUMBERS, CorpusKind::STRINGS, CorpusKind::COMMENTS, CorpusKind::MIXED
+    };
+
+    //the 100 MB sources live in the hidden [huge] cases
+    const std::vector<std::size_t> sizes = { 1024, 64 * 1024, 1024 * 1024 };
+    constexpr std::size_t HUGE_SIZE = 100 * 1024 * 1024;
+
+    std::string size_name(std::size_t bytes) {
+        if(bytes >= 1024 * 1024)
+            return std::to_string(bytes / (1024 * 1024)) + "MB";
+        return std::to_string(bytes / 1024) + "KB";
+    }
+
+    std::string label(const char *api, CorpusKind kind, std::size_t bytes) {
+        return std::string(api) + " " + torq::bench::corpus_name(kind) + " " + size_name(bytes);
+    }
+
+    std::size_t lex_all(torq::Lexer &l) {
+        std::size_t tokens = 0;
+        while(l.next().type != torq::EOS)
+            tokens++;
+        return tokens;
+    }
+
+    std::size_t peek_all(torq::Lexer &l) {
+        std::size_t tokens = 0;
+        while(l.peek().type != torq::EOS) {
+            l.next();
+            tokens++;
+        }
+        return tokens;
+    }
+
+    //Catch reports the time per run - this adds the throughput figures we track. Runs fn
+    //for at least a fifth of a second and reports the best run
+    template<typename F>
+    void report(const std::string &name, std::size_t bytes, F fn) {
+        using clock = std::chrono::steady_clock;
+
+        double best = 1e30;
+        double total = 0;
+        std::size_t tokens = 0;
+
+        for(int runs = 0; (runs < 3) || (total < 0.2); runs++) {
+            auto start = clock::now();
+            tokens = fn();
+            double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+            total += seconds;
+            if(seconds < best)
+                best = seconds;
+        }
+
+        std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << bytes / best / 1e6 << " MB/s"
+                  << std::setw(10) << tokens / best / 1e6 << " Mtok/s\n";
+    }
+
+    struct TempFile {
+        std::string path;
+        std::size_t size;
+
+        TempFile(const std::string &contents) : size(contents.size()) {
+            char name[] = "/tmp/torq_bench_XXXXXX";
+            int fd = mkstemp(name);
+            close(fd);
+            path = name;
+
+            std::ofstream out(path, std::ios::binary);
+            out << contents;
+        }
+
+        ~TempFile() { std::remove(path.c_str()); }
+    };
+
+    void bench_next(std::size_t bytes) {
+        for(CorpusKind kind : kinds) {
+            std::string source = torq::bench::generate_corpus(kind, bytes);
+            std::string name = label("next", kind, bytes);
+
+            BENCHMARK(std::string(name)) {
+                torq::Lexer l(source.data(), source.size());
+                return lex_all(l);
+            };
+
+            report(name, source.size(), [&] {
+                torq::Lexer l(source.data(), source.size());
+                return lex_all(l);
+            });
+        }
+    }
+
+    void bench_file(std::size_t bytes) {
+        for(CorpusKind kind : kinds) {
+            TempFile file(torq::bench::generate_corpus(kind, bytes));
+            std::size_t size = file.size;
+
+            std::string name = label("ifstream", kind, bytes);
+            BENCHMARK(std::string(name)) {
+                std::ifstream in(file.path);
+                torq::Lexer l(in);
+                return lex_all(l);
+            };
+            report(name, size, [&] {
+                std::ifstream in(file.path);
+                torq::Lexer l(in);
+                return lex_all(l);
+            });
+
+            name = label("mmap", kind, bytes);
+            BENCHMARK(std::string(name)) {
+                torq::Source source(file.path);
+                torq::Lexer l(source);
+                return lex_all(l);
+            };
+            report(name, size, [&] {
+                torq::Source source(file.path);
+                torq::Lexer l(source);
+                return lex_all(l);
+            });
+        }
+    }
+}
+
+TEST_CASE("Lexer::next()", "[bench][next]") {
+    for(std::size_t bytes : sizes)
+        bench_next(bytes);
+}
+
+TEST_CASE("Lexer::peek()", "[bench][peek]") {
+    for(std::size_t bytes : sizes) {
+        for(CorpusKind kind : kinds) {
+            std::string source = torq::bench::generate_corpus(kind, bytes);
+            std::string name = label("peek", kind, bytes);
+
+            BENCHMARK(std::string(name)) {
+                torq::Lexer l(source.data(), source.size());
+                return peek_all(l);
+            };
+
+            report(name, source.size(), [&] {
+                torq::Lexer l(source.data(), source.size());
+                return peek_all(l);
+            });
+        }
+    }
+}
+
+TEST_CASE("Lexer::tokenize_all()", "[bench][tokenize_all]") {
+    for(std::size_t bytes : sizes) {
+        for(CorpusKind kind : kinds) {
+            std::string source = torq::bench::generate_corpus(kind, bytes);
+            std::string name = label("tokenize_all", kind, bytes);
+
+            BENCHMARK(std::string(name)) {
+                torq::Lexer l(source.data(), source.size());
+                return l.tokenize_all().size();
+            };
+
+            report(name, source.size(), [&] {
+                torq::Lexer l(source.data(), source.size());
+                return l.tokenize_all().size() - 1;
+            });
+        }
+    }
+}
+
+TEST_CASE("IncrementalLexer::edit()", "[bench][edit]") {
+    //a keystroke typed and deleted again in the middle of the file, against lexing it all again
+    for(std::size_t bytes : sizes) {
+        std::string source = torq::bench::generate_corpus(CorpusKind::MIXED, bytes);
+        uint32_t middle = source.find('\n', source.size() / 2) + 1;
+
+        torq::IncrementalLexer inc(source);
+        BENCHMARK(label("edit", CorpusKind::MIXED, bytes)) {
+            inc.edit(middle, 0, "x");
+            inc.edit(middle, 1, "");
+            return inc.relexed();
+        };
+
+        BENCHMARK(label("relex", CorpusKind::MIXED, bytes)) {
+            source.insert(middle, 1, 'x');
+            source.erase(middle, 1);
+            torq::Lexer l(source.data(), source.size());
+            return lex_all(l);
+        };
+    }
+}
+
+TEST_CASE("file constructors", "[bench][file]") {
+    for(std::size_t bytes : sizes)
+        bench_file(bytes);
+}
+
+TEST_CASE("Lexer::next() on huge sources", "[.][bench][huge]") {
+    bench_next(HUGE_SIZE);
+}
+
+TEST_CASE("file constructors on huge sources", "[.][bench][huge]") {
+    bench_file(HUGE_SIZE);
+}
@@ -0,0 +1,95 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/compiler/loader.hpp"
+
+namespace {
+
+    constexpr int MODULES = 400;
+    constexpr int FUNCTIONS = 40;
+
+    //a generated project in a temporary directory - module i imports up to three lower
+    //numbered modules, main.tq imports every module
+    struct GeneratedProject {
+        std::string root;
+
+        GeneratedProject() {
+            char name[] = "/tmp/torq_project_XXXXXX";
+            root = mkdtemp(name);
+
+            std::string main;
+            for(int i = 0; i < MODULES; i++) {
+                std::string text;
+                for(int j = i - 1; (j >= 0) && (j >= i - 3); j--)
+                    text += "import m" + std::to_string(j * 7 % i) + "\n";
+
+                for(int k = 0; k < FUNCTIONS; k++) {
+                    std::string id = std::to_string(k);
+                    text += "LABEL" + id + " = \"module " + std::to_string(i) + " function " + id + "\"\n";
+                    text += "fn f" + id + "(int n): int\n"
+                            "    total = 0\n"
+                            "    for i = 1, n do\n"
+                            "        if i % 3 == 0 then total = total + i * " + id + " else total = total - 1 end\n"
+                            "    end\n"
+                            "    return total\n"
+                            "end\n";
+                }
+
+                std::ofstream(root + "/m" + std::to_string(i) + ".tq") << text;
+                main += "import m" + std::to_string(i) + "\n";
+            }
+            std::ofstream(root + "/main.tq") << main << "print(m0.f1(10))\n";
+        }
+
+        ~GeneratedProject() { std::filesystem::remove_all(root); }
+    };
+
+    double load_seconds(const GeneratedProject &project, unsigned threads) {
+        auto start = std::chrono::steady_clock::now();
+        torq::ModuleLoader loader(1, false, threads);
+        if(!loader.load(project.root + "/main.tq"))
+            std::abort();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+}
+
+TEST_CASE("ModuleLoader scaling", "[bench][loader]") {
+    GeneratedProject project;
+
+    std::vector<unsigned> counts;
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for(unsigned threads = 1; threads < cores; threads *= 2)
+        counts.push_back(threads);
+    counts.push_back(cores);
+
+    double single = 0;
+    for(unsigned threads : counts) {
+        std::string name = "load " + std::to_string(MODULES) + " modules, " + std::to_string(threads) + " threads";
+
+        BENCHMARK(std::string(name)) {
+            return load_seconds(project, threads);
+        };
+
+        double best = 1e30;
+        for(int run = 0; run < 3; run++)
+            best = std::min(best, load_seconds(project, threads));
+        if(threads == 1)
+            single = best;
+
+        std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(10) << MODULES / best << " mod/s"
+                  << std::setw(10) << single / best << "x\n";
+    }
+}
@@ -0,0 +1,86 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "../src/compiler/compiler.hpp"
+#include "../src/compiler/optimizer.hpp"
+#include "../src/parser/lexer.hpp"
+#include "../src/parser/parser.hpp"
+#include "../src/vm/vm.hpp"
+
+namespace {
+
+    //the same numeric scripts the superinstructions were picked from
+    const char *const PROGRAMS[] = {"loops", "floats", "lists"};
+
+    std::string read_program(const std::string &name) {
+        std::ifstream in(std::string(TORQ_BENCH_PROGRAMS) + "/" + name + ".tq");
+        std::stringstream text;
+        text << in.rdbuf();
+        if(text.str().empty())
+            std::abort();
+        return text.str();
+    }
+
+    void compile(const std::string &source, bool fuse, torq::Program &program) {
+        torq::Lexer l(source);
+        torq::Parser p(l);
+        torq::Ast ast = p.parse();
+        torq::Optimizer(ast, 1).run();
+        torq::Compiler c(ast, source, 1, fuse);
+        if(!ast.ok() || !c.compile(program))
+            std::abort();
+    }
+
+    struct Run {
+        double seconds;
+        uint64_t dispatches;
+    };
+
+    Run run(const torq::Program &program) {
+        std::ostringstream out;
+        torq::VM vm(out);
+        auto start = std::chrono::steady_clock::now();
+        if(!vm.run(program))
+            std::abort();
+        return {std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), vm.instructions()};
+    }
+
+    Run best_of(const torq::Program &program) {
+        Run best = run(program);
+        for(int i = 0; i < 2; i++)
+            best.seconds = std::min(best.seconds, run(program).seconds);
+        return best;
+    }
+
+}
+
+TEST_CASE("superinstructions", "[bench][vm]") {
+    for(const char *name : PROGRAMS) {
+        std::string source = read_program(name);
+        torq::Program unfused, fused;
+        compile(source, false, unfused);
+        compile(source, true, fused);
+
+        BENCHMARK(std::string(name) + ", unfused") {
+            return run(unfused).dispatches;
+        };
+        BENCHMARK(std::string(name) + ", superinstructions") {
+            return run(fused).dispatches;
+        };
+
+        //dispatches only add up when built with stats
+        Run before = best_of(unfused), after = best_of(fused);
+        std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(14) << before.dispatches / 1e6 << " M -> " << after.dispatches / 1e6 << " M dispatches"
+                  << std::setw(10) << before.seconds / after.seconds << "x\n";
+    }
+}
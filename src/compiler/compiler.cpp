@@ -0,0 +1,1040 @@
+#include "compiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "optimizer.hpp"
+#include "../parser/lexer.hpp"
+
+namespace torq {
+
+    namespace {
+        constexpr uint32_t NO_STRING = UINT32_MAX;
+    }
+
+    Compiler::Compiler(const Ast &ast, std::string_view source, int level, bool fuse) : ast(ast), source(source), level(level), fusing(fuse), program(nullptr),
+        fs(nullptr), offset(0), out_of_registers(false) {
+    }
+
+    void Compiler::error(uint32_t at, std::string message) {
+        errors.push_back({at, std::move(message)});
+    }
+
+
+    bool Compiler::compile(Program &program) {
+        this->program = &program;
+
+        symbol_strings.assign(ast.symbols->size(), NO_STRING);
+        format_symbols.assign(ast.symbols->size(), false);
+        //compiled programs often outlive the text they came from
+        program.set_source(source);
+        program.index_lines();
+
+        compile_function(ast.root);
+
+        if(!errors.empty())
+            return false;
+
+        program.link();
+        return true;
+    }
+
+    //the module root compiles as function 0, FUNCTION nodes as their own prototypes. Code is
+    //collected per function and appended once the function is complete, so a nested function
+    //never interleaves with its parent
+    uint32_t Compiler::compile_function(NodeId id) {
+        const Node &node = ast[id];
+        bool top_level = (node.kind == NodeKind::MODULE);
+
+        FunctionState state;
+        state.index = program->storage.functions.size();
+        state.top_level = top_level;
+        state.params = 0;
+        state.next_register = 0;
+        state.max_registers = 0;
+
+        program->storage.functions.push_back({});
+        FunctionProto proto{};
+        proto.name = top_level ? string_index(std::string_view("<main>")) : string_index(node.symbol);
+
+        FunctionState *parent = fs;
+        uint32_t parent_offset = offset;
+        fs = &state;
+        offset = node.offset;
+
+        if(top_level) {
+            for(NodeId statement_id : ast.list(node))
+                statement(statement_id);
+        } else {
+            auto params = ast.list(node);
+            if(params.size() > MAX_REGISTERS) {
+                error(node.offset, "too many parameters");
+            } else {
+                for(NodeId param : params)
+                    state.locals.push_back({ast[param].symbol, allocate(), ast[param].type});
+            }
+            state.params = state.locals.size();
+            proto.params = state.params;
+
+            collect_locals(node.a);
+            infer_locals(node.a);
+
+            //arguments are checked once on entry, typed locals start at their zero so they
+            //hold the right kind of value even if read before their declaration runs
+            for(std::size_t i = 0; i < state.locals.size(); i++) {
+                const Local &local = state.locals[i];
+                if(i < state.params) {
+                    offset = ast[params[i]].offset;
+                    coerce(local.reg, ValueType::NONE, local.type, local.symbol);
+                } else if(local.type != ValueType::NONE) {
+                    load_zero(local.reg, local.type);
+                }
+            }
+            offset = node.offset;
+
+            block(node.a);
+        }
+
+        offset = top_level ? static_cast<uint32_t>(source.size()) : node.offset;
+        emit(make_abc(Op::RETURN, 0, 0, 0));
+
+        if(level > 0) {
+            peephole(state.code, state.offsets);
+            if(fusing)
+                fuse(state.code);
+        }
+
+        proto.code_start = program->storage.code.size();
+        proto.code_size = state.code.size();
+        proto.registers = state.max_registers;
+        program->storage.functions[state.index] = proto;
+
+        program->storage.code.insert(program->storage.code.end(), state.code.begin(), state.code.end());
+        program->storage.offsets.insert(program->storage.offsets.end(), state.offsets.begin(), state.offsets.end());
+
+        fs = parent;
+        offset = parent_offset;
+        return state.index;
+    }
+
+    //every name a function body assigns, declares or defines gets a register up front
+    void Compiler::collect_locals(NodeId id) {
+        if(id == NO_NODE)
+            return;
+
+        const Node &node = ast[id];
+        switch(node.kind) {
+            case NodeKind::BLOCK:
+                for(NodeId child : ast.list(node))
+                    collect_locals(child);
+                break;
+
+            case NodeKind::IF:
+                collect_locals(node.b);
+                collect_locals(node.c);
+                break;
+
+            case NodeKind::WHILE:
+                collect_locals(node.b);
+                break;
+
+            case NodeKind::FOR:
+                collect_locals(node.a);
+                break;
+
+            case NodeKind::ASSIGN:
+                if(ast[node.a].kind != NodeKind::NAME)
+                    break;
+                [[fallthrough]];
+            case NodeKind::FUNCTION:
+                if(resolve(node.symbol) < 0)
+                    fs->locals.push_back({node.symbol, allocate(), ValueType::NONE});
+                break;
+
+            case NodeKind::DECLARE: {
+                int index = find_local(node.symbol);
+                if(index < 0) {
+                    fs->locals.push_back({node.symbol, allocate(), node.type});
+                } else if(fs->locals[index].type != node.type) {
+                    //one register, one type
+                    if( (static_cast<std::size_t>(index) < fs->params) || (fs->locals[index].type != ValueType::NONE) ) {
+                        error(node.offset, "'" + std::string(ast.name(node.symbol)) + "' is already declared as " +
+                            value_type_name(fs->locals[index].type));
+                    } else {
+                        fs->locals[index].type = node.type;
+                    }
+                }
+                break;
+            }
+
+            case NodeKind::IMPORT: {
+                std::string_view name = ast.name(node.symbol);
+                std::size_t dot = name.rfind('.');
+                if(dot == std::string_view::npos) {
+                    if(resolve(node.symbol) < 0)
+                        fs->locals.push_back({node.symbol, allocate(), ValueType::NONE});
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+
+    std::size_t Compiler::emit(Instr instr) {
+        fs->code.push_back(instr);
+        fs->offsets.push_back(offset);
+        return fs->code.size() - 1;
+    }
+
+    std::size_t Compiler::emit_jump(Op op, unsigned a) {
+        return emit(make_asbx(op, a, 0));
+    }
+
+    //points a forward jump at the next instruction to be emitted
+    void Compiler::patch(std::size_t jump) {
+        long distance = static_cast<long>(fs->code.size()) - static_cast<long>(jump) - 1;
+        if(distance > MAX_SBX) {
+            error(fs->offsets[jump], "jump too far");
+            return;
+        }
+        Instr instr = fs->code[jump];
+        fs->code[jump] = make_asbx(op_of(instr), arg_a(instr), distance);
+    }
+
+    void Compiler::jump_back(Op op, unsigned a, std::size_t target) {
+        long distance = static_cast<long>(target) - static_cast<long>(fs->code.size()) - 1;
+        if(distance < MIN_SBX) {
+            error(offset, "jump too far");
+            distance = 0;
+        }
+        emit(make_asbx(op, a, distance));
+    }
+
+    unsigned Compiler::allocate(unsigned count) {
+        if(fs->next_register + count > MAX_REGISTERS) {
+            if(!out_of_registers)
+                error(offset, "function needs too many registers");
+            out_of_registers = true;
+            return 0;
+        }
+
+        unsigned reg = fs->next_register;
+        fs->next_register += count;
+        if(fs->next_register > fs->max_registers)
+            fs->max_registers = fs->next_register;
+        return reg;
+    }
+
+    int Compiler::find_local(SymbolId symbol) const {
+        for(std::size_t i = fs->locals.size(); i > 0; i--) {
+            if(fs->locals[i - 1].symbol == symbol)
+                return i - 1;
+        }
+        return -1;
+    }
+
+    int Compiler::resolve(SymbolId symbol) const {
+        int index = find_local(symbol);
+        return (index < 0) ? -1 : static_cast<int>(fs->locals[index].reg);
+    }
+
+    bool Compiler::is_local(unsigned reg) const {
+        for(const Local &local : fs->locals) {
+            if(local.reg == reg)
+                return true;
+        }
+        return false;
+    }
+
+
+    uint32_t Compiler::string_index(SymbolId symbol) {
+        if(symbol_strings[symbol] == NO_STRING)
+            symbol_strings[symbol] = string_index(ast.name(symbol));
+        return symbol_strings[symbol];
+    }
+
+    uint32_t Compiler::string_index(std::string_view text) {
+        if(program->storage.string_refs.size() > MAX_BX) {
+            error(offset, "too many strings");
+            return 0;
+        }
+        return program->add_string(text);
+    }
+
+    //ints too wide for a Value take two entries, see wide_constant()
+    uint32_t Compiler::int_constant(int64_t value) {
+        auto [it, added] = int_constants.try_emplace(value, program->storage.constants.size());
+        if(added) {
+            auto &constants = program->storage.constants;
+            if(Value::fits(value)) {
+                constants.push_back(Value::small_int(value));
+            } else {
+                constants.push_back(Value::small_int(value >> 32));
+                constants.push_back(Value::small_int(static_cast<uint32_t>(value)));
+            }
+        }
+        if(it->second + (Value::fits(value) ? 0 : 1) > MAX_BX) {
+            error(offset, "too many constants");
+            return 0;
+        }
+        return it->second;
+    }
+
+    uint32_t Compiler::float_constant(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        auto [it, added] = float_constants.try_emplace(bits, program->storage.constants.size());
+        if(added)
+            program->storage.constants.push_back(Value::number(value));
+        if(it->second > MAX_BX) {
+            error(offset, "too many constants");
+            return 0;
+        }
+        return it->second;
+    }
+
+
+    void Compiler::block(NodeId id) {
+        if(id == NO_NODE)
+            return;
+
+        for(NodeId statement_id : ast.list(ast[id]))
+            statement(statement_id);
+    }
+
+    void Compiler::statement(NodeId id) {
+        const Node &node = ast[id];
+        unsigned mark = fs->next_register;
+        offset = node.offset;
+
+        switch(node.kind) {
+            case NodeKind::BLOCK:
+                block(id);
+                break;
+
+            case NodeKind::EXPR_STMT:
+                expression(node.a, allocate());
+                break;
+
+            case NodeKind::ASSIGN: {
+                const Node &target = ast[node.a];
+
+                if(target.kind == NodeKind::NAME) {
+                    assign_name(target.symbol, node.b);
+                } else {
+                    //INDEX or MEMBER
+                    unsigned object = operand(target.a);
+                    unsigned key;
+                    if(target.kind == NodeKind::INDEX) {
+                        key = operand(target.b);
+                    } else {
+                        key = allocate();
+                        emit(make_abx(Op::LOADSTR, key, string_index(target.symbol)));
+                    }
+                    unsigned value = operand(node.b);
+                    offset = node.offset;
+                    emit(make_abc(Op::SETINDEX, object, key, value));
+                }
+                break;
+            }
+
+            case NodeKind::DECLARE: {
+                if( (node.b != NO_NODE) && (find_local(node.symbol) < 0) ) {
+                    //a typed global - the annotation is checked where it's declared
+                    unsigned reg = allocate();
+                    expression(node.b, reg);
+                    offset = node.offset;
+                    coerce(reg, type_of(node.b), node.type, node.symbol);
+                    store_name(node.symbol, reg, node.type);
+                    break;
+                }
+
+                if(node.b != NO_NODE) {
+                    assign_name(node.symbol, node.b);
+                    break;
+                }
+
+                //typed declarations without a value start at that type's zero
+                unsigned reg = (resolve(node.symbol) >= 0) ? resolve(node.symbol) : allocate();
+                load_zero(reg, node.type);
+                store_name(node.symbol, reg, node.type);
+                break;
+            }
+
+            case NodeKind::IF:
+                if_statement(node);
+                break;
+
+            case NodeKind::WHILE:
+                while_statement(node);
+                break;
+
+            case NodeKind::FOR:
+                for_statement(node);
+                break;
+
+            case NodeKind::RETURN:
+                if(node.a == NO_NODE) {
+                    emit(make_abc(Op::RETURN, 0, 0, 0));
+                } else {
+                    unsigned value = operand(node.a);
+                    offset = node.offset;
+                    emit(make_abc(Op::RETURN, value, 1, 0));
+                }
+                break;
+
+            case NodeKind::BREAK:
+                if(fs->breaks.empty())
+                    error(node.offset, "break outside a loop");
+                else
+                    fs->breaks.back().push_back(emit_jump(Op::JMP));
+                break;
+
+            case NodeKind::FUNCTION: {
+                uint32_t index = compile_function(id);
+                int local = resolve(node.symbol);
+                unsigned reg = (local >= 0) ? local : allocate();
+                emit(make_abx(Op::LOADFN, reg, index));
+                store_name(node.symbol, reg, ValueType::NONE);
+                break;
+            }
+
+            case NodeKind::IMPORT: {
+                //import a.b binds the module to b
+                std::string_view name = ast.name(node.symbol);
+                std::size_t dot = name.rfind('.');
+                int local = resolve(node.symbol);
+                unsigned reg = ((local >= 0) && (dot == std::string_view::npos)) ? local : allocate();
+
+                emit(make_abx(Op::IMPORT, reg, string_index(node.symbol)));
+
+                if(dot == std::string_view::npos) {
+                    store_name(node.symbol, reg, ValueType::NONE);
+                } else if(fs->top_level) {
+                    emit(make_abx(Op::SETGLOBAL, reg, string_index(name.substr(dot + 1))));
+                } else {
+                    error(node.offset, "dotted imports are only allowed at module level");
+                }
+                break;
+            }
+
+            case NodeKind::ERROR:
+                break;
+
+            default: {
+                //any other node is an expression, evaluated for its side effects
+                expression(id, allocate());
+                break;
+            }
+        }
+
+        fs->next_register = mark;
+    }
+
+    void Compiler::assign_name(SymbolId symbol, NodeId value) {
+        int index = find_local(symbol);
+        if(index >= 0) {
+            Local local = fs->locals[index];
+            ValueType type = type_of(value);
+
+            if( (local.type == ValueType::FLOAT) && (ast[value].kind == NodeKind::INT_LITERAL) ) {
+                emit(make_abx(Op::LOADK, local.reg, float_constant(static_cast<double>(ast[value].i_value))));
+                return;
+            }
+
+            expression(value, local.reg);
+            coerce(local.reg, type, local.type, symbol);
+            return;
+        }
+
+        unsigned reg = operand(value);
+        store_name(symbol, reg, ValueType::NONE);
+    }
+
+    //a value already in reg becomes the name's value - a move for locals, a store for globals
+    void Compiler::store_name(SymbolId symbol, unsigned reg, ValueType type) {
+        int index = find_local(symbol);
+        if(index >= 0) {
+            Local local = fs->locals[index];
+            if(local.reg != reg)
+                emit(make_abc(Op::MOVE, local.reg, reg, 0));
+            coerce(local.reg, type, local.type, symbol);
+        } else {
+            emit(make_abx(Op::SETGLOBAL, reg, string_index(symbol)));
+        }
+    }
+
+    void Compiler::if_statement(const Node &node) {
+        unsigned mark = fs->next_register;
+        unsigned condition = operand(node.a);
+        std::size_t skip_then = emit_jump(Op::JMPIFNOT, condition);
+        fs->next_register = mark;
+
+        block(node.b);
+
+        if(node.c == NO_NODE) {
+            patch(skip_then);
+            return;
+        }
+
+        std::size_t skip_else = emit_jump(Op::JMP);
+        patch(skip_then);
+
+        if(ast[node.c].kind == NodeKind::IF)
+            statement(node.c);
+        else
+            block(node.c);
+
+        patch(skip_else);
+    }
+
+    void Compiler::while_statement(const Node &node) {
+        std::size_t start = fs->code.size();
+
+        unsigned mark = fs->next_register;
+        unsigned condition = operand(node.a);
+        std::size_t exit = emit_jump(Op::JMPIFNOT, condition);
+        fs->next_register = mark;
+
+        fs->breaks.emplace_back();
+        block(node.b);
+
+        offset = node.offset;
+        jump_back(Op::JMP, 0, start);
+
+        patch(exit);
+        for(std::size_t jump : fs->breaks.back())
+            patch(jump);
+        fs->breaks.pop_back();
+    }
+
+    //four consecutive registers: the hidden counter, limit and step, then the loop variable,
+    //which is only visible inside the body
+    void Compiler::for_statement(const Node &node) {
+        auto bounds = ast.list(node);
+        if(bounds.size() < 2)
+            return;
+
+        bool ints = true;
+        for(NodeId bound : bounds)
+            ints = ints && (type_of(bound) == ValueType::INT);
+        ValueType var_type = loop_type(node);
+
+        unsigned base = allocate(4);
+        expression(bounds[0], base);
+        expression(bounds[1], base + 1);
+        if(bounds.size() > 2)
+            expression(bounds[2], base + 2);
+        else
+            emit(make_asbx(Op::LOADINT, base + 2, 1));
+
+        offset = node.offset;
+        std::size_t prep = emit_jump(ints ? Op::FORPREP_I64 : Op::FORPREP, base);
+        std::size_t body = fs->code.size();
+
+        fs->locals.push_back({node.symbol, base + 3, var_type});
+        fs->breaks.emplace_back();
+        block(node.a);
+        fs->locals.pop_back();
+
+        offset = node.offset;
+        jump_back(ints ? Op::FORLOOP_I64 : Op::FORLOOP, base, body);
+
+        patch(prep);
+        for(std::size_t jump : fs->breaks.back())
+            patch(jump);
+        fs->breaks.pop_back();
+    }
+
+
+    void Compiler::load_int(unsigned dest, int64_t value) {
+        if( (value >= MIN_SBX) && (value <= MAX_SBX) )
+            emit(make_asbx(Op::LOADINT, dest, static_cast<int>(value)));
+        else if(Value::fits(value))
+            emit(make_abx(Op::LOADK, dest, int_constant(value)));
+        else
+            emit(make_abx(Op::LOADI64, dest, int_constant(value)));
+    }
+
+    void Compiler::load_zero(unsigned dest, ValueType type) {
+        switch(type) {
+            case ValueType::INT: emit(make_asbx(Op::LOADINT, dest, 0)); break;
+            case ValueType::FLOAT: emit(make_abx(Op::LOADK, dest, float_constant(0.0))); break;
+            case ValueType::STRING: emit(make_abx(Op::LOADSTR, dest, string_index(std::string_view()))); break;
+            case ValueType::BOOL: emit(make_abc(Op::LOADBOOL, dest, 0, 0)); break;
+            default: emit(make_abc(Op::LOADNIL, dest, 0, 0)); break;
+        }
+    }
+
+    //register holding the value of an expression: a local's own register, or a new temporary
+    unsigned Compiler::operand(NodeId id) {
+        const Node &node = ast[id];
+        if(node.kind == NodeKind::NAME) {
+            int local = resolve(node.symbol);
+            if(local >= 0)
+                return local;
+        }
+
+        unsigned reg = allocate();
+        expression(id, reg);
+        return reg;
+    }
+
+    //operand of a float instruction - ints are converted, literals at compile time
+    unsigned Compiler::numeric_operand(NodeId id, bool to_float) {
+        if(!to_float)
+            return operand(id);
+
+        unsigned reg = allocate();
+        if(ast[id].kind == NodeKind::INT_LITERAL) {
+            emit(make_abx(Op::LOADK, reg, float_constant(static_cast<double>(ast[id].i_value))));
+        } else {
+            unsigned value = operand(id);
+            emit(make_abc(Op::TOF64, reg, value, 0));
+        }
+        return reg;
+    }
+
+    void Compiler::expression(NodeId id, unsigned dest) {
+        const Node &node = ast[id];
+        unsigned mark = fs->next_register;
+        uint32_t saved = offset;
+        offset = node.offset;
+
+        switch(node.kind) {
+            case NodeKind::INT_LITERAL:
+                load_int(dest, node.i_value);
+                break;
+
+            case NodeKind::FLOAT_LITERAL:
+                emit(make_abx(Op::LOADK, dest, float_constant(node.f_value)));
+                break;
+
+            case NodeKind::STRING_LITERAL:
+                emit(make_abx(Op::LOADSTR, dest, string_index(node.symbol)));
+                break;
+
+            case NodeKind::BOOL_LITERAL:
+                emit(make_abc(Op::LOADBOOL, dest, node.i_value != 0, 0));
+                break;
+
+            case NodeKind::LIST_LITERAL: {
+                auto items = ast.list(node);
+                if(items.size() > MAX_REGISTERS) {
+                    error(node.offset, "list literal has too many elements");
+                    break;
+                }
+                unsigned base = allocate(items.size());
+                for(std::size_t i = 0; i < items.size(); i++)
+                    expression(items[i], base + i);
+                offset = node.offset;
+                emit(make_abc(Op::NEWLIST, dest, base, items.size()));
+                break;
+            }
+
+            case NodeKind::NAME: {
+                int local = resolve(node.symbol);
+                if(local < 0)
+                    emit(make_abx(Op::GETGLOBAL, dest, string_index(node.symbol)));
+                else if(static_cast<unsigned>(local) != dest)
+                    emit(make_abc(Op::MOVE, dest, local, 0));
+                break;
+            }
+
+            case NodeKind::UNARY: {
+                ValueType type = type_of(node.a);
+                unsigned value = operand(node.a);
+                offset = node.offset;
+
+                Op op = Op::NOT;
+                if(node.op == MINUS)
+                    op = (type == ValueType::INT) ? Op::NEG_I64 : (type == ValueType::FLOAT) ? Op::NEG_F64 : Op::NEG;
+                emit(make_abc(op, dest, value, 0));
+                break;
+            }
+
+            case NodeKind::BINARY: {
+                //both ints, or both numbers with at least one float, get the typed instruction
+                ValueType left_type = type_of(node.a), right_type = type_of(node.b);
+                bool left_number = (left_type == ValueType::INT) || (left_type == ValueType::FLOAT);
+                bool right_number = (right_type == ValueType::INT) || (right_type == ValueType::FLOAT);
+                bool ints = (left_type == ValueType::INT) && (right_type == ValueType::INT);
+                bool floats = left_number && right_number && !ints;
+
+                unsigned left = floats ? numeric_operand(node.a, left_type == ValueType::INT) : operand(node.a);
+                unsigned right = floats ? numeric_operand(node.b, right_type == ValueType::INT) : operand(node.b);
+                offset = node.offset;
+
+                auto pick = [&](Op generic, Op i64, Op f64) { return ints ? i64 : floats ? f64 : generic; };
+
+                Op op;
+                switch(node.op) {
+                    case PLUS: op = pick(Op::ADD, Op::ADD_I64, Op::ADD_F64); break;
+                    case MINUS: op = pick(Op::SUB, Op::SUB_I64, Op::SUB_F64); break;
+                    case STAR: op = pick(Op::MUL, Op::MUL_I64, Op::MUL_F64); break;
+                    case SLASH: op = pick(Op::DIV, Op::DIV_I64, Op::DIV_F64); break;
+                    case PERCENT: op = pick(Op::MOD, Op::MOD_I64, Op::MOD_F64); break;
+                    case EQUALS: op = pick(Op::EQ, Op::EQ_I64, Op::EQ_F64); break;
+                    case NOTEQUALS: op = pick(Op::NE, Op::NE_I64, Op::NE_F64); break;
+                    case LT: op = pick(Op::LT, Op::LT_I64, Op::LT_F64); break;
+                    case LTE: op = pick(Op::LE, Op::LE_I64, Op::LE_F64); break;
+                    //a > b is b < a
+                    case GT: op = pick(Op::LT, Op::LT_I64, Op::LT_F64); std::swap(left, right); break;
+                    case GTE: op = pick(Op::LE, Op::LE_I64, Op::LE_F64); std::swap(left, right); break;
+                    default:
+                        error(node.offset, "unknown operator");
+                        op = Op::ADD;
+                }
+                emit(make_abc(op, dest, left, right));
+                break;
+            }
+
+            case NodeKind::CALL:
+                call(node, dest);
+                break;
+
+            case NodeKind::INDEX: {
+                unsigned target = operand(node.a);
+                unsigned index = operand(node.b);
+                offset = node.offset;
+                emit(make_abc(Op::GETINDEX, dest, target, index));
+                break;
+            }
+
+            case NodeKind::MEMBER: {
+                unsigned target = operand(node.a);
+                unsigned key = allocate();
+                emit(make_abx(Op::LOADSTR, key, string_index(node.symbol)));
+                offset = node.offset;
+                emit(make_abc(Op::GETINDEX, dest, target, key));
+                break;
+            }
+
+            default:
+                error(node.offset, std::string("cannot compile ") + node_kind_name(node.kind) + " as an expression");
+                break;
+        }
+
+        fs->next_register = mark;
+        offset = saved;
+    }
+
+    //callee and arguments go in consecutive registers. When dest is the newest temporary the
+    //call is built in place and no move is needed - never in a local, the arguments may read it
+    void Compiler::call(const Node &node, unsigned dest) {
+        auto args = ast.list(node);
+        if(args.size() >= MAX_REGISTERS) {
+            error(node.offset, "too many arguments");
+            return;
+        }
+
+        bool in_place = (dest + 1 == fs->next_register) && !is_local(dest);
+        unsigned base = in_place ? dest : allocate();
+        allocate(args.size());
+
+        expression(node.a, base);
+        for(std::size_t i = 0; i < args.size(); i++)
+            expression(args[i], base + 1 + i);
+
+        //a literal format is parsed now instead of on every call
+        if( !args.empty() && (ast[args[0]].kind == NodeKind::STRING_LITERAL) && calls_print(node.a) &&
+            !format_symbols[ast[args[0]].symbol] ) {
+            format_symbols[ast[args[0]].symbol] = true;
+            program->add_format(string_index(ast[args[0]].symbol));
+        }
+
+        offset = node.offset;
+        emit(make_abc(Op::CALL, base, args.size(), 0));
+        if(base != dest)
+            emit(make_abc(Op::MOVE, dest, base, 0));
+    }
+
+    //print or std.print, unless a local hides it. A global print could still be reassigned,
+    //then the plan just goes unused
+    bool Compiler::calls_print(NodeId callee) const {
+        const Node &node = ast[callee];
+        if(node.kind == NodeKind::NAME)
+            return (ast.name(node.symbol) == "print") && (find_local(node.symbol) < 0);
+
+        return (node.kind == NodeKind::MEMBER) && (ast.name(node.symbol) == "print") &&
+            (ast[node.a].kind == NodeKind::NAME) && (ast.name(ast[node.a].symbol) == "std") &&
+            (find_local(ast[node.a].symbol) < 0);
+    }
+
+
+    //static type of an expression under the current locals, NONE when it depends on runtime
+    ValueType Compiler::type_of(NodeId id) const {
+        const Node &node = ast[id];
+
+        switch(node.kind) {
+            case NodeKind::INT_LITERAL: return ValueType::INT;
+            case NodeKind::FLOAT_LITERAL: return ValueType::FLOAT;
+            case NodeKind::STRING_LITERAL: return ValueType::STRING;
+            case NodeKind::BOOL_LITERAL: return ValueType::BOOL;
+
+            case NodeKind::NAME: {
+                int index = find_local(node.symbol);
+                return (index < 0) ? ValueType::NONE : fs->locals[index].type;
+            }
+
+            case NodeKind::UNARY: {
+                if(node.op != MINUS)
+                    return ValueType::BOOL;
+                ValueType type = type_of(node.a);
+                return ( (type == ValueType::INT) || (type == ValueType::FLOAT) ) ? type : ValueType::NONE;
+            }
+
+            case NodeKind::BINARY: {
+                switch(node.op) {
+                    case EQUALS: case NOTEQUALS: case LT: case LTE: case GT: case GTE:
+                        return ValueType::BOOL;
+                    default:
+                        break;
+                }
+
+                ValueType left = type_of(node.a), right = type_of(node.b);
+                if( (left == ValueType::INT) && (right == ValueType::INT) )
+                    return ValueType::INT;
+                if( ((left == ValueType::INT) || (left == ValueType::FLOAT)) && ((right == ValueType::INT) || (right == ValueType::FLOAT)) )
+                    return ValueType::FLOAT;
+                if( (node.op == PLUS) && (left == ValueType::STRING) && (right == ValueType::STRING) )
+                    return ValueType::STRING;
+                return ValueType::NONE;
+            }
+
+            default:
+                return ValueType::NONE;
+        }
+    }
+
+    //all int bounds count in ints, any float makes the loop count in floats. A body that
+    //assigns the variable itself leaves it untyped
+    ValueType Compiler::loop_type(const Node &node) const {
+        bool ints = true;
+        for(NodeId bound : ast.list(node)) {
+            ValueType type = type_of(bound);
+            if( (type != ValueType::INT) && (type != ValueType::FLOAT) )
+                return ValueType::NONE;
+            ints = ints && (type == ValueType::INT);
+        }
+
+        if(assigns(node.a, node.symbol))
+            return ValueType::NONE;
+        return ints ? ValueType::INT : ValueType::FLOAT;
+    }
+
+    //whether a subtree reads or writes a name. Nested functions are a scope of their own
+    bool Compiler::mentions(NodeId id, SymbolId symbol) const {
+        if(id == NO_NODE)
+            return false;
+
+        const Node &node = ast[id];
+        switch(node.kind) {
+            case NodeKind::NAME:
+            case NodeKind::IMPORT:
+            case NodeKind::FUNCTION:
+                return node.symbol == symbol;
+
+            case NodeKind::UNARY:
+            case NodeKind::MEMBER:
+            case NodeKind::EXPR_STMT:
+            case NodeKind::RETURN:
+                return mentions(node.a, symbol);
+
+            case NodeKind::BINARY:
+            case NodeKind::INDEX:
+            case NodeKind::ASSIGN:
+            case NodeKind::WHILE:
+                return mentions(node.a, symbol) || mentions(node.b, symbol);
+
+            case NodeKind::DECLARE:
+                return (node.symbol == symbol) || mentions(node.b, symbol);
+
+            case NodeKind::IF:
+                return mentions(node.a, symbol) || mentions(node.b, symbol) || mentions(node.c, symbol);
+
+            case NodeKind::FOR:
+                if( (node.symbol == symbol) || mentions(node.a, symbol) )
+                    return true;
+                [[fallthrough]];
+            case NodeKind::LIST_LITERAL:
+            case NodeKind::BLOCK:
+                for(NodeId child : ast.list(node)) {
+                    if(mentions(child, symbol))
+                        return true;
+                }
+                return false;
+
+            case NodeKind::CALL:
+                if(mentions(node.a, symbol))
+                    return true;
+                for(NodeId child : ast.list(node)) {
+                    if(mentions(child, symbol))
+                        return true;
+                }
+                return false;
+
+            default:
+                return false;
+        }
+    }
+
+    //whether any statement in a subtree stores to a name
+    bool Compiler::assigns(NodeId id, SymbolId symbol) const {
+        if(id == NO_NODE)
+            return false;
+
+        const Node &node = ast[id];
+        switch(node.kind) {
+            case NodeKind::BLOCK:
+                for(NodeId child : ast.list(node)) {
+                    if(assigns(child, symbol))
+                        return true;
+                }
+                return false;
+
+            case NodeKind::IF:
+                return assigns(node.b, symbol) || assigns(node.c, symbol);
+            case NodeKind::WHILE:
+                return assigns(node.b, symbol);
+            case NodeKind::FOR:
+                return assigns(node.a, symbol);
+
+            case NodeKind::ASSIGN:
+                return (ast[node.a].kind == NodeKind::NAME) && (node.symbol == symbol);
+            case NodeKind::DECLARE:
+            case NodeKind::FUNCTION:
+            case NodeKind::IMPORT:
+                return node.symbol == symbol;
+
+            default:
+                return false;
+        }
+    }
+
+    //types of the values stored to each of the first count locals, with loop variables in
+    //scope the way the emitter will see them
+    void Compiler::assignment_types(NodeId id, std::size_t count, std::vector<std::pair<std::size_t, ValueType>> &out) {
+        if(id == NO_NODE)
+            return;
+
+        const Node &node = ast[id];
+        switch(node.kind) {
+            case NodeKind::BLOCK:
+                for(NodeId child : ast.list(node))
+                    assignment_types(child, count, out);
+                break;
+
+            case NodeKind::IF:
+                assignment_types(node.b, count, out);
+                assignment_types(node.c, count, out);
+                break;
+
+            case NodeKind::WHILE:
+                assignment_types(node.b, count, out);
+                break;
+
+            case NodeKind::FOR:
+                fs->locals.push_back({node.symbol, MAX_REGISTERS, loop_type(node)});
+                assignment_types(node.a, count, out);
+                fs->locals.pop_back();
+                break;
+
+            case NodeKind::ASSIGN:
+            case NodeKind::FUNCTION: {
+                if( (node.kind == NodeKind::ASSIGN) && (ast[node.a].kind != NodeKind::NAME) )
+                    break;
+                int index = find_local(node.symbol);
+                if( (index >= 0) && (static_cast<std::size_t>(index) < count) )
+                    out.push_back({index, (node.kind == NodeKind::ASSIGN) ? type_of(node.b) : ValueType::NONE});
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    //an untyped local gets a type when one of its assignments runs before any use of it and
+    //every assignment stores the same type. Candidates start at the type of that first
+    //assignment and drop to NONE when another assignment disagrees, until nothing changes
+    void Compiler::infer_locals(NodeId body) {
+        if(body == NO_NODE)
+            return;
+
+        auto statements = ast.list(ast[body]);
+        std::vector<std::pair<std::size_t, std::size_t>> candidates;     //statement, local
+
+        for(std::size_t i = fs->params; i < fs->locals.size(); i++) {
+            SymbolId symbol = fs->locals[i].symbol;
+            if(fs->locals[i].type != ValueType::NONE)
+                continue;
+
+            for(std::size_t s = 0; s < statements.size(); s++) {
+                if(!mentions(statements[s], symbol))
+                    continue;
+
+                const Node &first = ast[statements[s]];
+                if( (first.kind == NodeKind::ASSIGN) && (ast[first.a].kind == NodeKind::NAME) &&
+                    (first.symbol == symbol) && !mentions(first.b, symbol) )
+                    candidates.push_back({s, i});
+                break;
+            }
+        }
+
+        if(candidates.empty())
+            return;
+
+        //in statement order, so a first assignment only reads candidates already guessed
+        std::sort(candidates.begin(), candidates.end());
+        for(auto [s, i] : candidates)
+            fs->locals[i].type = type_of(ast[statements[s]].b);
+
+        std::vector<std::pair<std::size_t, ValueType>> stores;
+        std::size_t count = fs->locals.size();
+        bool changed = true;
+
+        while(changed) {
+            changed = false;
+            stores.clear();
+            assignment_types(body, count, stores);
+
+            for(auto [index, type] : stores) {
+                Local &local = fs->locals[index];
+                if( (local.type != ValueType::NONE) && (local.type != type) ) {
+                    local.type = ValueType::NONE;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    //makes a value the compiler typed as from fit a register typed as to
+    void Compiler::coerce(unsigned reg, ValueType from, ValueType to, SymbolId symbol) {
+        if( (to == ValueType::NONE) || (to == from) )
+            return;
+
+        if( (to == ValueType::FLOAT) && (from == ValueType::INT) ) {
+            emit(make_abc(Op::TOF64, reg, reg, 0));
+            return;
+        }
+
+        if(from == ValueType::NONE) {
+            switch(to) {
+                case ValueType::INT: emit(make_abc(Op::GUARD_I64, reg, 0, 0)); break;
+                case ValueType::FLOAT: emit(make_abc(Op::GUARD_F64, reg, 0, 0)); break;
+                case ValueType::STRING: emit(make_abc(Op::GUARD_STR, reg, 0, 0)); break;
+                default: break;
+            }
+            return;
+        }
+
+        error(offset, std::string("cannot assign a ") + value_type_name(from) + " to " + value_type_name(to) +
+            " '" + std::string(ast.name(symbol)) + "'");
+    }
+
+}
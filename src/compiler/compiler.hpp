@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../parser/ast.hpp"
+#include "../vm/bytecode.hpp"
+
+namespace torq {
+
+    //single pass from the AST to register bytecode. Names assigned or declared in a function
+    //body live in registers, names at module level and anything not local are globals.
+    //Temporaries are allocated stack fashion above the locals.
+    //
+    //Locals with a static type - from an annotation, or inferred when every assignment has the
+    //same type and one runs before any use - get the unchecked _I64 / _F64 instructions.
+    //Guards at the edges (typed parameters, untyped values stored into typed locals) keep
+    //those types true at runtime. Everything else uses the generic instructions
+    class Compiler {
+      private:
+        struct Local {
+            SymbolId symbol;
+            unsigned reg;
+            ValueType type;             //NONE when not statically known
+        };
+
+        struct FunctionState {
+            uint32_t index;                                 //into Program::functions
+            bool top_level;
+
+            std::vector<Instr> code;
+            std::vector<uint32_t> offsets;
+
+            //searched from the back, so loop variables shadow function locals
+            std::vector<Local> locals;
+            std::size_t params;
+            unsigned next_register;
+            unsigned max_registers;
+
+            //pending break jumps of each enclosing loop
+            std::vector<std::vector<std::size_t>> breaks;
+        };
+
+        const Ast &ast;
+        std::string_view source;
+        int level;                      //optimization level, the peephole pass runs from 1
+        bool fusing;                    //into superinstructions, with the peephole pass
+
+        Program *program;
+        FunctionState *fs;
+
+        uint32_t offset;                //source offset given to emitted instructions
+        bool out_of_registers;
+
+        std::vector<uint32_t> symbol_strings;
+        std::vector<bool> format_symbols;       //string literals already planned as formats
+        std::unordered_map<int64_t, uint32_t> int_constants;
+        std::unordered_map<uint64_t, uint32_t> float_constants;
+
+        void error(uint32_t at, std::string message);
+
+        std::size_t emit(Instr instr);
+        std::size_t emit_jump(Op op, unsigned a = 0);
+        void patch(std::size_t jump);
+        void jump_back(Op op, unsigned a, std::size_t target);
+
+        unsigned allocate(unsigned count = 1);
+        int find_local(SymbolId symbol) const;
+        int resolve(SymbolId symbol) const;
+        bool is_local(unsigned reg) const;
+        void collect_locals(NodeId node);
+
+        ValueType type_of(NodeId id) const;
+        ValueType loop_type(const Node &node) const;
+        bool mentions(NodeId id, SymbolId symbol) const;
+        bool assigns(NodeId id, SymbolId symbol) const;
+        void infer_locals(NodeId body);
+        void assignment_types(NodeId id, std::size_t locals, std::vector<std::pair<std::size_t, ValueType>> &out);
+        void coerce(unsigned reg, ValueType from, ValueType to, SymbolId symbol);
+
+        uint32_t string_index(SymbolId symbol);
+        uint32_t string_index(std::string_view text);
+        uint32_t int_constant(int64_t value);
+        uint32_t float_constant(double value);
+
+        uint32_t compile_function(NodeId node);
+
+        void statement(NodeId id);
+        void block(NodeId id);
+        void assign_name(SymbolId symbol, NodeId value);
+        void store_name(SymbolId symbol, unsigned reg, ValueType type);
+        void if_statement(const Node &node);
+        void while_statement(const Node &node);
+        void for_statement(const Node &node);
+
+        void expression(NodeId id, unsigned dest);
+        unsigned operand(NodeId id);
+        unsigned numeric_operand(NodeId id, bool to_float);
+        void load_int(unsigned dest, int64_t value);
+        void load_zero(unsigned dest, ValueType type);
+        void call(const Node &node, unsigned dest);
+        bool calls_print(NodeId callee) const;
+
+      public:
+        std::vector<Diagnostic> errors;
+
+      public:
+        //source is only used to map instruction offsets back to lines. The tree should already
+        //have been through an Optimizer of the same level. From level 1 the code is fused into
+        //superinstructions unless fuse is false
+        Compiler(const Ast &ast, std::string_view source, int level = 0, bool fuse = true);
+
+        bool compile(Program &program);
+    };
+
+}
@@ -0,0 +1,206 @@
+#include "loader.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <tuple>
+
+#include "../parser/lexer.hpp"
+#include "../parser/parser.hpp"
+#include "../stats.hpp"
+#include "../vm/cache.hpp"
+#include "compiler.hpp"
+#include "optimizer.hpp"
+
+namespace torq {
+
+    namespace {
+        //registered by the VM itself, see register_builtins()
+        bool is_builtin(const std::string &name) {
+            return name == "std";
+        }
+    }
+
+    std::string module_path(const std::string &root, const std::string &name) {
+        std::string path = root + "/" + name + ".tq";
+        std::replace(path.begin() + root.size() + 1, path.end() - 3, '.', '/');
+        return path;
+    }
+
+    ModuleLoader::ModuleLoader(int level, bool use_cache, unsigned threads) :
+      level(level), use_cache(use_cache), pool(threads) {}
+
+    bool ModuleLoader::load(const std::string &path) {
+        std::size_t slash = path.rfind('/');
+        if(slash == std::string::npos)
+            root = ".";
+        else
+            root = path.substr(0, std::max<std::size_t>(slash, 1));
+
+        add("", path);
+        pool.wait();
+
+        //tasks finish in any order, the report shouldn't
+        std::sort(load_errors.begin(), load_errors.end(), [](const LoadError &a, const LoadError &b) {
+            return std::tie(a.file, a.location.line, a.location.column) < std::tie(b.file, b.location.line, b.location.column);
+        });
+        if(!load_errors.empty())
+            return false;
+
+        std::unordered_map<const LoadedModule*, Mark> marks;
+        std::vector<const LoadedModule*> chain;
+        return visit(*modules[""], marks, chain);
+    }
+
+    void ModuleLoader::error(const std::string &file, Location location, std::string message) {
+        std::lock_guard<std::mutex> guard(lock);
+        load_errors.push_back({file, location, std::move(message)});
+    }
+
+    void ModuleLoader::add(const std::string &name, const std::string &path) {
+        LoadedModule *module;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto [it, inserted] = modules.try_emplace(name);
+            if(!inserted)
+                return;
+
+            it->second = std::make_unique<LoadedModule>();
+            module = it->second.get();
+            module->name = name;
+            module->path = path;
+        }
+
+        pool.submit([this, module] { compile(*module); });
+    }
+
+    void ModuleLoader::compile(LoadedModule &module) {
+        module.source = std::make_unique<Source>(module.path);
+        if(!module.source->good()) {
+            error(module.path, Location{1, 1}, "cannot read '" + module.path + "'");
+            return;
+        }
+
+        std::string_view text = module.source->view();
+        Program &program = module.program;
+        program.name = module.path;
+
+        //same as a single script - compiled bytecode is kept next to each module's source
+        bool cached = use_cache && (module.path != "-");
+        std::string cache = cached ? cache_path(module.path, level) : "";
+
+        Stats &stats = Stats::global();
+        stats.add(Counter::MODULES, 1);
+        stats.add(Counter::BYTES, text.size());
+
+        bool hit;
+        {
+            PhaseTimer timer(Phase::CACHE);
+            hit = cached && load_cache(cache, text, level, program);
+        }
+
+        if(hit) {
+            stats.add(Counter::CACHED_MODULES, 1);
+        } else {
+            //the parser lexes the whole module up front
+            Lexer lexer(*module.source);
+            std::optional<Parser> parser;
+            {
+                PhaseTimer timer(Phase::LEX);
+                parser.emplace(lexer);
+            }
+            stats.add(Counter::TOKENS, parser->token_count());
+
+            Ast ast;
+            {
+                PhaseTimer timer(Phase::PARSE);
+                ast = parser->parse();
+            }
+            stats.add(Counter::NODES, ast.nodes.size());
+
+            if(!ast.ok()) {
+                for(const Diagnostic &e : ast.errors)
+                    error(module.path, lexer.location(e.offset), e.message);
+                return;
+            }
+
+            {
+                PhaseTimer timer(Phase::OPTIMIZE);
+                Optimizer(ast, level).run();
+            }
+
+            Compiler compiler(ast, text, level);
+            bool ok;
+            {
+                PhaseTimer timer(Phase::COMPILE);
+                ok = compiler.compile(program);
+            }
+            if(!ok) {
+                for(const Diagnostic &e : compiler.errors)
+                    error(module.path, program.locate(e.offset), e.message);
+                return;
+            }
+
+            if(cached) {
+                PhaseTimer timer(Phase::CACHE);
+                save_cache(cache, program, text, level);
+            }
+        }
+        stats.add(Counter::INSTRUCTIONS, program.code.size());
+
+        //imports are read back out of the bytecode, so a cached module is never parsed
+        for(uint32_t pc = 0; pc < program.code.size(); pc++) {
+            if(op_of(program.code[pc]) == Op::IMPORT)
+                module.imports.push_back({std::string(program.string(arg_bx(program.code[pc]))), program.offsets[pc]});
+        }
+        module.ok = true;
+
+        for(const Import &import : module.imports) {
+            if(is_builtin(import.name))
+                continue;
+
+            std::string path = module_path(root, import.name);
+            std::error_code ec;
+            if(!std::filesystem::is_regular_file(path, ec)) {
+                error(module.path, program.locate(import.offset), "no module named '" + import.name + "' (looked for " + path + ")");
+                continue;
+            }
+
+            add(import.name, path);
+        }
+    }
+
+    bool ModuleLoader::visit(const LoadedModule &module, std::unordered_map<const LoadedModule*, Mark> &marks,
+                             std::vector<const LoadedModule*> &path) {
+        marks[&module] = Mark::VISITING;
+        path.push_back(&module);
+
+        for(const Import &import : module.imports) {
+            auto found = modules.find(import.name);
+            if(found == modules.end())
+                continue;
+
+            const LoadedModule *target = found->second.get();
+            auto mark = marks.find(target);
+
+            if(mark == marks.end()) {
+                if(!visit(*target, marks, path))
+                    return false;
+            } else if(mark->second == Mark::VISITING) {
+                std::string cycle;
+                for(auto it = std::find(path.begin(), path.end(), target); it != path.end(); ++it)
+                    cycle += (*it)->name + " -> ";
+                cycle += target->name;
+
+                error(module.path, module.program.locate(import.offset), "import cycle: " + cycle);
+                return false;
+            }
+        }
+
+        path.pop_back();
+        marks[&module] = Mark::DONE;
+        run_order.push_back(&module);
+        return true;
+    }
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../parser/location.hpp"
+#include "../parser/source.hpp"
+#include "../vm/bytecode.hpp"
+#include "pool.hpp"
+
+namespace torq {
+
+    struct LoadError {
+        std::string file;
+        Location location;
+        std::string message;
+    };
+
+    struct Import {
+        std::string name;
+        uint32_t offset;        //source offset of the IMPORT instruction
+    };
+
+    //one source file of a program and the bytecode it compiled to. Shared read-only once
+    //the loader has finished
+    struct LoadedModule {
+        std::string name;       //dotted import name, empty for the entry script
+        std::string path;
+
+        std::unique_ptr<Source> source;
+        Program program;
+
+        std::vector<Import> imports;
+        bool ok = false;
+    };
+
+
+    //compiles a script and every module it imports. Each module is lexed, parsed and
+    //compiled as its own task on a thread pool; the imports in its bytecode then queue any
+    //module not seen yet. Nothing in the front end is shared between modules, so they never
+    //wait on each other. Once everything is compiled the import graph is ordered so every
+    //module runs after the modules it imports, and cycles are reported.
+    //
+    //import a.b is read from a/b.tq next to the entry script
+    class ModuleLoader {
+      private:
+        enum class Mark { VISITING, DONE };
+
+        int level;
+        bool use_cache;
+        std::string root;
+
+        std::mutex lock;
+        std::unordered_map<std::string, std::unique_ptr<LoadedModule>> modules;
+        std::vector<LoadError> load_errors;
+
+        std::vector<const LoadedModule*> run_order;
+
+        ThreadPool pool;
+
+        void add(const std::string &name, const std::string &path);
+        void compile(LoadedModule &module);
+        void error(const std::string &file, Location location, std::string message);
+
+        bool visit(const LoadedModule &module, std::unordered_map<const LoadedModule*, Mark> &marks,
+                   std::vector<const LoadedModule*> &path);
+
+      public:
+        //0 threads means one per hardware thread
+        ModuleLoader(int level, bool use_cache, unsigned threads = 0);
+
+        //false if any module failed to load - errors() says why
+        bool load(const std::string &path);
+
+        const std::vector<LoadError>& errors() const { return load_errors; }
+
+        //imports before the modules importing them, the entry script last
+        const std::vector<const LoadedModule*>& modules_in_order() const { return run_order; }
+
+        std::size_t threads() const { return pool.size(); }
+    };
+
+    //file an import name is read from, relative to the entry script's directory
+    std::string module_path(const std::string &root, const std::string &name);
+
+}
@@ -0,0 +1,524 @@
+#include "optimizer.hpp"
+
+#include <cmath>
+
+#include "../parser/lexer.hpp"
+
+namespace torq {
+
+    namespace {
+
+        //calls f on every child of a node, in evaluation order
+        template<typename F>
+        void each_child(const Ast &ast, const Node &node, F f) {
+            auto call = [&](NodeId id) {
+                if(id != NO_NODE)
+                    f(id);
+            };
+
+            switch(node.kind) {
+                case NodeKind::UNARY:
+                case NodeKind::MEMBER:
+                case NodeKind::EXPR_STMT:
+                case NodeKind::RETURN:
+                    call(node.a);
+                    break;
+
+                case NodeKind::BINARY:
+                case NodeKind::INDEX:
+                case NodeKind::ASSIGN:
+                case NodeKind::WHILE:
+                    call(node.a);
+                    call(node.b);
+                    break;
+
+                case NodeKind::DECLARE:
+                    call(node.b);
+                    break;
+
+                case NodeKind::IF:
+                    call(node.a);
+                    call(node.b);
+                    call(node.c);
+                    break;
+
+                case NodeKind::CALL:
+                    call(node.a);
+                    for(NodeId child : ast.list(node))
+                        call(child);
+                    break;
+
+                case NodeKind::FOR:
+                case NodeKind::FUNCTION:
+                    for(NodeId child : ast.list(node))
+                        call(child);
+                    call(node.a);
+                    break;
+
+                case NodeKind::LIST_LITERAL:
+                case NodeKind::BLOCK:
+                case NodeKind::MODULE:
+                    for(NodeId child : ast.list(node))
+                        call(child);
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        bool truthy(const Node &literal) {
+            return (literal.kind != NodeKind::BOOL_LITERAL) || (literal.i_value != 0);
+        }
+
+        bool is_number(const Node &node) {
+            return (node.kind == NodeKind::INT_LITERAL) || (node.kind == NodeKind::FLOAT_LITERAL);
+        }
+
+        double number(const Node &node) {
+            return (node.kind == NodeKind::INT_LITERAL) ? static_cast<double>(node.i_value) : node.f_value;
+        }
+
+        //ints wrap like the VM's do
+        int64_t wrap(uint64_t value) { return static_cast<int64_t>(value); }
+
+        bool is_jump(Op op) {
+            OpFormat format = op_format(op);
+            return (format == OpFormat::AJ) || (format == OpFormat::J);
+        }
+
+        //writes R[A] and nothing else, can't fail and doesn't read R[A]
+        bool is_load(Instr instr) {
+            switch(op_of(instr)) {
+                case Op::LOADNIL:
+                case Op::LOADBOOL:
+                case Op::LOADINT:
+                case Op::LOADK:
+                case Op::LOADSTR:
+                case Op::LOADFN:
+                    return true;
+                case Op::MOVE:
+                    return arg_b(instr) != arg_a(instr);
+                default:
+                    return false;
+            }
+        }
+
+        std::size_t jump_target(Instr instr, std::size_t pc) {
+            return pc + 1 + arg_sbx(instr);
+        }
+
+        bool retarget(Instr &instr, Op op, std::size_t pc, std::size_t target) {
+            int64_t delta = static_cast<int64_t>(target) - static_cast<int64_t>(pc) - 1;
+            if( (delta < MIN_SBX) || (delta > MAX_SBX) )
+                return false;
+            instr = make_asbx(op, arg_a(instr), static_cast<int>(delta));
+            return true;
+        }
+
+    }
+
+    Optimizer::Optimizer(Ast &ast, int level) : ast(ast), level(level) {}
+
+    void Optimizer::run() {
+        if( (level <= 0) || (ast.root == NO_NODE) )
+            return;
+
+        if(level >= 2)
+            count_stores(ast.root);
+
+        //in order, so a constant is only substituted into statements that run after it is set.
+        //Functions defined later can't be called before then either
+        for(NodeId statement : ast.list(ast[ast.root])) {
+            visit(statement, false);
+
+            if(level >= 2) {
+                NodeId value = constant_value(statement);
+                if(value != NO_NODE)
+                    constants[ast[statement].symbol] = value;
+            }
+        }
+    }
+
+    bool Optimizer::is_literal(NodeId id) const {
+        switch(ast[id].kind) {
+            case NodeKind::INT_LITERAL:
+            case NodeKind::FLOAT_LITERAL:
+            case NodeKind::STRING_LITERAL:
+            case NodeKind::BOOL_LITERAL:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    //whether dropping a subtree would change which names a function keeps in registers
+    bool Optimizer::binds_names(NodeId id) const {
+        if(id == NO_NODE)
+            return false;
+
+        const Node &node = ast[id];
+        switch(node.kind) {
+            case NodeKind::ASSIGN:
+                return ast[node.a].kind == NodeKind::NAME;
+            case NodeKind::DECLARE:
+            case NodeKind::FUNCTION:
+                return true;
+            default:
+                break;
+        }
+
+        bool found = false;
+        each_child(ast, node, [&](NodeId child) { found = found || binds_names(child); });
+        return found;
+    }
+
+    void Optimizer::count_stores(NodeId id) {
+        const Node &node = ast[id];
+
+        switch(node.kind) {
+            case NodeKind::ASSIGN:
+                if(ast[node.a].kind == NodeKind::NAME)
+                    stores[node.symbol]++;
+                break;
+
+            case NodeKind::DECLARE:
+            case NodeKind::FUNCTION:
+            case NodeKind::PARAM:
+            case NodeKind::FOR:
+                stores[node.symbol]++;
+                break;
+
+            case NodeKind::IMPORT: {
+                //import a.b binds a
+                std::string_view name = ast.name(node.symbol);
+                SymbolId bound;
+                if(ast.symbols->find(name.substr(0, name.find('.')), bound))
+                    stores[bound]++;
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        each_child(ast, node, [&](NodeId child) { count_stores(child); });
+    }
+
+    //the literal a top level statement gives a name that is never stored to anywhere else
+    NodeId Optimizer::constant_value(NodeId statement) const {
+        const Node &node = ast[statement];
+
+        if(node.kind == NodeKind::ASSIGN) {
+            if(ast[node.a].kind != NodeKind::NAME)
+                return NO_NODE;
+        } else if(node.kind == NodeKind::DECLARE) {
+            //only when no conversion is needed
+            if(node.b == NO_NODE)
+                return NO_NODE;
+            NodeKind kind = ast[node.b].kind;
+            bool matches = ( (node.type == ValueType::INT) && (kind == NodeKind::INT_LITERAL) ) ||
+                ( (node.type == ValueType::FLOAT) && (kind == NodeKind::FLOAT_LITERAL) ) ||
+                ( (node.type == ValueType::STRING) && (kind == NodeKind::STRING_LITERAL) ) ||
+                ( (node.type == ValueType::BOOL) && (kind == NodeKind::BOOL_LITERAL) );
+            if(!matches)
+                return NO_NODE;
+        } else {
+            return NO_NODE;
+        }
+
+        auto count = stores.find(node.symbol);
+        if( (count == stores.end()) || (count->second != 1) || !is_literal(node.b) )
+            return NO_NODE;
+        return node.b;
+    }
+
+    //children first, so folds see folded operands and branches see folded conditions
+    void Optimizer::visit(NodeId id, bool in_function) {
+        Node &node = ast[id];
+
+        if(node.kind == NodeKind::NAME) {
+            auto constant = constants.find(node.symbol);
+            if(constant != constants.end()) {
+                uint32_t offset = node.offset;
+                node = ast[constant->second];
+                node.offset = offset;
+            }
+            return;
+        }
+
+        bool inner = in_function || (node.kind == NodeKind::FUNCTION);
+        each_child(ast, node, [&](NodeId child) { visit(child, inner); });
+
+        switch(node.kind) {
+            case NodeKind::UNARY:
+            case NodeKind::BINARY:
+                fold(id);
+                break;
+
+            case NodeKind::IF:
+            case NodeKind::WHILE:
+                prune(id, in_function);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    //operators on literals. Anything that would fail at runtime - dividing by zero, adding a
+    //string to a number - is left for the VM to report
+    void Optimizer::fold(NodeId id) {
+        Node &node = ast[id];
+
+        if(node.kind == NodeKind::UNARY) {
+            const Node &operand = ast[node.a];
+            if(!is_literal(node.a))
+                return;
+
+            if(node.op == EXCLAIM)
+                make_bool(id, !truthy(operand));
+            else if(operand.kind == NodeKind::INT_LITERAL)
+                make_int(id, wrap(0 - static_cast<uint64_t>(operand.i_value)));
+            else if(operand.kind == NodeKind::FLOAT_LITERAL)
+                make_float(id, -operand.f_value);
+            return;
+        }
+
+        if(!is_literal(node.a) || !is_literal(node.b))
+            return;
+
+        const Node &left = ast[node.a], &right = ast[node.b];
+        bool ints = (left.kind == NodeKind::INT_LITERAL) && (right.kind == NodeKind::INT_LITERAL);
+        bool numbers = is_number(left) && is_number(right);
+        bool strings = (left.kind == NodeKind::STRING_LITERAL) && (right.kind == NodeKind::STRING_LITERAL);
+
+        switch(node.op) {
+            case EQUALS:
+            case NOTEQUALS: {
+                bool equal;
+                if(ints)
+                    equal = left.i_value == right.i_value;
+                else if(numbers)
+                    equal = number(left) == number(right);
+                else if(left.kind != right.kind)
+                    equal = false;
+                else if(strings)
+                    equal = left.symbol == right.symbol;
+                else
+                    equal = left.i_value == right.i_value;
+                make_bool(id, (node.op == EQUALS) ? equal : !equal);
+                return;
+            }
+
+            case LT: case LTE: case GT: case GTE: {
+                int order;
+                if(ints) {
+                    order = (left.i_value < right.i_value) ? -1 : (left.i_value > right.i_value);
+                } else if(numbers) {
+                    double a = number(left), b = number(right);
+                    if( (a != a) || (b != b) )
+                        return;
+                    order = (a < b) ? -1 : (a > b);
+                } else if(strings) {
+                    order = ast.name(left.symbol).compare(ast.name(right.symbol));
+                } else {
+                    return;
+                }
+
+                switch(node.op) {
+                    case LT: make_bool(id, order < 0); break;
+                    case LTE: make_bool(id, order <= 0); break;
+                    case GT: make_bool(id, order > 0); break;
+                    default: make_bool(id, order >= 0); break;
+                }
+                return;
+            }
+
+            default:
+                break;
+        }
+
+        if(ints) {
+            uint64_t a = left.i_value, b = right.i_value;
+            switch(node.op) {
+                case PLUS: make_int(id, wrap(a + b)); break;
+                case MINUS: make_int(id, wrap(a - b)); break;
+                case STAR: make_int(id, wrap(a * b)); break;
+                case SLASH:
+                    if(right.i_value != 0)
+                        make_int(id, (right.i_value == -1) ? wrap(0 - a) : left.i_value / right.i_value);
+                    break;
+                case PERCENT:
+                    if(right.i_value != 0)
+                        make_int(id, (right.i_value == -1) ? 0 : left.i_value % right.i_value);
+                    break;
+                default:
+                    break;
+            }
+        } else if(numbers) {
+            double a = number(left), b = number(right);
+            switch(node.op) {
+                case PLUS: make_float(id, a + b); break;
+                case MINUS: make_float(id, a - b); break;
+                case STAR: make_float(id, a * b); break;
+                case SLASH: make_float(id, a / b); break;
+                case PERCENT: make_float(id, std::fmod(a, b)); break;
+                default: break;
+            }
+        }
+    }
+
+    //if and while on a literal condition keep only the branch that can run. In a function a
+    //branch that assigns names stays, since those names are locals because of it
+    void Optimizer::prune(NodeId id, bool in_function) {
+        Node &node = ast[id];
+        if(!is_literal(node.a))
+            return;
+        bool taken = truthy(ast[node.a]);
+
+        if(node.kind == NodeKind::WHILE) {
+            if(!taken && !(in_function && binds_names(node.b)))
+                make_empty(id);
+            return;
+        }
+
+        NodeId kept = taken ? node.b : node.c;
+        NodeId dropped = taken ? node.c : node.b;
+        if(in_function && binds_names(dropped))
+            return;
+
+        if(kept == NO_NODE)
+            make_empty(id);
+        else
+            node = ast[kept];
+    }
+
+    void Optimizer::make_int(NodeId id, int64_t value) {
+        ast[id].kind = NodeKind::INT_LITERAL;
+        ast[id].i_value = value;
+    }
+
+    void Optimizer::make_float(NodeId id, double value) {
+        ast[id].kind = NodeKind::FLOAT_LITERAL;
+        ast[id].f_value = value;
+    }
+
+    void Optimizer::make_bool(NodeId id, bool value) {
+        ast[id].kind = NodeKind::BOOL_LITERAL;
+        ast[id].i_value = value;
+    }
+
+    void Optimizer::make_empty(NodeId id) {
+        Node &node = ast[id];
+        node.kind = NodeKind::BLOCK;
+        node.a = NO_NODE;
+        node.b = 0;
+        node.c = 0;
+    }
+
+
+    std::size_t peephole(std::vector<Instr> &code, std::vector<uint32_t> &offsets) {
+        std::size_t total = 0;
+
+        while(true) {
+            std::size_t n = code.size();
+            std::vector<bool> removed(n, false), target(n + 1, false);
+            for(std::size_t pc = 0; pc < n; pc++) {
+                if(is_jump(op_of(code[pc])))
+                    target[jump_target(code[pc], pc)] = true;
+            }
+
+            std::size_t count = 0;
+            for(std::size_t pc = 0; pc < n; pc++) {
+                if(removed[pc])
+                    continue;
+
+                Instr &instr = code[pc];
+                Op op = op_of(instr);
+
+                //if !x goto L; goto M; L:   becomes   if x goto M
+                if( ((op == Op::JMPIF) || (op == Op::JMPIFNOT)) && (pc + 1 < n) && !target[pc + 1] &&
+                    (jump_target(instr, pc) == pc + 2) && (op_of(code[pc + 1]) == Op::JMP) ) {
+                    Op inverted = (op == Op::JMPIF) ? Op::JMPIFNOT : Op::JMPIF;
+                    if(retarget(instr, inverted, pc, jump_target(code[pc + 1], pc + 1))) {
+                        removed[pc + 1] = true;
+                        count++;
+                        op = inverted;
+                    }
+                }
+
+                //through unconditional jumps to their final target
+                if( (op == Op::JMP) || (op == Op::JMPIF) || (op == Op::JMPIFNOT) ) {
+                    std::size_t to = jump_target(instr, pc);
+                    for(int hops = 0; (hops < 8) && (to < n) && (to != pc) && (op_of(code[to]) == Op::JMP); hops++)
+                        to = jump_target(code[to], to);
+                    if(retarget(instr, op, pc, to))
+                        target[to] = true;
+                }
+
+                if( ((op == Op::JMP) && (jump_target(instr, pc) == pc + 1)) ||
+                    (is_load(instr) && (pc + 1 < n) && is_load(code[pc + 1]) && (arg_a(code[pc + 1]) == arg_a(instr))) ) {
+                    removed[pc] = true;
+                    count++;
+                }
+            }
+
+            if(count == 0)
+                return total;
+            total += count;
+
+            //removed instructions map to the next one kept
+            std::vector<std::size_t> moved(n + 1);
+            std::size_t kept = 0;
+            for(std::size_t pc = 0; pc < n; pc++) {
+                moved[pc] = kept;
+                if(!removed[pc])
+                    kept++;
+            }
+            moved[n] = kept;
+
+            for(std::size_t pc = 0; pc < n; pc++) {
+                if(removed[pc])
+                    continue;
+                Instr instr = code[pc];
+                if(is_jump(op_of(instr)))
+                    retarget(instr, op_of(instr), moved[pc], moved[jump_target(instr, pc)]);
+                code[moved[pc]] = instr;
+                offsets[moved[pc]] = offsets[pc];
+            }
+            code.resize(kept);
+            offsets.resize(kept);
+        }
+    }
+
+    std::size_t fuse(std::vector<Instr> &code) {
+        std::size_t count = 0;
+
+        for(std::size_t pc = 0; pc < code.size(); ) {
+            //fused already
+            if(const Superinstruction *super = superinstruction(op_of(code[pc]))) {
+                pc += super->length;
+                continue;
+            }
+
+            std::size_t length = 1;
+            for(const Superinstruction &super : superinstructions()) {
+                if(pc + super.length > code.size())
+                    continue;
+                bool match = true;
+                for(unsigned k = 0; match && (k < super.length); k++)
+                    match = op_of(code[pc + k]) == super.parts[k];
+                if(match) {
+                    code[pc] = (code[pc] & ~Instr(0xff)) | static_cast<uint8_t>(super.op);
+                    length = super.length;
+                    count++;
+                    break;
+                }
+            }
+            pc += length;
+        }
+        return count;
+    }
+
+}
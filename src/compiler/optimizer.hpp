@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "../parser/ast.hpp"
+#include "../vm/bytecode.hpp"
+
+namespace torq {
+
+    //rewrites a parsed module in place before it is compiled. Level 1 folds operators on
+    //literals and drops if/while branches whose condition is a literal, level 2 also replaces
+    //reads of module level names assigned exactly once, to a literal, by that literal.
+    //Nothing is rewritten that could change what a program prints or which error it stops at
+    class Optimizer {
+      private:
+        Ast &ast;
+        int level;
+
+        //module level constants seen so far, by the literal node holding their value
+        std::unordered_map<SymbolId, NodeId> constants;
+        std::unordered_map<SymbolId, unsigned> stores;
+
+        bool is_literal(NodeId id) const;
+        bool binds_names(NodeId id) const;
+
+        void count_stores(NodeId id);
+        NodeId constant_value(NodeId statement) const;
+
+        void visit(NodeId id, bool in_function);
+        void fold(NodeId id);
+        void prune(NodeId id, bool in_function);
+
+        void make_int(NodeId id, int64_t value);
+        void make_float(NodeId id, double value);
+        void make_bool(NodeId id, bool value);
+        void make_empty(NodeId id);
+
+      public:
+        Optimizer(Ast &ast, int level);
+
+        void run();
+    };
+
+    //cleans up a function's emitted code: threads jumps to jumps, turns a conditional jump
+    //over a jump into one inverted jump, and drops loads overwritten before they are read and
+    //jumps to the next instruction. offsets are kept parallel to code. Returns the number of
+    //instructions removed
+    std::size_t peephole(std::vector<Instr> &code, std::vector<uint32_t> &offsets);
+
+    //rewrites the first instruction of each sequence a superinstruction covers into that
+    //superinstruction, trying the longest first. The rest of the sequence stays where it is as
+    //the superinstruction's operands, so nothing moves and a jump into the middle still runs
+    //the rest on their own. Returns the number of sequences fused
+    std::size_t fuse(std::vector<Instr> &code);
+
+}
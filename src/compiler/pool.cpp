@@ -0,0 +1,103 @@
+#include "pool.hpp"
+
+#include <algorithm>
+
+namespace torq {
+
+    namespace {
+        //which pool and deque the running thread works for, so nested submits stay local
+        thread_local const ThreadPool *current_pool = nullptr;
+        thread_local std::size_t current_worker = 0;
+    }
+
+    ThreadPool::ThreadPool(unsigned threads) : available(0), pending(0), stopping(false), next_queue(0) {
+        if(threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        for(unsigned i = 0; i < threads; i++)
+            queues.push_back(std::make_unique<Queue>());
+
+        for(unsigned i = 0; i < threads; i++)
+            workers.emplace_back([this, i] { work(i); });
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(state_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        for(std::thread &worker : workers)
+            worker.join();
+    }
+
+    void ThreadPool::submit(std::function<void()> task) {
+        std::size_t target = (current_pool == this) ? current_worker : next_queue++ % queues.size();
+        pending++;
+
+        {
+            std::lock_guard<std::mutex> guard(queues[target]->lock);
+            queues[target]->tasks.push_back(std::move(task));
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(state_lock);
+            available++;
+        }
+        wake.notify_one();
+    }
+
+    void ThreadPool::wait() {
+        std::unique_lock<std::mutex> guard(state_lock);
+        idle.wait(guard, [this] { return pending == 0; });
+    }
+
+    std::function<void()> ThreadPool::take(std::size_t self) {
+        //a task has been claimed, so one is queued somewhere - own deque newest first, then
+        //the oldest of the others
+        while(true) {
+            for(std::size_t i = 0; i < queues.size(); i++) {
+                Queue &queue = *queues[(self + i) % queues.size()];
+                std::lock_guard<std::mutex> guard(queue.lock);
+
+                if(queue.tasks.empty())
+                    continue;
+
+                std::function<void()> task;
+                if(i == 0) {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                } else {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                return task;
+            }
+        }
+    }
+
+    void ThreadPool::work(std::size_t self) {
+        current_pool = this;
+        current_worker = self;
+
+        while(true) {
+            {
+                std::unique_lock<std::mutex> guard(state_lock);
+                wake.wait(guard, [this] { return stopping || (available > 0); });
+
+                if(available == 0)
+                    return;
+                available--;
+            }
+
+            take(self)();
+
+            if(--pending == 0) {
+                std::lock_guard<std::mutex> guard(state_lock);
+                idle.notify_all();
+            }
+        }
+    }
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace torq {
+
+    //fixed set of workers with a task deque each. A worker takes its newest task first and,
+    //when its own deque is empty, steals the oldest task of another. Tasks may submit more
+    //tasks, which go on the submitting worker's own deque
+    class ThreadPool {
+      private:
+        struct Queue {
+            std::mutex lock;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+
+        //tasks queued but not yet claimed by a worker, and submitted but not yet finished
+        std::mutex state_lock;
+        std::condition_variable wake;
+        std::condition_variable idle;
+        std::size_t available;
+        std::atomic<std::size_t> pending;
+        bool stopping;
+
+        std::atomic<std::size_t> next_queue;
+
+        void work(std::size_t self);
+        std::function<void()> take(std::size_t self);
+
+      public:
+        //0 threads means one per hardware thread
+        explicit ThreadPool(unsigned threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void submit(std::function<void()> task);
+
+        //blocks until every submitted task, and everything they submitted, has finished
+        void wait();
+
+        std::size_t size() const { return workers.size(); }
+    };
+
+}
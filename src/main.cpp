@@ -3,13 +3,59 @@
 
 #include "clipp.h"
 
+#include "compiler/loader.hpp"
+#include "stats.hpp"
+#include "vm/bytecode.hpp"
+#include "vm/vm.hpp"
+
+
+namespace {
+
+    void report(const std::string &file, torq::Location location, const std::string &message) {
+        std::cerr << file << ":" << location.line << ":" << location.column << ": error: " << message << "\n";
+    }
+
+    struct StatsReport {
+        bool enabled;
+        bool json;
+
+        ~StatsReport() {
+            if(enabled)
+                torq::Stats::global().report(std::cerr, json);
+        }
+    };
+
+}
+
 
 int main(int argc, char* argv[]) {
     bool disasm = false;
+    bool no_cache = false;
+    bool jit = false;
+    bool stats = false;
+    bool json = false;
+    int level = 1;
+    unsigned jobs = 0;
+    std::string profile_path = "";
+    std::string sequences_path = "";
     std::string infile = "";
 
     auto cli = (
         clipp::option("-d", "--disasm").set(disasm).doc("disassemble code"),
+        clipp::option("--no-cache").set(no_cache).doc("always compile from source, don't read or write .tqc files"),
+        clipp::option("--jit").set(jit).doc("compile hot loops and functions to native code (x86-64 Linux)"),
+        clipp::one_of(
+            clipp::option("--stats").set(stats).doc("report time and counts for each phase on stderr"),
+            clipp::option("--stats=json").set(json).doc("the same as one JSON object")
+        ),
+        (clipp::option("--profile") & clipp::value("folded file", profile_path)).doc("count opcodes and sample the call stack, report on stderr and write folded stacks for a flamegraph"),
+        (clipp::option("--sequences") & clipp::value("sequences file", sequences_path)).doc("write how often each run of two and three instructions ran, for tools/superinstructions"),
+        (clipp::option("-j", "--jobs") & clipp::value("threads", jobs)).doc("threads compiling modules, default one per core"),
+        clipp::one_of(
+            clipp::option("-O0").set(level, 0).doc("no optimization"),
+            clipp::option("-O1").set(level, 1).doc("fold constants, drop dead branches, peephole (default)"),
+            clipp::option("-O2").set(level, 2).doc("also propagate module level constants")
+        ),
         clipp::value("input file", infile)
     );
 
@@ -18,9 +64,78 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
-    std::ifstream source(infile);
-    if(!source.good()){
-        std::cout << "Source file '" << infile << "' not found.\nExiting...\n\n";
-        return -1;
+    stats = stats || json;
+    if(stats && !TORQ_STATS)
+        std::cerr << "warning: this build has no stats\n";
+    if(stats)
+        torq::Stats::global().enable();
+
+    //printed however main returns, after the total below is added up
+    StatsReport stats_report{stats && TORQ_STATS, json};
+    torq::PhaseTimer total(torq::Phase::TOTAL, true);
+
+    //the script and everything it imports, compiled in parallel. Sources are mapped straight
+    //into memory for regular files, "-" reads stdin
+    torq::ModuleLoader loader(level, !no_cache, jobs);
+    bool loaded;
+    {
+        torq::PhaseTimer timer(torq::Phase::LOAD, true);
+        loaded = loader.load(infile);
+    }
+    if(!loaded) {
+        for(const torq::LoadError &error : loader.errors())
+            report(error.file, error.location, error.message);
+        return 1;
     }
+
+    const auto &modules = loader.modules_in_order();
+
+    if(disasm) {
+        for(const torq::LoadedModule *module : modules) {
+            if(modules.size() > 1)
+                std::cout << "; " << module->path << "\n";
+            torq::disassemble(module->program, std::cout);
+        }
+        return 0;
+    }
+
+    //imports first, each with its own globals, then the script itself
+    torq::VM vm;
+    if(jit && !vm.enable_jit())
+        std::cerr << "warning: this build has no JIT, interpreting\n";
+    bool profiling = !profile_path.empty() || !sequences_path.empty();
+    const torq::Profiler *profile = profiling ? vm.enable_profile() : nullptr;
+
+    bool ok = true;
+    {
+        torq::PhaseTimer timer(torq::Phase::RUN);
+        for(const torq::LoadedModule *module : modules) {
+            ok = module->name.empty() ? vm.run(module->program) : vm.run_module(module->program, module->name);
+            if(!ok)
+                break;
+        }
+    }
+    torq::Stats::global().add(torq::Counter::EXECUTED, vm.instructions());
+
+    //a failed run still has a profile up to the error
+    if(!profile_path.empty()) {
+        std::ofstream folded(profile_path);
+        profile->write_folded(folded);
+        if(!folded)
+            std::cerr << "warning: could not write " << profile_path << "\n";
+        profile->report(std::cerr);
+    }
+    if(!sequences_path.empty()) {
+        std::ofstream sequences(sequences_path);
+        profile->write_sequences(sequences);
+        if(!sequences)
+            std::cerr << "warning: could not write " << sequences_path << "\n";
+    }
+
+    if(!ok) {
+        report(vm.error().file, vm.error().location, vm.error().message);
+        return 1;
+    }
+
+    return 0;
 }
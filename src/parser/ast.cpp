@@ -0,0 +1,194 @@
+#include "ast.hpp"
+#include "lexer.hpp"
+
+#include <charconv>
+
+namespace torq {
+
+    const char* node_kind_name(NodeKind kind) {
+        switch(kind) {
+            case NodeKind::INT_LITERAL: return "int";
+            case NodeKind::FLOAT_LITERAL: return "float";
+            case NodeKind::STRING_LITERAL: return "string";
+            case NodeKind::BOOL_LITERAL: return "bool";
+            case NodeKind::LIST_LITERAL: return "list";
+            case NodeKind::NAME: return "name";
+            case NodeKind::UNARY: return "unary";
+            case NodeKind::BINARY: return "binary";
+            case NodeKind::CALL: return "call";
+            case NodeKind::INDEX: return "index";
+            case NodeKind::MEMBER: return "member";
+            case NodeKind::MODULE: return "module";
+            case NodeKind::BLOCK: return "block";
+            case NodeKind::EXPR_STMT: return "expr";
+            case NodeKind::ASSIGN: return "assign";
+            case NodeKind::DECLARE: return "declare";
+            case NodeKind::IF: return "if";
+            case NodeKind::WHILE: return "while";
+            case NodeKind::FOR: return "for";
+            case NodeKind::RETURN: return "return";
+            case NodeKind::BREAK: return "break";
+            case NodeKind::FUNCTION: return "fn";
+            case NodeKind::PARAM: return "param";
+            case NodeKind::IMPORT: return "import";
+            case NodeKind::ERROR: return "error";
+        }
+        return "?";
+    }
+
+    const char* value_type_name(ValueType type) {
+        switch(type) {
+            case ValueType::NONE: return "any";
+            case ValueType::INT: return "int";
+            case ValueType::FLOAT: return "float";
+            case ValueType::STRING: return "string";
+            case ValueType::BOOL: return "bool";
+        }
+        return "?";
+    }
+
+    namespace {
+        const char* operator_text(uint8_t op) {
+            switch(op) {
+                case PLUS: return "+";
+                case MINUS: return "-";
+                case STAR: return "*";
+                case SLASH: return "/";
+                case PERCENT: return "%";
+                case EQUALS: return "==";
+                case NOTEQUALS: return "!=";
+                case GT: return ">";
+                case GTE: return ">=";
+                case LT: return "<";
+                case LTE: return "<=";
+                case EXCLAIM: return "!";
+            }
+            return "?";
+        }
+    }
+
+    std::string Ast::dump(NodeId id) const {
+        if(id == NO_NODE)
+            return "()";
+
+        const Node &node = nodes[id];
+        std::string out;
+
+        auto dump_list = [&](std::string text) {
+            for(NodeId child : list(node))
+                text += " " + dump(child);
+            return text;
+        };
+
+        switch(node.kind) {
+            case NodeKind::INT_LITERAL:
+                return std::to_string(node.i_value);
+
+            case NodeKind::FLOAT_LITERAL: {
+                char buffer[32];
+                auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), node.f_value);
+                out.assign(buffer, end);
+                if(out.find_first_of(".en") == std::string::npos)
+                    out += ".0";
+                return out;
+            }
+
+            case NodeKind::STRING_LITERAL:
+                out = "\"";
+                for(char ch : name(node.symbol)) {
+                    if(ch == '\n')
+                        out += "\\n";
+                    else if(ch == '"')
+                        out += "\\\"";
+                    else
+                        out += ch;
+                }
+                return out + "\"";
+
+            case NodeKind::BOOL_LITERAL:
+                return node.i_value ? "true" : "false";
+
+            case NodeKind::LIST_LITERAL:
+                return dump_list("(list") + ")";
+
+            case NodeKind::NAME:
+                return std::string(name(node.symbol));
+
+            case NodeKind::UNARY:
+                return std::string("(") + operator_text(node.op) + " " + dump(node.a) + ")";
+
+            case NodeKind::BINARY:
+                return std::string("(") + operator_text(node.op) + " " + dump(node.a) + " " + dump(node.b) + ")";
+
+            case NodeKind::CALL:
+                return dump_list("(call " + dump(node.a)) + ")";
+
+            case NodeKind::INDEX:
+                return "(index " + dump(node.a) + " " + dump(node.b) + ")";
+
+            case NodeKind::MEMBER:
+                return "(. " + dump(node.a) + " " + std::string(name(node.symbol)) + ")";
+
+            case NodeKind::MODULE:
+                return dump_list("(module") + ")";
+
+            case NodeKind::BLOCK:
+                return dump_list("(block") + ")";
+
+            case NodeKind::EXPR_STMT:
+                return dump(node.a);
+
+            case NodeKind::ASSIGN:
+                return "(= " + dump(node.a) + " " + dump(node.b) + ")";
+
+            case NodeKind::DECLARE:
+                out = std::string("(declare ") + value_type_name(node.type) + " " + std::string(name(node.symbol));
+                if(node.b != NO_NODE)
+                    out += " " + dump(node.b);
+                return out + ")";
+
+            case NodeKind::IF:
+                out = "(if " + dump(node.a) + " " + dump(node.b);
+                if(node.c != NO_NODE)
+                    out += " " + dump(node.c);
+                return out + ")";
+
+            case NodeKind::WHILE:
+                return "(while " + dump(node.a) + " " + dump(node.b) + ")";
+
+            case NodeKind::FOR:
+                return dump_list("(for " + std::string(name(node.symbol))) + " " + dump(node.a) + ")";
+
+            case NodeKind::RETURN:
+                if(node.a == NO_NODE)
+                    return "(return)";
+                return "(return " + dump(node.a) + ")";
+
+            case NodeKind::BREAK:
+                return "(break)";
+
+            case NodeKind::FUNCTION:
+                out = "(fn " + std::string(name(node.symbol)) + " (";
+                for(NodeId param : list(node)) {
+                    if(out.back() != '(')
+                        out += " ";
+                    out += dump(param);
+                }
+                return out + ") " + value_type_name(node.type) + " " + dump(node.a) + ")";
+
+            case NodeKind::PARAM:
+                if(node.type == ValueType::NONE)
+                    return std::string(name(node.symbol));
+                return std::string("(") + value_type_name(node.type) + " " + std::string(name(node.symbol)) + ")";
+
+            case NodeKind::IMPORT:
+                return "(import " + std::string(name(node.symbol)) + ")";
+
+            case NodeKind::ERROR:
+                return "(error)";
+        }
+
+        return "?";
+    }
+
+}
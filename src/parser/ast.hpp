@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "symbols.hpp"
+
+namespace torq {
+
+    using NodeId = uint32_t;
+    constexpr NodeId NO_NODE = UINT32_MAX;
+
+    enum class NodeKind : uint8_t {
+        //expressions
+        INT_LITERAL,        //i_value
+        FLOAT_LITERAL,      //f_value
+        STRING_LITERAL,     //symbol
+        BOOL_LITERAL,       //i_value 0 or 1
+        LIST_LITERAL,       //list = elements
+        NAME,               //symbol
+        UNARY,              //op, a = operand
+        BINARY,             //op, a = left, b = right
+        CALL,               //a = callee, list = arguments
+        INDEX,              //a = target, b = index
+        MEMBER,             //a = target, symbol = member name
+
+        //statements
+        MODULE,             //list = statements
+        BLOCK,              //list = statements
+        EXPR_STMT,          //a = expression
+        ASSIGN,             //a = target (NAME, INDEX or MEMBER), b = value
+        DECLARE,            //symbol, type, b = initial value or NO_NODE
+        IF,                 //a = condition, b = then BLOCK, c = else BLOCK, chained IF or NO_NODE
+        WHILE,              //a = condition, b = body BLOCK
+        FOR,                //symbol = loop variable, a = body BLOCK, list = start, limit [, step]
+        RETURN,             //a = value or NO_NODE
+        BREAK,
+        FUNCTION,           //symbol, type = return type, a = body BLOCK, list = PARAMs
+        PARAM,              //symbol, type
+        IMPORT,             //symbol = dotted module name
+
+        ERROR               //placeholder left where a parse error was recovered from
+    };
+
+    enum class ValueType : uint8_t { NONE, INT, FLOAT, STRING, BOOL };
+
+    const char* node_kind_name(NodeKind kind);
+    const char* value_type_name(ValueType type);
+
+
+    //32 bytes. Nodes refer to each other by index into Ast::nodes, never by pointer. Nodes
+    //with a variable number of children keep them as a run of Ast::lists, starting at b with
+    //c entries - see Ast::list()
+    struct Node {
+        NodeKind kind;
+        uint8_t op;         //TokenType of UNARY and BINARY operators
+        ValueType type;
+        uint8_t flags;
+
+        uint32_t offset;    //source offset of the first token of the node
+        SymbolId symbol;
+
+        NodeId a;
+        NodeId b;
+        NodeId c;
+
+        union {
+            int64_t i_value;
+            double f_value;
+        };
+    };
+
+    static_assert(sizeof(Node) == 32, "Node should pack into 32 bytes");
+
+
+    struct Diagnostic {
+        uint32_t offset;
+        std::string message;
+    };
+
+
+    //a whole parsed module. Everything lives in two flat arrays, so passes walk contiguous
+    //memory and the tree is released in one go
+    class Ast {
+      public:
+        std::vector<Node> nodes;
+        std::vector<NodeId> lists;
+        NodeId root = NO_NODE;
+
+        std::vector<Diagnostic> errors;
+
+        //names, string literals and member names - owned by the lexer that produced the tree
+        const SymbolTable *symbols = nullptr;
+
+      public:
+        const Node& operator[](NodeId id) const { return nodes[id]; }
+        Node& operator[](NodeId id) { return nodes[id]; }
+
+        std::span<const NodeId> list(const Node &node) const {
+            return std::span<const NodeId>(lists.data() + node.b, node.c);
+        }
+
+        std::string_view name(SymbolId symbol) const { return symbols->name(symbol); }
+
+        NodeId add(NodeKind kind, uint32_t offset) {
+            Node &node = nodes.emplace_back();
+            node.kind = kind;
+            node.op = 0;
+            node.type = ValueType::NONE;
+            node.flags = 0;
+            node.offset = offset;
+            node.symbol = 0;
+            node.a = node.b = node.c = NO_NODE;
+            node.i_value = 0;
+            return nodes.size() - 1;
+        }
+
+        bool ok() const { return errors.empty(); }
+
+        //s-expression form of a subtree, for tests and debugging
+        std::string dump(NodeId id) const;
+        std::string dump() const { return dump(root); }
+    };
+
+}
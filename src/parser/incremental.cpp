@@ -0,0 +1,161 @@
+#include "incremental.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace torq {
+
+    IncrementalLexer::IncrementalLexer(std::string source) :
+      buffer(std::move(source)), lexer(buffer.data(), buffer.size()) {
+        lines_before.push_back(0);
+        add_lines(0, size());
+
+        relex(0, 0);
+    }
+
+    void IncrementalLexer::add_lines(uint32_t from, uint32_t to) {
+        const char *pos = buffer.data() + from;
+        const char *end = buffer.data() + to;
+
+        while(pos < end) {
+            const char *nl = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+            if(nl == nullptr)
+                break;
+
+            lines_before.push_back(nl + 1 - buffer.data());
+            pos = nl + 1;
+        }
+    }
+
+    void IncrementalLexer::move_gap(uint32_t offset) {
+        //offsets flip between absolute and from the end as tokens cross the gap
+        while(!before.empty() && before.back().offset >= offset) {
+            Token t = before.back();
+            before.pop_back();
+            t.offset = size() - t.offset;
+            after.push_back(t);
+        }
+
+        while(!after.empty() && size() - after.back().offset < offset) {
+            Token t = after.back();
+            after.pop_back();
+            t.offset = size() - t.offset;
+            before.push_back(t);
+        }
+    }
+
+    void IncrementalLexer::move_line_gap(uint32_t offset) {
+        //line 1 always starts at 0, so lines_before is never empty
+        while(lines_before.back() > offset) {
+            lines_after.push_back(size() - lines_before.back());
+            lines_before.pop_back();
+        }
+
+        while(!lines_after.empty() && size() - lines_after.back() <= offset) {
+            lines_before.push_back(size() - lines_after.back());
+            lines_after.pop_back();
+        }
+    }
+
+    uint32_t IncrementalLexer::restart_point(uint32_t offset) {
+        //the lexer is between tokens at any line start, except inside a multi-line string - the
+        //only token that can hold a newline. Strings are checked by their opening quotes
+        while(true) {
+            move_line_gap(offset);
+            uint32_t line = lines_before.back();
+
+            move_gap(line);
+            if(before.empty())
+                return line;
+
+            const Token &last = before.back();
+            bool string = (last.type == STRING_LIT) || (last.type == ERROR);
+            if(!string || (buffer.compare(last.offset, 3, "\"\"\"") != 0))
+                return line;
+
+            offset = last.offset;
+        }
+    }
+
+    bool IncrementalLexer::edit(uint32_t offset, uint32_t removed, std::string_view inserted) {
+        if( (offset > size()) || (removed > size() - offset) )
+            return false;
+
+        //token offsets are 32 bits
+        if(inserted.size() > std::numeric_limits<uint32_t>::max() - (size() - removed))
+            return false;
+
+        uint32_t restart = restart_point(offset);
+
+        //old tokens from the restart point to the end of the removed range are lexed again,
+        //and line starts inside the removed range are gone. What is left after the gaps is
+        //measured from the end, so it is still right once the text is spliced
+        uint32_t tail = size() - offset - removed;
+
+        while(!after.empty() && after.back().offset > tail)
+            after.pop_back();
+
+        move_line_gap(offset);
+        while(!lines_after.empty() && lines_after.back() >= tail)
+            lines_after.pop_back();
+
+        buffer.replace(offset, removed, inserted);
+        add_lines(offset, offset + inserted.size());
+
+        relex(restart, offset + inserted.size());
+        return true;
+    }
+
+    void IncrementalLexer::relex(uint32_t restart, uint32_t edit_end) {
+        lexer.resume(buffer.data(), buffer.size(), restart);
+        last_relexed = 0;
+
+        while(true) {
+            Token t = lexer.next();
+
+            //old tokens the new ones have run over
+            while(!after.empty() && size() - after.back().offset < t.offset)
+                after.pop_back();
+
+            //past the edit the text is unchanged, so a token starting where an old one did
+            //lexes the same from there on
+            if( (t.offset >= edit_end) && !after.empty() && (size() - after.back().offset == t.offset) )
+                return;
+
+            before.push_back(t);
+            last_relexed++;
+
+            if(t.type == EOS) {
+                after.clear();
+                return;
+            }
+        }
+    }
+
+    Token IncrementalLexer::token(std::size_t i) const {
+        if(i < before.size())
+            return before[i];
+
+        Token t = after[after.size() - 1 - (i - before.size())];
+        t.offset = size() - t.offset;
+        return t;
+    }
+
+    Location IncrementalLexer::location(uint32_t offset) const {
+        if(!lines_after.empty() && (offset >= size() - lines_after.back())) {
+            //distances from the end grow towards the gap, so the line starts at or before
+            //offset are a run at the back
+            auto it = std::lower_bound(lines_after.begin(), lines_after.end(), size() - offset);
+            std::size_t line = lines_before.size() + (lines_after.end() - it);
+
+            return Location{static_cast<int>(line), static_cast<int>(offset - (size() - *it)) + 1};
+        }
+
+        auto it = std::upper_bound(lines_before.begin(), lines_before.end(), offset);
+        std::size_t line = it - lines_before.begin();
+
+        return Location{static_cast<int>(line), static_cast<int>(offset - lines_before[line - 1]) + 1};
+    }
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lexer.hpp"
+#include "location.hpp"
+
+namespace torq {
+
+    //keeps the tokens and line starts of a source being edited, and re-lexes only around each
+    //edit. Lexing restarts at the start of the edited line, or of the line a multi-line string
+    //around it opens on, and stops as soon as a new token lands on the start of an old one past
+    //the edit, since the lexer carries no state between tokens.
+    //
+    //tokens and line starts are kept as gap buffers split at the last edit. Entries after the
+    //gap hold their distance from the end of the source, so an edit never touches them and
+    //a run of nearby edits costs what they re-lex
+    class IncrementalLexer {
+      private:
+        std::string buffer;
+        Lexer lexer;
+
+        //tokens before the gap in order, by offset
+        std::vector<Token> before;
+        //tokens after the gap, last token first, by distance from the end of the buffer
+        std::vector<Token> after;
+
+        //line starts, split the same way
+        std::vector<uint32_t> lines_before;
+        std::vector<uint32_t> lines_after;
+
+        std::size_t last_relexed;
+
+        uint32_t size() const { return buffer.size(); }
+
+        //line starts for the newlines in [from, to), which must sit right after the line gap
+        void add_lines(uint32_t from, uint32_t to);
+
+        void move_gap(uint32_t offset);
+        void move_line_gap(uint32_t offset);
+
+        //line start at or before offset to lex again from
+        uint32_t restart_point(uint32_t offset);
+        void relex(uint32_t restart, uint32_t edit_end);
+
+      public:
+        explicit IncrementalLexer(std::string source);
+
+        //the lexer points into buffer
+        IncrementalLexer(const IncrementalLexer&) = delete;
+        IncrementalLexer& operator=(const IncrementalLexer&) = delete;
+
+        //replaces removed bytes at offset with inserted. Returns false, and changes nothing,
+        //if the range runs past the end of the source
+        bool edit(uint32_t offset, uint32_t removed, std::string_view inserted);
+
+        std::string_view source() const { return buffer; }
+
+        //every token including the final EOS
+        std::size_t tokens() const { return before.size() + after.size(); }
+        Token token(std::size_t i) const;
+
+        //text carried by IDENTIFIER, STRING_LIT and ERROR tokens
+        std::string_view text(const Token &token) const { return lexer.text(token); }
+
+        Location location(uint32_t offset) const;
+        Location location(const Token &token) const { return location(token.offset); }
+
+        std::size_t lines() const { return lines_before.size() + lines_after.size(); }
+
+        //tokens lexed by the last edit, or by the constructor
+        std::size_t relexed() const { return last_relexed; }
+    };
+
+}
@@ -1,188 +1,404 @@
 #include "lexer.hpp"
+#include "scan.hpp"
 
-#include <iostream>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <istream>
 
 namespace torq {
 
+    Lexer::Lexer(std::istream &stream_source, std::size_t window, Retain retain) : buffer(std::max<std::size_t>(window, 16), '\0') {
+        //starts out empty, the first advance() reads
+        reset(buffer.data(), 0);
+        stream = &stream_source;
+        windowed = (retain == Retain::WINDOW);
+        line_index.add_line(0);
+    }
+
+    void Lexer::reset(const char *data, std::size_t size) {
+        start = data;
+        cursor = data;
+        end = data + size;
+        token_start = data;
+        stream = nullptr;
+        windowed = false;
+        base = 0;
+        indexed = 0;
+        line_index.clear();
+        lookahead_head = 0;
+        lookahead_count = 0;
+    }
+
+    bool Lexer::refill() {
+        if( (stream == nullptr) || !stream->good() )
+            return false;
+
+        //everything before the token being read is done with, bar its line starts
+        index_lines(token_start);
+
+        std::size_t kept = end - token_start;
+        std::size_t read_so_far = cursor - token_start;
+        base += token_start - start;
+
+        //a long token keeps the window from sliding far, so it's grown to still read plenty
+        if(kept > buffer.size() / 2) {
+            std::string grown(buffer.size() * 2, '\0');
+            std::memcpy(grown.data(), token_start, kept);
+            buffer.swap(grown);
+        } else {
+            std::memmove(buffer.data(), token_start, kept);
+        }
+
+        stream->read(buffer.data() + kept, buffer.size() - kept);
+        std::size_t got = stream->gcount();
+
+        start = buffer.data();
+        token_start = start;
+        cursor = start + read_so_far;
+        end = start + kept + got;
+        return got > 0;
+    }
+
+    void Lexer::index_lines(const char *upto) {
+        const char *pos = start + (indexed - base);
+        if(pos >= upto)
+            return;
+
+        while(pos < upto) {
+            const char *nl = static_cast<const char*>(std::memchr(pos, '\n', upto - pos));
+            if(nl == nullptr)
+                break;
+
+            line_index.add_line(base + (nl + 1 - start));
+            pos = nl + 1;
+        }
+
+        indexed = base + (upto - start);
+    }
+
+    void Lexer::forget_behind() {
+        //nothing before the token next() is about to return is needed any more
+        uint32_t oldest = (lookahead_count > 0) ? lookahead[lookahead_head].offset : base + (cursor - start);
+        if(line_index.kept() > LINES_KEPT)
+            line_index.drop_before(oldest);
+
+        if(symbol_table.memory() <= SYMBOL_BUDGET)
+            return;
+
+        //the peeked tokens are the only ones still holding ids, so they're interned again
+        std::array<std::string, MAX_LOOKAHEAD> held;
+        for(std::size_t i = 0; i < lookahead_count; i++) {
+            Token &t = lookahead[(lookahead_head + i) & (MAX_LOOKAHEAD - 1)];
+            if( (t.type == IDENTIFIER) || (t.type == STRING_LIT) || (t.type == ERROR) )
+                held[i] = symbol_table.name(t.symbol);
+        }
+
+        symbol_table.clear();
+
+        for(std::size_t i = 0; i < lookahead_count; i++) {
+            Token &t = lookahead[(lookahead_head + i) & (MAX_LOOKAHEAD - 1)];
+            if( (t.type == IDENTIFIER) || (t.type == STRING_LIT) || (t.type == ERROR) )
+                t.symbol = symbol_table.intern(held[i]);
+        }
+    }
+
+    template<typename Scan>
+    void Lexer::scan_refilling(Scan scan) {
+        //scans stop at the end of the window, so carry on into the next one - refill() keeps
+        //the token from token_start, so the scan doesn't have to start again
+        cursor = scan(cursor, end);
+        while( (cursor == end) && refill() )
+            cursor = scan(cursor, end);
+    }
+
+    void Lexer::resume(const char *data, std::size_t size, uint32_t offset) {
+        reset(data, size);
+        cursor = start + offset;
+        token_start = cursor;
+    }
+
     Token Lexer::next() {
+        if(windowed)
+            forget_behind();
+
+        if(lookahead_count > 0) {
+            Token t = lookahead[lookahead_head];
+            lookahead_head = (lookahead_head + 1) & (MAX_LOOKAHEAD - 1);
+            lookahead_count--;
+            return t;
+        }
+
         return read_token();
     }
 
-    Token Lexer::peek() {
-        //save current positions and reset after
-        auto current_stream_pos = source->tellg();
-        int current_column = column;
-        int current_line = line;
+    TokenStream Lexer::tokenize_all() {
+        TokenStream stream;
+
+        //generated and hand written sources both average around 5-6 bytes a token
+        stream.reserve((end - cursor) / 5 + 16);
+
+        //hand over anything peek() has already lexed first
+        while(lookahead_count > 0) {
+            Token t = next();
+            stream.push(t);
+
+            if(t.type == EOS)
+                return stream;
+        }
+
+        while(true) {
+            Token t = read_token();
+            stream.push(t);
+
+            if(t.type == EOS)
+                return stream;
+        }
+    }
+
+    Token Lexer::peek(std::size_t depth) {
+        //past the ring would read a token that was never lexed
+        if( (depth < 1) || (depth > MAX_LOOKAHEAD) )
+            return Token(ERROR, token_offset(), symbol_table.intern("Peek depth out of range"));
 
-        Token t = read_token();
+        while(lookahead_count < depth) {
+            lookahead[(lookahead_head + lookahead_count) & (MAX_LOOKAHEAD - 1)] = read_token();
+            lookahead_count++;
+        }
 
-        source->clear(); //need to clear flags, in case we hit EOF while getting the next token
+        return lookahead[(lookahead_head + depth - 1) & (MAX_LOOKAHEAD - 1)];
+    }
+
+    Token Lexer::error(std::string_view message) {
+        return Token(ERROR, token_offset(), symbol_table.intern(message));
+    }
 
-        //restore old position
-        source->seekg(current_stream_pos);
-        column = current_column;
-        line = current_line;
+    Location Lexer::location(uint32_t offset) {
+        if(stream != nullptr)
+            index_lines(end);
+        else if(line_index.empty())
+            line_index.build(start, end - start);
 
-        return t;
+        return line_index.locate(offset);
     }
 
-    char Lexer::advance() {
-        char ch = source->get();
-        column++;
-        return ch;
+    void TokenStream::reserve(std::size_t tokens) {
+        types.reserve(tokens);
+        offsets.reserve(tokens);
+        payloads.reserve(tokens);
     }
 
-    char Lexer::peek_char(int offset) {
+    void TokenStream::push(const Token &token) {
+        types.push_back(token.type);
+        offsets.push_back(token.offset);
 
-        if( offset == 1) {
-            return source->peek();
-        } else {
-            //store current position
-            int curr = source->tellg();
+        switch(token.type) {
+            case INTEGER_LIT:
+                payloads.push_back(integers.size());
+                integers.push_back(token.i_value);
+                break;
+            case FLOAT_LIT:
+                payloads.push_back(floats.size());
+                floats.push_back(token.f_value);
+                break;
+            case IDENTIFIER:
+            case STRING_LIT:
+            case ERROR:
+                payloads.push_back(token.symbol);
+                break;
+            default:
+                payloads.push_back(0);
+        }
+    }
 
-            // this looks weird, but is ok.
-            // istream->peek looks at the character after the current position (curr + 1).
-            // So peek_char(1) - peek 1 char ahead - needs an offset of 0
-            source->seekg(offset-1, source->cur);
-            char ch = source->peek();
+    Token TokenStream::operator[](std::size_t i) const {
+        switch(types[i]) {
+            case INTEGER_LIT: return Token(types[i], offsets[i], integers[payloads[i]]);
+            case FLOAT_LIT: return Token(types[i], offsets[i], floats[payloads[i]]);
+            case IDENTIFIER:
+            case STRING_LIT:
+            case ERROR:
+                return Token(types[i], offsets[i], static_cast<SymbolId>(payloads[i]));
+            default:
+                return Token(types[i], offsets[i]);
+        }
+    }
 
-            //reset to original pos
-            source->seekg(curr, source->beg);
+    char Lexer::advance() {
+        if( (cursor < end) || refill() )
+            return *cursor++;
 
-            return ch;
+        return EOS_CHAR;
+    }
+
+    char Lexer::peek_char(int offset) {
+        //peek_char(1) is the character under the cursor - the next one advance() will return
+        while(end - cursor < offset) {
+            if(!refill())
+                return EOS_CHAR;
         }
+
+        return cursor[offset-1];
     }
 
     char Lexer::skip_whitespace_comments(char ch) {
         char tmp = ch;
 
+        //token_start follows along, so a stream's window slides past what's skipped
         while(true) {
-            switch(tmp) {
-                //whitespace
-                case ' ':
-                case '\f':
-                case '\t':
-                    tmp = advance();
-                    break;
-
-                //comments till end of line
-                case '#':
-                    //run to end of line, or end of file
-                    while(true) {
-                        ch = advance();
-
-                        if(ch == '\n') {
-                            break;
-                        } else if (ch == std::istream::traits_type::eof() ) {
-                            //end of file - jump out
-                            break;
-                        }
-                    }
-                    //set tmp to the next char - might be and eof
-                    tmp = advance();
-                    break;
+            if(has_class(tmp, CC_SPACE)) {
+                token_start = cursor;
+                tmp = advance();
+
+            } else if(tmp == '#') {
+                //comments run to the end of line, or end of file. The newline goes with the comment
+                cursor = scan_line(cursor, end);
+                while(cursor == end) {
+                    token_start = cursor;
+                    if(!refill())
+                        break;
+                    cursor = scan_line(cursor, end);
+                }
+                if(cursor < end)
+                    cursor++;
+                token_start = cursor;
+
+                //set tmp to the next char - might be and eof
+                tmp = advance();
 
-                default:
-                    return tmp;
+            } else {
+                return tmp;
             }
         }
     }
 
     bool Lexer::is_hex_char(char ch) {
-        if ( (ch >= '0') && (ch <= '9') )
-            return true;
-        else if ( (ch >= 'a') && (ch <= 'f') )
-            return true;
-        else if ( (ch >= 'A') && (ch <= 'F') )
-            return true;
-        else if (ch =='_')
-            return true;
+        return has_class(ch, CC_HEX);
+    }
 
-        return false;
+    bool Lexer::is_binary_char(char ch) {
+        return has_class(ch, CC_BINARY);
     }
 
-    Token Lexer::read_hex_number() {
-        std::string buffer = "";
-        int start_column = column;
-
-        while(true){
-            if( is_hex_char(peek_char()) ) {
-                char ch = advance();
-                if(ch != '_') {
-                    buffer += ch;
-                }
-            } else {
-                //try to convert to long
-                try {
-                    long value = std::stol(buffer, nullptr, 16);
-                    return Token(INTEGER_LIT, line, start_column, value);
-                } catch (const std::exception& e){
-                    return Token(ERROR, line, start_column, "Unable to convert hex literal to integer");
+    bool Lexer::is_decimal_char(char ch) {
+        return has_class(ch, CC_DECIMAL);
+    }
+
+    std::errc Lexer::convert_integer(const char *first, const char *last, int base, int64_t &value) {
+        //converted a run of digits at a time between '_' separators, so nothing is copied
+        value = 0;
+        bool digits = false;
+
+        while(first < last) {
+            const char *sep = std::find(first, last, '_');
+
+            if(sep > first) {
+                int64_t part;
+                auto [ptr, ec] = std::from_chars(first, sep, part, base);
+                if(ec != std::errc())
+                    return ec;
+
+                //shift the digits so far up past this run
+                for(const char *p = first; (p < sep) && (value != 0); p++) {
+                    if(__builtin_mul_overflow(value, base, &value))
+                        return std::errc::result_out_of_range;
                 }
+                if(__builtin_add_overflow(value, part, &value))
+                    return std::errc::result_out_of_range;
+
+                digits = true;
             }
+
+            first = (sep < last) ? sep + 1 : last;
         }
+
+        return digits ? std::errc() : std::errc::invalid_argument;
     }
 
-    bool Lexer::is_binary_char(char ch) {
-        if ( (ch >= '0') && (ch <= '1') )
-            return true;
-        else if (ch =='_')
-            return true;
+    std::errc Lexer::convert_float(const char *first, const char *last, double &value) {
+        if(std::find(first, last, '_') == last) {
+            auto [ptr, ec] = std::from_chars(first, last, value);
+            return ec;
+        }
 
-        return false;
-    }
+        //from_chars needs the separators gone - short literals are squeezed on the stack
+        char digits[64];
+        char *out = digits;
 
-    Token Lexer::read_binary_number() {
-        std::string buffer = "";
-        int start_column = column;
-
-        while(true){
-            if( is_binary_char(peek_char()) ) {
-                char ch = advance();
-                if(ch != '_') {
-                    buffer += ch;
-                }
-            } else {
-                //try to convert to long
-                try {
-                    long value = std::stol(buffer, nullptr, 2);
-                    return Token(INTEGER_LIT, line, start_column, value);
-                } catch (const std::exception& e){
-                    return Token(ERROR, line, start_column, "Unable to convert binary literal to integer");
-                }
+        if(last - first > (std::ptrdiff_t)sizeof(digits)) {
+            scratch.clear();
+            for(const char *p = first; p < last; p++) {
+                if(*p != '_')
+                    scratch += *p;
             }
+            auto [ptr, ec] = std::from_chars(scratch.data(), scratch.data() + scratch.size(), value);
+            return ec;
+        }
+
+        for(const char *p = first; p < last; p++) {
+            if(*p != '_')
+                *out++ = *p;
         }
+
+        auto [ptr, ec] = std::from_chars(digits, out, value);
+        return ec;
     }
 
-    bool Lexer::is_decimal_char(char ch) {
-        if ( (ch >= '0') && (ch <= '9') )
-            return true;
-        else if (ch =='_')
-            return true;
+    Token Lexer::read_hex_number() {
+        scan_refilling([this](const char *pos, const char *last) {
+            while( (pos < last) && is_hex_char(*pos) )
+                pos++;
+            return pos;
+        });
+
+        //past the 0x
+        int64_t value;
+        std::errc ec = convert_integer(token_start + 2, cursor, 16, value);
+
+        if(ec == std::errc::result_out_of_range)
+            return error("Hex literal out of range");
+        else if(ec != std::errc())
+            return error("Unable to convert hex literal to integer");
+
+        return Token(INTEGER_LIT, token_offset(), value);
+    }
 
-        return false;
+    Token Lexer::read_binary_number() {
+        scan_refilling([this](const char *pos, const char *last) {
+            while( (pos < last) && is_binary_char(*pos) )
+                pos++;
+            return pos;
+        });
+
+        //past the 0b
+        int64_t value;
+        std::errc ec = convert_integer(token_start + 2, cursor, 2, value);
+
+        if(ec == std::errc::result_out_of_range)
+            return error("Binary literal out of range");
+        else if(ec != std::errc())
+            return error("Unable to convert binary literal to integer");
+
+        return Token(INTEGER_LIT, token_offset(), value);
     }
-    Token Lexer::read_number() {
-        std::string buffer = "";
-        int start_column = column;
 
+    Token Lexer::read_number() {
+        //the literal is converted in place, from the token start - read_token() may already
+        //have consumed a leading 0
         bool decimal = true;
+        bool exponent = false;
 
         while(true) {
             char ch = peek_char(1);
 
             if( is_decimal_char(ch) ) {
-                ch = advance();
-                if(ch != '_') {
-                    buffer += ch;
-                }
+                cursor++;
 
             } else if( (ch == '.') && decimal ){
-                ch = advance();
+                cursor++;
                 decimal = false;
-                buffer += ch;
 
-            } else if( (ch == 'e') || (ch == 'E') ) {
+            } else if( ((ch == 'e') || (ch == 'E')) && !exponent ) {
                 advance();
 
                 //look for an exponent sign after the exponent marker
@@ -190,203 +406,187 @@ namespace torq {
 
                 if( (sch == '-') || (sch == '+') ) {
                     //look for a digit after the exponent sign
-                    char pch = peek_char(2);
-
-                    if(is_decimal_char(pch)) {
-                        decimal = false;
-
-                        buffer += ch;
-                        buffer += sch;
-                        buffer += pch;
+                    if(is_decimal_char(peek_char(2))) {
                         advance();
                         advance();
                     } else {
-                        return Token(ERROR, line, start_column, "Incomplete float literal");
+                        return error("Incomplete float literal");
                     }
 
                 } else if(is_decimal_char(sch)) {
-                    decimal = false;
-
-                    buffer += ch;
-                    buffer += sch;
                     advance();
 
                 } else {
-                    return Token(ERROR, line, start_column, "Incomplete float literal");
+                    return error("Incomplete float literal");
                 }
+
+                decimal = false;
+                exponent = true;
             } else {
                 break;
             }
         }
 
         if(decimal) {
-            try {
-                long value = std::stol(buffer, nullptr, 10);
-                return Token(INTEGER_LIT, line, start_column, value);
-            } catch (const std::exception& e) {
-                return Token(ERROR, line, start_column, "Error converting decimal number literal");
-            }
+            int64_t value;
+            std::errc ec = convert_integer(token_start, cursor, 10, value);
+
+            if(ec == std::errc::result_out_of_range)
+                return error("Decimal literal out of range");
+            else if(ec != std::errc())
+                return error("Error converting decimal number literal");
+
+            return Token(INTEGER_LIT, token_offset(), value);
         } else {
-            try{
-            double value = std::stod(buffer);
-            return Token(FLOAT_LIT, line, start_column, value);
-            } catch(const std::exception& e) {
-                return Token(ERROR, line, start_column, "Error converting float number literal");
-            }
+            double value;
+            if(convert_float(token_start, cursor, value) != std::errc())
+                return error("Error converting float number literal");
+
+            return Token(FLOAT_LIT, token_offset(), value);
         }
     }
 
     Token Lexer::read_string() {
-        std::string buffer = "";
         bool single_line = true;
-        int start_column = column-1;
-        int start_line = line;
 
         //check for single or multi-line strings and for empty strings
         if( (peek_char(1) == '"') && (peek_char(2) != '"') ) {
             //empty string
             advance();
-            return Token(STRING_LIT, line, start_column, "");
+            return Token(STRING_LIT, token_offset(), symbol_table.intern(""));
         } else if ( (peek_char(1) == '"') && (peek_char(2) == '"') ) {
             //multi-line string
             single_line = false;
             advance();
             advance();
-        } else {
-            single_line = true;
         }
 
+        //a string with no escapes is interned straight from the source. Otherwise the runs
+        //between escapes are collected in scratch
+        scratch.clear();
+        bool copied = false;
+
         while(true) {
-            char ch = advance();
+            //kept as an offset from token_start, which stays put in the window while the string is read
+            std::size_t run_offset = cursor - token_start;
+            scan_refilling(scan_string);
+            const char *run = token_start + run_offset;
+
+            if(cursor == end)
+                return error("Unterminated string literal");
+
+            char ch = *cursor++;
+
+            if( (ch == '"') && single_line ) {
+                if(!copied)
+                    return Token(STRING_LIT, token_offset(), symbol_table.intern(std::string_view(run, cursor - 1 - run)));
+
+                scratch.append(run, cursor - 1 - run);
+                return Token(STRING_LIT, token_offset(), symbol_table.intern(scratch));
+            }
+
+            scratch.append(run, cursor - 1 - run);
+            copied = true;
 
             if(ch == '\\') {
                 ch = advance();
 
                 switch(ch) {
-                    case '\\': buffer += '\\'; break;
-                    case '"': buffer += '"'; break;
-                    case 'n': buffer += '\n'; break;
-                    case 'r': buffer += '\r'; break;
-                    case 't': buffer += '\t'; break;
+                    case '\\': scratch += '\\'; break;
+                    case '"': scratch += '"'; break;
+                    case 'n': scratch += '\n'; break;
+                    case 'r': scratch += '\r'; break;
+                    case 't': scratch += '\t'; break;
 
                     default:
-                        buffer = "Invalid escape character: ";
-                        buffer += ch;
-                        return Token(ERROR, line, column, buffer);
+                        scratch = "Invalid escape character: ";
+                        scratch += ch;
+                        return error(scratch);
                 }
             } else if(ch == '\n') {
-                if(single_line) {
+                if(single_line)
+                    return error("Unterminated string literal");
+
+                //multiline, just add
+                scratch += ch;
+            } else {
+                //multiline string - read and remove two more " or error
+                if( (peek_char(1) == '"') && (peek_char(2) == '"') ) {
+                    advance();
                     advance();
-                    line++;
-                    return Token(ERROR, line, column, "Unterminated string literal");
+                    return Token(STRING_LIT, token_offset(), symbol_table.intern(scratch));
                 } else {
-                    //multiline, just add
-                    buffer += ch;
+                    return error("Unclosed multi-line string");
                 }
-            } else if(ch == '"') {
-                if(single_line) {
-                    return Token(STRING_LIT, line, start_column, buffer);
-                } else {
-                    //multiline string - read and remove two more " or error
-                    if( (peek_char(1) == '"') && (peek_char(2) == '"') ) {
-                        return Token(STRING_LIT, start_line, start_column, buffer);
-                    } else {
-                        return Token(ERROR, start_line, start_column, "Unclosed multi-line string");
-                    }
-                }
-            } else if(source->eof()) {
-                return Token(ERROR, line, column, "Unterminated string literal");
-            } else {
-                buffer += ch;
             }
         }
     }
 
-    bool Lexer::is_name_start_char(char ch){
-        if(ch == '_')
-            return true;
-        if( (ch >= 'a') && (ch <= 'z') )
-            return true;
-        if( (ch >= 'A') && (ch <= 'Z') )
-            return true;
-
-        return false;
+    bool Lexer::is_name_start_char(char ch) {
+        return has_class(ch, CC_NAME_START);
     }
 
-    bool Lexer::is_name_char(char ch){
-        if(ch == '_')
-            return true;
-        if( (ch >= 'a') && (ch <= 'z') )
-            return true;
-        if( (ch >= 'A') && (ch <= 'Z') )
-            return true;
-        if( (ch >= '0') && (ch <= '9') )
-            return true;
-
-        return false;
+    bool Lexer::is_name_char(char ch) {
+        return has_class(ch, CC_NAME);
     }
 
     Token Lexer::read_name() {
-        std::string name = "";
+        //names are a contiguous run of the buffer, so they can be interned without a copy.
+        //read_token() rewound to the token start
+        scan_refilling(scan_name);
 
-        int start_column = column + 1;
+        std::string_view name(token_start, cursor - token_start);
 
-        while(true) {
-            char ch = peek_char();
-
-            if(!is_name_char(ch))
-                break;
+        TokenType type = keyword_type(name);
 
-            name += ch;
-            advance();
-        }
+        if(type != IDENTIFIER)
+            return Token(type, token_offset());
 
-        try {
-            TokenType type = keywords.at(name);
-            return Token(type, line, column);
-        } catch(std::out_of_range){
-            return Token(IDENTIFIER, line, column, name);
-        }
+        return Token(IDENTIFIER, token_offset(), symbol_table.intern(name));
     }
 
 
     Token Lexer::process_pair(char second, TokenType pair, TokenType single) {
         if (peek_char() == second) {
             advance();
-            return Token(pair, line, column-1, "");
+            return Token(pair, token_offset());
         } else {
-            return Token(single, line, column, "");
+            return Token(single, token_offset());
         }
     }
 
     Token Lexer::read_token() {
+        token_start = cursor;
         char ch = advance();
 
         //skip whitespace and comments - in any order - before collecting next token
         ch = skip_whitespace_comments(ch);
 
-        if (ch == std::istream::traits_type::eof() )
-            return Token(EOS, line, column, "");
+        if (ch == EOS_CHAR) {
+            token_start = cursor;
+            return Token(EOS, token_offset());
+        }
+
+        token_start = cursor - 1;
 
         //assign tokens
         switch(ch) {
             //single char tokens
-            case '(': return Token(LPAREN, line, column);
-            case ')': return Token(RPAREN, line, column);
-            case '[': return Token(LBRACKET, line, column);
-            case ']': return Token(RBRACKET, line, column);
-            case ',': return Token(COMMA, line, column);
-            case '.': return Token(DOT, line, column);
-            case ';': return Token(SEMICOLON, line, column);
-            case ':': return Token(COLON, line, column);
-            case '+': return Token(PLUS, line, column);
-            case '-': return Token(MINUS, line, column);
-            case '*': return Token(STAR, line, column);
-            case '/': return Token(SLASH, line, column);
-            case '%': return Token(PERCENT, line, column);
+            case '(': return Token(LPAREN, token_offset());
+            case ')': return Token(RPAREN, token_offset());
+            case '[': return Token(LBRACKET, token_offset());
+            case ']': return Token(RBRACKET, token_offset());
+            case ',': return Token(COMMA, token_offset());
+            case '.': return Token(DOT, token_offset());
+            case ';': return Token(SEMICOLON, token_offset());
+            case ':': return Token(COLON, token_offset());
+            case '+': return Token(PLUS, token_offset());
+            case '-': return Token(MINUS, token_offset());
+            case '*': return Token(STAR, token_offset());
+            case '/': return Token(SLASH, token_offset());
+            case '%': return Token(PERCENT, token_offset());
             case '\n':
-                line++;
-                return Token(ENDL, line, column);
+                return Token(ENDL, token_offset());
 
             //single or double char tokens
             case '=': return process_pair('=', EQUALS, ASSIGN);
@@ -417,17 +617,17 @@ namespace torq {
                 //handle all the cases that cannot be matched on start char
                 if(is_name_start_char(ch)) {
                     //rewind 1 place to allow the read routine to pick up the first digit
-                    source->seekg(-1, source->cur);
+                    cursor--;
                     return read_name();
                 }
                 else if( (ch >= '0') && (ch <= '9') ) {
                     //rewind 1 place to allow the read routine to pick up the first digit
-                    source->seekg(-1, source->cur);
+                    cursor--;
                     return read_number();
                 } else {
-                    std::string error = "Unrecognised token: ";
-                    error += ch;
-                    return Token(ERROR, line, column, error);
+                    scratch = "Unrecognised token: ";
+                    scratch += ch;
+                    return error(scratch);
                 }
         }
     }
@@ -1,14 +1,23 @@
 #pragma once
 
-#include <fstream>
-#include <iostream>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
 #include <string>
-#include <sstream>
-#include <unordered_map>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "location.hpp"
+#include "source.hpp"
+#include "symbols.hpp"
 
 namespace torq {
 
-    enum TokenType {
+    enum TokenType : uint8_t {
         LPAREN, RPAREN, LBRACKET, RBRACKET,
         DOT, COMMA, SEMICOLON, COLON, EXCLAIM,
 
@@ -29,12 +38,12 @@ namespace torq {
         FUNCTION,
 
         ENDL,
-        EOS = 1000,
-        ERROR = 9999
+        EOS,
+        ERROR
     };
 
 
-    inline std::unordered_map<std::string, TokenType> keywords = {
+    constexpr std::array<std::pair<std::string_view, TokenType>, 16> keywords = {{
         {"import", IMPORT},
         {"if", IF},
         {"then", THEN},
@@ -51,62 +60,212 @@ namespace torq {
         {"float", FLOAT_TYPE},
         {"string", STRING_TYPE},
         {"fn", FUNCTION}
-    } ;
-
-
+    }};
+
+
+    //keyword for a name, or IDENTIFIER. Dispatches on length then first character, so an
+    //identifier costs at most one short compare
+    constexpr TokenType keyword_type(std::string_view name) {
+        switch(name.size()) {
+            case 2:
+                switch(name[0]) {
+                    case 'i': if(name == "if") return IF; break;
+                    case 'd': if(name == "do") return DO; break;
+                    case 'f': if(name == "fn") return FUNCTION; break;
+                }
+                break;
+            case 3:
+                switch(name[0]) {
+                    case 'e': if(name == "end") return END; break;
+                    case 'f': if(name == "for") return FOR; break;
+                    case 'i': if(name == "int") return INT_TYPE; break;
+                }
+                break;
+            case 4:
+                switch(name[0]) {
+                    case 't':
+                        if(name == "then") return THEN;
+                        if(name == "true") return TRUE_LIT;
+                        break;
+                    case 'e': if(name == "else") return ELSE; break;
+                }
+                break;
+            case 5:
+                switch(name[0]) {
+                    case 'w': if(name == "while") return WHILE; break;
+                    case 'b': if(name == "break") return BREAK; break;
+                    case 'f':
+                        if(name == "false") return FALSE_LIT;
+                        if(name == "float") return FLOAT_TYPE;
+                        break;
+                }
+                break;
+            case 6:
+                switch(name[0]) {
+                    case 'i': if(name == "import") return IMPORT; break;
+                    case 'r': if(name == "return") return RETURN; break;
+                    case 's': if(name == "string") return STRING_TYPE; break;
+                }
+                break;
+        }
+
+        return IDENTIFIER;
+    }
+
+    //keyword_type() has to be kept in step with the table
+    constexpr bool keywords_match() {
+        for(auto &[name, type] : keywords) {
+            if(keyword_type(name) != type)
+                return false;
+        }
+        return true;
+    }
+    static_assert(keywords_match(), "keyword_type() is missing a keyword");
+
+
+    //16 bytes - at most one payload is ever used, so they share storage. Line and column are
+    //not stored, Lexer::location() recovers them from the offset
     class Token {
       public:
         TokenType type;
-        int line;
-        int column;
+        uint32_t offset;
 
-        std::string s_value;
-        long i_value;
-        double f_value;
+        union {
+            //identifier names, string literal contents and error messages - see Lexer::text()
+            SymbolId symbol;
+            int64_t i_value;
+            double f_value;
+        };
 
       public:
-        Token(TokenType type, int line, int column) :
-          type(type), line(line), column(column) {
-              s_value= "";
-              i_value = 0;
-              f_value = 0.0f;
+        Token() : type(EOS), offset(0), i_value(0) {}
+
+        Token(TokenType type, uint32_t offset) :
+          type(type), offset(offset), i_value(0) {}
+
+        Token(TokenType type, uint32_t offset, SymbolId value) :
+          type(type), offset(offset), i_value(0) {
+              symbol = value;
           }
 
-        Token(TokenType type, int line, int column, std::string value) :
-            type(type), line(line), column(column), s_value(value) {
-                i_value = 0;
-                f_value = 0.0f;
-            }
-
-        Token(TokenType type, int line, int column, long value) :
-            type(type), line(line), column(column), i_value(value) {
-                s_value= "";
-                f_value = 0.0f;
-            }
-
-        Token(TokenType type, int line, int column, double value) :
-            type(type), line(line), column(column), f_value(value) {
-                s_value= "";
-                i_value = 0;
-            }
+        Token(TokenType type, uint32_t offset, int64_t value) :
+          type(type), offset(offset), i_value(value) {}
+
+        Token(TokenType type, uint32_t offset, double value) :
+          type(type), offset(offset), f_value(value) {}
+    };
+
+    static_assert(sizeof(Token) == 16, "Token should pack into 16 bytes");
+
+
+    //a whole file of tokens in structure-of-arrays form, always terminated by an EOS token.
+    //payloads index into integers/floats for number literals and hold the symbol id otherwise
+    class TokenStream {
+      public:
+        std::vector<TokenType> types;
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> payloads;
+
+        std::vector<int64_t> integers;
+        std::vector<double> floats;
+
+      public:
+        void reserve(std::size_t tokens);
+        void push(const Token &token);
+
+        std::size_t size() const { return types.size(); }
+
+        TokenType type(std::size_t i) const { return types[i]; }
+        uint32_t offset(std::size_t i) const { return offsets[i]; }
+        SymbolId symbol(std::size_t i) const { return payloads[i]; }
+        int64_t i_value(std::size_t i) const { return integers[payloads[i]]; }
+        double f_value(std::size_t i) const { return floats[payloads[i]]; }
+
+        Token operator[](std::size_t i) const;
     };
 
 
+    //returned by advance() and peek_char() once the cursor runs off the end of the buffer
+    constexpr char EOS_CHAR = '\0';
+
+
     class Lexer {
+      public:
+        //how far peek() can see - must be a power of two
+        static constexpr std::size_t MAX_LOOKAHEAD = 8;
+
+        //default window for lexing from a stream
+        static constexpr std::size_t STREAM_WINDOW = 64 * 1024;
+
+        //what a stream lexer keeps of what it has read
+        enum class Retain {
+            //every line start and symbol, so text() and location() hold for any token and ids
+            //stay comparable - what the parser needs. Grows with the input
+            ALL,
+            //only what the tokens still held need: text() and location() hold for the token
+            //next() last returned and any peeked past it, until next() is called again.
+            //Memory stays the same however long the input
+            WINDOW
+        };
+
+        //with Retain::WINDOW, symbols are forgotten once they take more than this
+        static constexpr std::size_t SYMBOL_BUDGET = 256 * 1024;
+        //and line starts once this many are kept
+        static constexpr std::size_t LINES_KEPT = 1024;
+
       private:
-        std::istream *source;
-        std::stringstream string_stream;
+        //owned storage for the string adapter, and the window for streams - unused for borrowed buffers
+        std::string buffer;
+
+        const char *start;
+        const char *cursor;
+        const char *end;
+
+        //set when lexing from a stream: start is then base bytes into it, and the window slides
+        //on past each token as more is read
+        std::istream *stream;
+        bool windowed;
+        uint32_t base;
+        //offset up to which line starts are in line_index, as the window only holds some lines
+        uint32_t indexed;
+
+        //first character of the token being read
+        const char *token_start;
+
+        SymbolTable symbol_table;
+        LineIndex line_index;
 
-        int line;
-        int column;
+        //tokens already lexed by peek(), oldest at lookahead_head
+        std::array<Token, MAX_LOOKAHEAD> lookahead;
+        std::size_t lookahead_head;
+        std::size_t lookahead_count;
+
+        //reused for string literal escapes and error messages, so its capacity is kept
+        std::string scratch;
+
+        void reset(const char *data, std::size_t size);
+
+        bool refill();
+        void index_lines(const char *upto);
+        void forget_behind();
+
+        template<typename Scan>
+        void scan_refilling(Scan scan);
 
         char advance();
         char peek_char(int offset = 1);
 
         char skip_whitespace_comments(char ch);
 
+        uint32_t token_offset() const { return base + (token_start - start); }
+
+        Token error(std::string_view message);
+
         Token process_pair(char second, TokenType pair, TokenType single);
 
+        std::errc convert_integer(const char *first, const char *last, int base, int64_t &value);
+        std::errc convert_float(const char *first, const char *last, double &value);
+
         Token read_hex_number();
         Token read_binary_number();
         Token read_number();
@@ -120,19 +279,51 @@ namespace torq {
         bool is_name_char(char ch);
 
       public:
-        Lexer(std::string string_source) : string_stream(string_source) {
-            source = &string_stream;
-            line = 1;
-            column = 0;
+        Lexer(std::string string_source) : buffer(std::move(string_source)) {
+            reset(buffer.data(), buffer.size());
+        };
+        //reads the stream a window at a time - a token longer than half the window grows it.
+        //Works on pipes, nothing is seeked. Only the window is bounded unless retain is
+        //Retain::WINDOW, as the line index and symbol table otherwise keep everything
+        Lexer(std::istream &stream_source, std::size_t window = STREAM_WINDOW, Retain retain = Retain::ALL);
+
+        //lex directly over a caller-owned buffer, without copying. The buffer must outlive the lexer
+        Lexer(const char *data, std::size_t size) {
+            reset(data, size);
         };
-        Lexer(std::ifstream &file_source) {
-            source = &file_source;
-            line = 1;
-            column = 0;
+        Lexer(const Source &source) {
+            reset(source.data(), source.size());
         };
 
+        //the cursor points into the lexer itself for the owning adapters
+        Lexer(const Lexer&) = delete;
+        Lexer& operator=(const Lexer&) = delete;
+
         Token next();
-        Token peek();
+
+        //the token depth places ahead, 1 being the one next() will return. Each token is only lexed once.
+        //An ERROR token for a depth outside 1 to MAX_LOOKAHEAD
+        Token peek(std::size_t depth = 1);
+
+        //lexes everything left in the source in one pass. Needs Retain::ALL for a stream, as
+        //the tokens all stay held
+        TokenStream tokenize_all();
+
+        //carries on lexing over a new buffer from offset, keeping the symbol table so ids stay
+        //comparable. offset has to be a point where the lexer is between tokens
+        void resume(const char *data, std::size_t size, uint32_t offset);
+
+        //bytes the lexer holds itself: its copy of the source or window, line starts and symbols
+        std::size_t memory() const { return buffer.capacity() + line_index.memory() + symbol_table.memory(); }
+
+        SymbolTable& symbols() { return symbol_table; }
+
+        //text carried by IDENTIFIER, STRING_LIT and ERROR tokens
+        std::string_view text(const Token &token) const { return symbol_table.name(token.symbol); }
+
+        //line and column of a token - the line index is built on first use
+        Location location(const Token &token) { return location(token.offset); }
+        Location location(uint32_t offset);
 
 
       private:
@@ -0,0 +1,50 @@
+#include "location.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace torq {
+
+    void LineIndex::build(const char *data, std::size_t size) {
+        clear();
+        line_starts.push_back(0);
+
+        const char *pos = data;
+        const char *end = data + size;
+
+        while(pos < end) {
+            const char *nl = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+            if(nl == nullptr)
+                break;
+
+            line_starts.push_back(nl + 1 - data);
+            pos = nl + 1;
+        }
+    }
+
+    void LineIndex::drop_before(uint32_t offset) {
+        auto it = std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+        if(it == line_starts.begin())
+            return;
+
+        //the line holding offset stays
+        std::size_t count = (it - line_starts.begin()) - 1;
+        line_starts.erase(line_starts.begin(), line_starts.begin() + count);
+        dropped += count;
+    }
+
+    Location LineIndex::locate(uint32_t offset) const {
+        if(line_starts.empty())
+            return Location{1, static_cast<int>(offset) + 1};
+
+        auto it = std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+        std::size_t line = it - line_starts.begin();
+
+        //before the first line kept, it's been dropped
+        if(line == 0)
+            return Location{static_cast<int>(dropped), 0};
+
+        return Location{static_cast<int>(dropped + line), static_cast<int>(offset - line_starts[line - 1]) + 1};
+    }
+
+}
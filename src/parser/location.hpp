@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace torq {
+
+    //1-based line and column of a source offset
+    struct Location {
+        int line;
+        int column;
+    };
+
+
+    //offsets of the first character of every line, so tokens only need to carry a byte offset
+    class LineIndex {
+      private:
+        std::vector<uint32_t> line_starts;
+        //lines before line_starts[0], once drop_before() has forgotten them
+        std::size_t dropped = 0;
+
+      public:
+        void build(const char *data, std::size_t size);
+        void clear() { line_starts.clear(); dropped = 0; }
+        bool empty() const { return line_starts.empty(); }
+
+        //records a line starting at offset - offsets must be added in increasing order
+        void add_line(uint32_t offset) { line_starts.push_back(offset); }
+
+        //forgets the lines before the one holding offset. Later offsets still locate, with
+        //the same line numbers
+        void drop_before(uint32_t offset);
+
+        //an offset on a dropped line gets column 0, and the line before the first kept
+        Location locate(uint32_t offset) const;
+
+        std::size_t lines() const { return dropped + line_starts.size(); }
+        std::size_t kept() const { return line_starts.size(); }
+        uint32_t line_start(std::size_t line) const { return line_starts[line - 1 - dropped]; }
+
+        std::size_t memory() const { return line_starts.capacity() * sizeof(uint32_t); }
+    };
+
+}
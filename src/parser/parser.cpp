@@ -0,0 +1,598 @@
+#include "parser.hpp"
+
+namespace torq {
+
+    namespace {
+        //binding power of binary operators, 0 for anything else
+        int precedence(TokenType type) {
+            switch(type) {
+                case EQUALS: case NOTEQUALS:
+                case GT: case GTE: case LT: case LTE:
+                    return 1;
+                case PLUS: case MINUS:
+                    return 2;
+                case STAR: case SLASH: case PERCENT:
+                    return 3;
+                default:
+                    return 0;
+            }
+        }
+
+        const char* token_name(TokenType type) {
+            switch(type) {
+                case LPAREN: return "'('";
+                case RPAREN: return "')'";
+                case LBRACKET: return "'['";
+                case RBRACKET: return "']'";
+                case COMMA: return "','";
+                case COLON: return "':'";
+                case ASSIGN: return "'='";
+                case IDENTIFIER: return "a name";
+                case END: return "'end'";
+                case DO: return "'do'";
+                case ENDL: return "end of line";
+                case EOS: return "end of file";
+                default: return "token";
+            }
+        }
+
+        //counts a level of nesting for as long as a parse function runs
+        struct Nesting {
+            int &depth;
+
+            Nesting(int &depth) : depth(depth) { depth++; }
+            ~Nesting() { depth--; }
+        };
+    }
+
+    Parser::Parser(Lexer &lexer) : lexer(lexer), pos(0), panicking(false), depth(0), abandoned(false) {
+        tokens = lexer.tokenize_all();
+
+        //most tokens end up as at most one node
+        ast.nodes.reserve(tokens.size());
+        ast.lists.reserve(tokens.size() / 2);
+        ast.symbols = &lexer.symbols();
+    }
+
+    TokenType Parser::peek(std::size_t ahead) const {
+        std::size_t i = pos + ahead;
+        return (i < tokens.size()) ? tokens.type(i) : EOS;
+    }
+
+    std::size_t Parser::advance() {
+        std::size_t current = pos;
+        if(pos + 1 < tokens.size())
+            pos++;
+        return current;
+    }
+
+    bool Parser::match(TokenType type) {
+        if(peek() != type)
+            return false;
+        advance();
+        return true;
+    }
+
+    bool Parser::expect(TokenType type, const char *what) {
+        if(match(type))
+            return true;
+
+        error(pos, std::string("expected ") + token_name(type) + " " + what);
+        return false;
+    }
+
+    void Parser::error(std::size_t token, std::string message) {
+        //only the first error of a statement is reported, the rest usually follow from it
+        if(panicking || abandoned)
+            return;
+        panicking = true;
+
+        //the lexer's own message is more use than anything the parser can say
+        if(tokens.type(token) == ERROR)
+            message = std::string(lexer.symbols().name(tokens.symbol(token)));
+
+        ast.errors.push_back(Diagnostic{tokens.offset(token), std::move(message)});
+    }
+
+    NodeId Parser::too_deep() {
+        uint32_t offset = tokens.offset(pos);
+        error(pos, "nesting too deep");
+        abandoned = true;
+
+        //everything still open would only report what's missing on the way out
+        pos = tokens.size() - 1;
+        return ast.add(NodeKind::ERROR, offset);
+    }
+
+    void Parser::synchronise() {
+        while( (peek() != ENDL) && (peek() != SEMICOLON) && (peek() != END) && (peek() != EOS) )
+            advance();
+
+        panicking = false;
+    }
+
+    NodeId Parser::parse_statement() {
+        NodeId statement = parse_any_statement();
+
+        if(panicking)
+            synchronise();
+
+        return statement;
+    }
+
+    void Parser::skip_separators() {
+        while( (peek() == ENDL) || (peek() == SEMICOLON) )
+            advance();
+    }
+
+    void Parser::finish_list(NodeId node, std::size_t mark) {
+        ast[node].b = ast.lists.size();
+        ast[node].c = pending.size() - mark;
+
+        ast.lists.insert(ast.lists.end(), pending.begin() + mark, pending.end());
+        pending.resize(mark);
+    }
+
+    Ast Parser::parse() {
+        NodeId root = ast.add(NodeKind::MODULE, 0);
+        std::size_t mark = pending.size();
+
+        while(true) {
+            skip_separators();
+
+            if(peek() == EOS)
+                break;
+
+            if( (peek() == END) || (peek() == ELSE) ) {
+                error(pos, peek() == END ? "'end' without a matching block" : "'else' without a matching 'if'");
+                advance();
+                panicking = false;
+                continue;
+            }
+
+            NodeId statement = parse_statement();
+            pending.push_back(statement);
+        }
+
+        finish_list(root, mark);
+        ast.root = root;
+
+        return std::move(ast);
+    }
+
+    NodeId Parser::parse_any_statement() {
+        switch(peek()) {
+            case IMPORT: return parse_import();
+            case FUNCTION: return parse_function();
+            case IF: return parse_if(false);
+            case WHILE: return parse_while();
+            case FOR: return parse_for();
+            case RETURN: return parse_return();
+
+            case BREAK:
+                return ast.add(NodeKind::BREAK, tokens.offset(advance()));
+
+            case INT_TYPE:
+            case FLOAT_TYPE:
+            case STRING_TYPE:
+                return parse_declare();
+
+            default:
+                break;
+        }
+
+        uint32_t offset = tokens.offset(pos);
+
+        NodeId expr = parse_expression();
+
+        if(panicking)
+            return expr;
+
+        if(peek() == ASSIGN) {
+            std::size_t assign = advance();
+            NodeKind target = ast[expr].kind;
+
+            if( (target != NodeKind::NAME) && (target != NodeKind::INDEX) && (target != NodeKind::MEMBER) ) {
+                error(assign, "can only assign to a name, index or member");
+                return ast.add(NodeKind::ERROR, offset);
+            }
+
+            NodeId value = parse_expression();
+
+            NodeId node = ast.add(NodeKind::ASSIGN, offset);
+            ast[node].a = expr;
+            ast[node].b = value;
+            if(target == NodeKind::NAME)
+                ast[node].symbol = ast[expr].symbol;
+            return node;
+        }
+
+        NodeId node = ast.add(NodeKind::EXPR_STMT, offset);
+        ast[node].a = expr;
+        return node;
+    }
+
+    NodeId Parser::parse_block() {
+        Nesting nesting(depth);
+        if(depth > MAX_DEPTH)
+            return too_deep();
+
+        //a broken block header is skipped to the end of its line, the body still gets parsed
+        if(panicking)
+            synchronise();
+
+        NodeId block = ast.add(NodeKind::BLOCK, tokens.offset(pos));
+        std::size_t mark = pending.size();
+
+        while(true) {
+            skip_separators();
+
+            TokenType type = peek();
+            if( (type == END) || (type == ELSE) || (type == EOS) )
+                break;
+
+            NodeId statement = parse_statement();
+            pending.push_back(statement);
+        }
+
+        finish_list(block, mark);
+        return block;
+    }
+
+    NodeId Parser::parse_import() {
+        NodeId node = ast.add(NodeKind::IMPORT, tokens.offset(advance()));
+
+        std::size_t name = pos;
+        if(!expect(IDENTIFIER, "after 'import'"))
+            return node;
+
+        //dotted names are interned whole, "a.b.c"
+        std::string path(lexer.symbols().name(tokens.symbol(name)));
+        while(peek() == DOT) {
+            advance();
+            name = pos;
+            if(!expect(IDENTIFIER, "after '.' in import"))
+                break;
+            path += ".";
+            path += lexer.symbols().name(tokens.symbol(name));
+        }
+
+        ast[node].symbol = lexer.symbols().intern(path);
+        return node;
+    }
+
+    bool Parser::parse_type(ValueType &type) {
+        switch(peek()) {
+            case INT_TYPE: type = ValueType::INT; break;
+            case FLOAT_TYPE: type = ValueType::FLOAT; break;
+            case STRING_TYPE: type = ValueType::STRING; break;
+            default:
+                return false;
+        }
+        advance();
+        return true;
+    }
+
+    NodeId Parser::parse_function() {
+        NodeId node = ast.add(NodeKind::FUNCTION, tokens.offset(advance()));
+
+        //a missing name is reported, but the rest of the function is still parsed so its
+        //'end' is not mistaken for the end of an enclosing block
+        std::size_t name = pos;
+        if(expect(IDENTIFIER, "after 'fn'"))
+            ast[node].symbol = tokens.symbol(name);
+
+        std::size_t mark = pending.size();
+
+        if(expect(LPAREN, "before function parameters")) {
+            while(peek() != RPAREN) {
+                NodeId param = ast.add(NodeKind::PARAM, tokens.offset(pos));
+                parse_type(ast[param].type);
+
+                std::size_t param_name = pos;
+                if(!expect(IDENTIFIER, "for parameter name"))
+                    break;
+                ast[param].symbol = tokens.symbol(param_name);
+                pending.push_back(param);
+
+                if(!match(COMMA))
+                    break;
+            }
+            expect(RPAREN, "after function parameters");
+        }
+
+        finish_list(node, mark);
+
+        if(match(COLON)) {
+            if(!parse_type(ast[node].type))
+                error(pos, "expected a return type after ':'");
+        }
+
+        NodeId body = parse_block();
+        ast[node].a = body;
+
+        expect(END, "to close function");
+        return node;
+    }
+
+    NodeId Parser::parse_if(bool chained) {
+        //"else if" chains nest too
+        Nesting nesting(depth);
+        if(depth > MAX_DEPTH)
+            return too_deep();
+
+        NodeId node = ast.add(NodeKind::IF, tokens.offset(advance()));
+
+        NodeId condition = parse_expression();
+        match(THEN);
+
+        NodeId then_block = parse_block();
+        NodeId else_block = NO_NODE;
+
+        if(match(ELSE)) {
+            //"else if" chains share the closing 'end' of the first if
+            if(peek() == IF)
+                else_block = parse_if(true);
+            else
+                else_block = parse_block();
+        }
+
+        Node &n = ast[node];
+        n.a = condition;
+        n.b = then_block;
+        n.c = else_block;
+
+        if(!chained)
+            expect(END, "to close if");
+        return node;
+    }
+
+    NodeId Parser::parse_while() {
+        NodeId node = ast.add(NodeKind::WHILE, tokens.offset(advance()));
+
+        NodeId condition = parse_expression();
+        match(DO);
+
+        NodeId body = parse_block();
+        ast[node].a = condition;
+        ast[node].b = body;
+
+        expect(END, "to close while");
+        return node;
+    }
+
+    NodeId Parser::parse_for() {
+        //for i = start, limit [, step] do ... end
+        NodeId node = ast.add(NodeKind::FOR, tokens.offset(advance()));
+
+        std::size_t name = pos;
+        if(!expect(IDENTIFIER, "for loop variable") || !expect(ASSIGN, "after loop variable")) {
+            finish_list(node, pending.size());
+            return node;
+        }
+        ast[node].symbol = tokens.symbol(name);
+
+        std::size_t mark = pending.size();
+
+        NodeId start = parse_expression();
+        pending.push_back(start);
+
+        if(expect(COMMA, "between loop start and limit")) {
+            NodeId limit = parse_expression();
+            pending.push_back(limit);
+
+            if(match(COMMA)) {
+                NodeId step = parse_expression();
+                pending.push_back(step);
+            }
+        }
+
+        finish_list(node, mark);
+
+        expect(DO, "before loop body");
+
+        NodeId body = parse_block();
+        ast[node].a = body;
+
+        expect(END, "to close for");
+        return node;
+    }
+
+    NodeId Parser::parse_return() {
+        NodeId node = ast.add(NodeKind::RETURN, tokens.offset(advance()));
+
+        switch(peek()) {
+            case ENDL: case SEMICOLON: case END: case ELSE: case EOS:
+                break;
+            default: {
+                NodeId value = parse_expression();
+                ast[node].a = value;
+            }
+        }
+
+        return node;
+    }
+
+    NodeId Parser::parse_declare() {
+        //int x [= value]
+        NodeId node = ast.add(NodeKind::DECLARE, tokens.offset(pos));
+        parse_type(ast[node].type);
+
+        std::size_t name = pos;
+        if(!expect(IDENTIFIER, "for variable name"))
+            return node;
+        ast[node].symbol = tokens.symbol(name);
+
+        if(match(ASSIGN)) {
+            NodeId value = parse_expression();
+            ast[node].b = value;
+        }
+
+        return node;
+    }
+
+    NodeId Parser::parse_expression(int min_precedence) {
+        NodeId left = parse_unary();
+
+        while(true) {
+            TokenType op = peek();
+            int prec = precedence(op);
+
+            if( (prec == 0) || (prec < min_precedence) )
+                return left;
+
+            std::size_t token = advance();
+            NodeId right = parse_expression(prec + 1);
+
+            NodeId node = ast.add(NodeKind::BINARY, tokens.offset(token));
+            ast[node].op = op;
+            ast[node].a = left;
+            ast[node].b = right;
+            left = node;
+        }
+    }
+
+    NodeId Parser::parse_unary() {
+        //every nested expression comes through here, as do runs of unary operators
+        Nesting nesting(depth);
+        if(depth > MAX_DEPTH)
+            return too_deep();
+
+        TokenType op = peek();
+
+        if( (op == MINUS) || (op == EXCLAIM) ) {
+            std::size_t token = advance();
+            NodeId operand = parse_unary();
+
+            NodeId node = ast.add(NodeKind::UNARY, tokens.offset(token));
+            ast[node].op = op;
+            ast[node].a = operand;
+            return node;
+        }
+
+        return parse_postfix(parse_primary());
+    }
+
+    NodeId Parser::parse_postfix(NodeId node) {
+        while(true) {
+            switch(peek()) {
+                case LPAREN: {
+                    NodeId call = ast.add(NodeKind::CALL, tokens.offset(advance()));
+                    std::size_t mark = pending.size();
+
+                    while(peek() != RPAREN) {
+                        NodeId argument = parse_expression();
+                        pending.push_back(argument);
+
+                        if(!match(COMMA))
+                            break;
+                    }
+                    expect(RPAREN, "after call arguments");
+
+                    finish_list(call, mark);
+                    ast[call].a = node;
+                    node = call;
+                    break;
+                }
+
+                case LBRACKET: {
+                    NodeId index = ast.add(NodeKind::INDEX, tokens.offset(advance()));
+                    NodeId value = parse_expression();
+                    expect(RBRACKET, "after index");
+
+                    ast[index].a = node;
+                    ast[index].b = value;
+                    node = index;
+                    break;
+                }
+
+                case DOT: {
+                    NodeId member = ast.add(NodeKind::MEMBER, tokens.offset(advance()));
+                    std::size_t name = pos;
+                    if(expect(IDENTIFIER, "after '.'"))
+                        ast[member].symbol = tokens.symbol(name);
+
+                    ast[member].a = node;
+                    node = member;
+                    break;
+                }
+
+                default:
+                    return node;
+            }
+        }
+    }
+
+    NodeId Parser::parse_primary() {
+        std::size_t token = pos;
+        uint32_t offset = tokens.offset(token);
+
+        switch(peek()) {
+            case INTEGER_LIT: {
+                advance();
+                NodeId node = ast.add(NodeKind::INT_LITERAL, offset);
+                ast[node].i_value = tokens.i_value(token);
+                return node;
+            }
+
+            case FLOAT_LIT: {
+                advance();
+                NodeId node = ast.add(NodeKind::FLOAT_LITERAL, offset);
+                ast[node].f_value = tokens.f_value(token);
+                return node;
+            }
+
+            case STRING_LIT: {
+                advance();
+                NodeId node = ast.add(NodeKind::STRING_LITERAL, offset);
+                ast[node].symbol = tokens.symbol(token);
+                return node;
+            }
+
+            case TRUE_LIT:
+            case FALSE_LIT: {
+                advance();
+                NodeId node = ast.add(NodeKind::BOOL_LITERAL, offset);
+                ast[node].i_value = (tokens.type(token) == TRUE_LIT);
+                return node;
+            }
+
+            case IDENTIFIER: {
+                advance();
+                NodeId node = ast.add(NodeKind::NAME, offset);
+                ast[node].symbol = tokens.symbol(token);
+                return node;
+            }
+
+            case LPAREN: {
+                advance();
+                NodeId inner = parse_expression();
+                expect(RPAREN, "to close '('");
+                return inner;
+            }
+
+            case LBRACKET: {
+                advance();
+                NodeId list = ast.add(NodeKind::LIST_LITERAL, offset);
+                std::size_t mark = pending.size();
+
+                while(peek() != RBRACKET) {
+                    NodeId element = parse_expression();
+                    pending.push_back(element);
+
+                    if(!match(COMMA))
+                        break;
+                }
+                expect(RBRACKET, "to close list");
+
+                finish_list(list, mark);
+                return list;
+            }
+
+            default:
+                error(token, "expected an expression");
+                return ast.add(NodeKind::ERROR, offset);
+        }
+    }
+
+}
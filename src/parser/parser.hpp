@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "ast.hpp"
+#include "lexer.hpp"
+
+namespace torq {
+
+    //recursive descent for statements, precedence climbing for expressions. Errors are
+    //collected in Ast::errors and parsing picks up again at the next line
+    class Parser {
+      public:
+        //nesting of expressions and blocks past this is an error - deeper, and the recursion
+        //here and in the passes over the tree risks running out of stack
+        static constexpr int MAX_DEPTH = 1000;
+
+      private:
+        Lexer &lexer;
+        TokenStream tokens;
+        std::size_t pos;
+
+        Ast ast;
+
+        //set by the first error in a statement, cleared once parsing resynchronises
+        bool panicking;
+
+        //current nesting, and whether it went past MAX_DEPTH - the rest of the source is then
+        //skipped without reporting anything more
+        int depth;
+        bool abandoned;
+
+        //children of list nodes still being parsed - copied into Ast::lists in one run once
+        //the node is complete, so nested lists never interleave
+        std::vector<NodeId> pending;
+
+        TokenType peek(std::size_t ahead = 0) const;
+        std::size_t advance();
+        bool match(TokenType type);
+        bool expect(TokenType type, const char *what);
+
+        void error(std::size_t token, std::string message);
+        NodeId too_deep();
+        void synchronise();
+        void skip_separators();
+
+        void finish_list(NodeId node, std::size_t mark);
+
+        NodeId parse_statement();
+        NodeId parse_any_statement();
+        NodeId parse_block();
+        NodeId parse_import();
+        NodeId parse_function();
+        NodeId parse_if(bool chained);
+        NodeId parse_while();
+        NodeId parse_for();
+        NodeId parse_return();
+        NodeId parse_declare();
+
+        NodeId parse_expression(int min_precedence = 1);
+        NodeId parse_unary();
+        NodeId parse_postfix(NodeId node);
+        NodeId parse_primary();
+
+        bool parse_type(ValueType &type);
+
+      public:
+        Parser(Lexer &lexer);
+
+        Ast parse();
+
+        std::size_t token_count() const { return tokens.size(); }
+    };
+
+}
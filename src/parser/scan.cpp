@@ -0,0 +1,213 @@
+#include "scan.hpp"
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TORQ_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace torq {
+
+    namespace {
+
+        using ScanFn = const char* (*)(const char*, const char*);
+
+        //scalar fallbacks - also used for the tails of the vector scanners
+
+        const char* name_scalar(const char *pos, const char *end) {
+            while( (pos < end) && has_class(*pos, CC_NAME) )
+                pos++;
+            return pos;
+        }
+
+        const char* line_scalar(const char *pos, const char *end) {
+            while( (pos < end) && (*pos != '\n') )
+                pos++;
+            return pos;
+        }
+
+        const char* string_scalar(const char *pos, const char *end) {
+            while( (pos < end) && (*pos != '"') && (*pos != '\\') && (*pos != '\n') )
+                pos++;
+            return pos;
+        }
+
+#ifdef TORQ_SCAN_X86
+
+        //all the characters of interest are ascii, so signed byte compares are safe - bytes
+        //over 0x7f compare as negative and fall outside every range
+
+        inline __m128i name_mask_sse2(__m128i v) {
+            __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                          _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));
+            __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+            __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                          _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+            __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+
+            return _mm_or_si128(_mm_or_si128(digit, alpha), under);
+        }
+
+        const char* name_sse2(const char *pos, const char *end) {
+            for(; end - pos >= 16; pos += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+                unsigned stop = ~_mm_movemask_epi8(name_mask_sse2(v)) & 0xffff;
+
+                if(stop != 0)
+                    return pos + __builtin_ctz(stop);
+            }
+            return name_scalar(pos, end);
+        }
+
+        const char* line_sse2(const char *pos, const char *end) {
+            const __m128i nl = _mm_set1_epi8('\n');
+
+            for(; end - pos >= 16; pos += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+                unsigned hit = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+
+                if(hit != 0)
+                    return pos + __builtin_ctz(hit);
+            }
+            return line_scalar(pos, end);
+        }
+
+        const char* string_sse2(const char *pos, const char *end) {
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i slash = _mm_set1_epi8('\\');
+            const __m128i nl = _mm_set1_epi8('\n');
+
+            for(; end - pos >= 16; pos += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+                __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)),
+                                         _mm_cmpeq_epi8(v, nl));
+                unsigned hit = _mm_movemask_epi8(m);
+
+                if(hit != 0)
+                    return pos + __builtin_ctz(hit);
+            }
+            return string_scalar(pos, end);
+        }
+
+        __attribute__((target("avx2")))
+        const char* name_avx2(const char *pos, const char *end) {
+            for(; end - pos >= 32; pos += 32) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+
+                __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                                 _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+                __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+                __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                                 _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+                __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+
+                uint32_t stop = ~static_cast<uint32_t>(_mm256_movemask_epi8(
+                    _mm256_or_si256(_mm256_or_si256(digit, alpha), under)));
+
+                if(stop != 0)
+                    return pos + __builtin_ctz(stop);
+            }
+            return name_sse2(pos, end);
+        }
+
+        __attribute__((target("avx2")))
+        const char* line_avx2(const char *pos, const char *end) {
+            const __m256i nl = _mm256_set1_epi8('\n');
+
+            for(; end - pos >= 32; pos += 32) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+                uint32_t hit = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+
+                if(hit != 0)
+                    return pos + __builtin_ctz(hit);
+            }
+            return line_sse2(pos, end);
+        }
+
+        __attribute__((target("avx2")))
+        const char* string_avx2(const char *pos, const char *end) {
+            const __m256i quote = _mm256_set1_epi8('"');
+            const __m256i slash = _mm256_set1_epi8('\\');
+            const __m256i nl = _mm256_set1_epi8('\n');
+
+            for(; end - pos >= 32; pos += 32) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+                __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, slash)),
+                                            _mm256_cmpeq_epi8(v, nl));
+                uint32_t hit = _mm256_movemask_epi8(m);
+
+                if(hit != 0)
+                    return pos + __builtin_ctz(hit);
+            }
+            return string_sse2(pos, end);
+        }
+
+#endif
+
+        struct Scanners {
+            ScanLevel level;
+            ScanFn name;
+            ScanFn line;
+            ScanFn string;
+        };
+
+        constexpr Scanners scalar_scanners = {ScanLevel::SCALAR, name_scalar, line_scalar, string_scalar};
+#ifdef TORQ_SCAN_X86
+        constexpr Scanners sse2_scanners = {ScanLevel::SSE2, name_sse2, line_sse2, string_sse2};
+        constexpr Scanners avx2_scanners = {ScanLevel::AVX2, name_avx2, line_avx2, string_avx2};
+#endif
+
+        const Scanners* scanners_for(ScanLevel level) {
+#ifdef TORQ_SCAN_X86
+            //may run from a static initialiser, before libgcc has probed the cpu
+            __builtin_cpu_init();
+
+            if( (level == ScanLevel::AVX2) && __builtin_cpu_supports("avx2") )
+                return &avx2_scanners;
+            if(level != ScanLevel::SCALAR)
+                return &sse2_scanners;
+#endif
+            return &scalar_scanners;
+        }
+
+        //constant initialised, so a lexer run from another file's static initialiser doesn't
+        //depend on initialisation order - the level is picked on first use instead. Atomic, as
+        //the loader lexes on pool threads
+        std::atomic<const Scanners*> active{nullptr};
+
+        const Scanners& scanners() {
+            const Scanners *current = active.load(std::memory_order_acquire);
+            if(current == nullptr) [[unlikely]] {
+                const Scanners *best = scanners_for(ScanLevel::AVX2);
+                //another thread may have got there first, or set a level
+                if(active.compare_exchange_strong(current, best, std::memory_order_acq_rel))
+                    current = best;
+            }
+            return *current;
+        }
+    }
+
+    ScanLevel scan_level() {
+        return scanners().level;
+    }
+
+    ScanLevel set_scan_level(ScanLevel level) {
+        const Scanners *selected = scanners_for(level);
+        active.store(selected, std::memory_order_release);
+        return selected->level;
+    }
+
+    const char* scan_name_simd(const char *pos, const char *end) {
+        return scanners().name(pos, end);
+    }
+
+    const char* scan_line(const char *pos, const char *end) {
+        return scanners().line(pos, end);
+    }
+
+    const char* scan_string(const char *pos, const char *end) {
+        return scanners().string(pos, end);
+    }
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace torq {
+
+    enum CharClass : uint8_t {
+        CC_SPACE = 1,       //' ', '\t', '\f' - newlines are tokens
+        CC_NAME_START = 2,
+        CC_NAME = 4,
+        CC_DECIMAL = 8,     //digits and '_' separators
+        CC_HEX = 16,
+        CC_BINARY = 32
+    };
+
+    constexpr std::array<uint8_t, 256> make_char_classes() {
+        std::array<uint8_t, 256> table{};
+
+        table[' '] = table['\t'] = table['\f'] = CC_SPACE;
+
+        for(int ch = 'a'; ch <= 'z'; ch++)
+            table[ch] = CC_NAME_START | CC_NAME;
+        for(int ch = 'A'; ch <= 'Z'; ch++)
+            table[ch] = CC_NAME_START | CC_NAME;
+        for(int ch = '0'; ch <= '9'; ch++)
+            table[ch] = CC_NAME | CC_DECIMAL | CC_HEX;
+        for(int ch = 'a'; ch <= 'f'; ch++)
+            table[ch] |= CC_HEX;
+        for(int ch = 'A'; ch <= 'F'; ch++)
+            table[ch] |= CC_HEX;
+
+        table['0'] |= CC_BINARY;
+        table['1'] |= CC_BINARY;
+        table['_'] = CC_NAME_START | CC_NAME | CC_DECIMAL | CC_HEX | CC_BINARY;
+
+        return table;
+    }
+
+    inline constexpr std::array<uint8_t, 256> char_classes = make_char_classes();
+
+    inline bool has_class(char ch, uint8_t cls) {
+        return (char_classes[static_cast<unsigned char>(ch)] & cls) != 0;
+    }
+
+
+    enum class ScanLevel { SCALAR, SSE2, AVX2 };
+
+    //the best level this cpu supports is picked on first use
+    ScanLevel scan_level();
+    //clamped to what the cpu supports - returns the level actually selected. Changes it for
+    //every thread, each scan after it uses the new level
+    ScanLevel set_scan_level(ScanLevel level);
+
+    //all scanners return the first position in [pos, end) that stops the run, or end
+
+    //first character that cannot be part of a name
+    const char* scan_name_simd(const char *pos, const char *end);
+    //next '\n'
+    const char* scan_line(const char *pos, const char *end);
+    //next '"', '\\' or '\n' - the characters a string body has to stop on
+    const char* scan_string(const char *pos, const char *end);
+
+    //names are usually short, so the first few characters are checked inline before
+    //paying for the call into the vector scanner
+    inline const char* scan_name(const char *pos, const char *end) {
+        for(int i = 0; i < 16; i++, pos++) {
+            if( (pos == end) || !has_class(*pos, CC_NAME) )
+                return pos;
+        }
+        return scan_name_simd(pos, end);
+    }
+
+}
@@ -0,0 +1,90 @@
+#include "source.hpp"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace torq {
+
+    Source::Source(const std::string &path) :
+        path(path), mapping(nullptr), mapped_size(0), bytes(""), length(0), ok(false) {
+
+        if(path == "-") {
+            load(STDIN_FILENO);
+            return;
+        }
+
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+            return;
+
+        load(fd);
+        ::close(fd);
+    }
+
+    Source::Source(int fd) :
+        path("<fd>"), mapping(nullptr), mapped_size(0), bytes(""), length(0), ok(false) {
+        load(fd);
+    }
+
+    Source::~Source() {
+        if(mapping != nullptr)
+            ::munmap(mapping, mapped_size);
+    }
+
+    void Source::load(int fd) {
+        struct stat info;
+        if(::fstat(fd, &info) != 0)
+            return;
+
+        //mmap needs a regular file with something in it - an empty mapping is an error
+        if(S_ISREG(info.st_mode) && info.st_size > 0) {
+            void *addr = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if(addr != MAP_FAILED) {
+                ::madvise(addr, info.st_size, MADV_SEQUENTIAL);
+
+                mapping = addr;
+                mapped_size = info.st_size;
+                bytes = static_cast<const char*>(addr);
+                length = mapped_size;
+                ok = true;
+                return;
+            }
+        }
+
+        read_all(fd);
+    }
+
+    void Source::read_all(int fd) {
+        constexpr std::size_t chunk = 64 * 1024;
+
+        while(true) {
+            std::size_t used = buffer.size();
+            buffer.resize(used + chunk);
+
+            ssize_t n = ::read(fd, buffer.data() + used, chunk);
+
+            if(n < 0) {
+                if(errno == EINTR) {
+                    buffer.resize(used);
+                    continue;
+                }
+                buffer.clear();
+                return;
+            }
+
+            buffer.resize(used + n);
+            if(n == 0)
+                break;
+        }
+
+        bytes = buffer.data();
+        length = buffer.size();
+        ok = true;
+    }
+
+}
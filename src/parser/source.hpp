@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace torq {
+
+    //read-only view of a whole source file. Regular files are memory mapped, anything that
+    //cannot be mapped (pipes, ttys, stdin) is read into an owned buffer instead
+    class Source {
+      private:
+        std::string path;
+        std::string buffer;
+
+        void *mapping;
+        std::size_t mapped_size;
+
+        const char *bytes;
+        std::size_t length;
+        bool ok;
+
+        void load(int fd);
+        void read_all(int fd);
+
+      public:
+        //"-" reads from stdin
+        Source(const std::string &path);
+        //reads from an already open descriptor, which stays owned by the caller
+        Source(int fd);
+        ~Source();
+
+        Source(const Source&) = delete;
+        Source& operator=(const Source&) = delete;
+
+        bool good() const { return ok; }
+        bool mapped() const { return mapping != nullptr; }
+
+        const char* data() const { return bytes; }
+        std::size_t size() const { return length; }
+        std::string_view view() const { return std::string_view(bytes, length); }
+        const std::string& name() const { return path; }
+    };
+
+}
@@ -0,0 +1,139 @@
+#include "symbols.hpp"
+
+#include <cstring>
+
+namespace torq {
+
+    SymbolTable::SymbolTable() : block_pos(nullptr), block_left(0), block_bytes(0), slots(256, 0) {
+    }
+
+    void SymbolTable::clear() {
+        //swapped out rather than cleared, so the capacity goes too
+        std::vector<std::unique_ptr<char[]>>().swap(blocks);
+        block_pos = nullptr;
+        block_left = 0;
+        block_bytes = 0;
+
+        std::vector<std::string_view>().swap(names);
+        std::vector<uint32_t>().swap(hashes);
+        std::vector<uint32_t>(256, 0).swap(slots);
+    }
+
+    std::size_t SymbolTable::memory() const {
+        return block_bytes + blocks.capacity() * sizeof(blocks[0]) + names.capacity() * sizeof(names[0]) +
+               (hashes.capacity() + slots.capacity()) * sizeof(uint32_t);
+    }
+
+    uint32_t SymbolTable::hash(std::string_view text) {
+        //multiply-xorshift over 8 byte words - strings are often long enough that hashing a
+        //byte at a time shows up next to the lexing itself
+        constexpr uint64_t k = 0x9e3779b97f4a7c15ull;
+
+        const char *p = text.data();
+        std::size_t n = text.size();
+        uint64_t h = n * k;
+
+        for(; n >= 8; p += 8, n -= 8) {
+            uint64_t w;
+            std::memcpy(&w, p, 8);
+            h = (h ^ w) * k;
+            h ^= h >> 29;
+        }
+
+        if(n > 0) {
+            uint64_t w = 0;
+            std::memcpy(&w, p, n);
+            h = (h ^ w) * k;
+            h ^= h >> 29;
+        }
+
+        h *= k;
+        return static_cast<uint32_t>(h >> 32);
+    }
+
+    const char* SymbolTable::store(std::string_view text) {
+        if(text.empty())
+            return "";      //before the first block there's nowhere to copy nothing to
+
+        if(text.size() > block_left) {
+            //oversized strings get a block of their own, so the current block keeps its space
+            if(text.size() > BLOCK_SIZE / 4) {
+                blocks.emplace_back(new char[text.size()]);
+                block_bytes += text.size();
+                std::memcpy(blocks.back().get(), text.data(), text.size());
+                return blocks.back().get();
+            }
+
+            blocks.emplace_back(new char[BLOCK_SIZE]);
+            block_bytes += BLOCK_SIZE;
+            block_pos = blocks.back().get();
+            block_left = BLOCK_SIZE;
+        }
+
+        char *dest = block_pos;
+        std::memcpy(dest, text.data(), text.size());
+        block_pos += text.size();
+        block_left -= text.size();
+
+        return dest;
+    }
+
+    void SymbolTable::grow() {
+        std::vector<uint32_t> bigger(slots.size() * 2, 0);
+        std::size_t mask = bigger.size() - 1;
+
+        for(uint32_t entry : slots) {
+            if(entry == 0)
+                continue;
+
+            std::size_t i = hashes[entry - 1] & mask;
+            while(bigger[i] != 0)
+                i = (i + 1) & mask;
+
+            bigger[i] = entry;
+        }
+
+        slots.swap(bigger);
+    }
+
+    bool SymbolTable::find(std::string_view text, SymbolId &id) const {
+        uint32_t h = hash(text);
+        std::size_t mask = slots.size() - 1;
+
+        for(std::size_t i = h & mask; slots[i] != 0; i = (i + 1) & mask) {
+            uint32_t candidate = slots[i] - 1;
+
+            if( (hashes[candidate] == h) && (names[candidate] == text) ) {
+                id = candidate;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    SymbolId SymbolTable::intern(std::string_view text) {
+        uint32_t h = hash(text);
+        std::size_t mask = slots.size() - 1;
+        std::size_t i = h & mask;
+
+        for(; slots[i] != 0; i = (i + 1) & mask) {
+            uint32_t candidate = slots[i] - 1;
+
+            if( (hashes[candidate] == h) && (names[candidate] == text) )
+                return candidate;
+        }
+
+        SymbolId id = names.size();
+        names.emplace_back(store(text), text.size());
+        hashes.push_back(h);
+        slots[i] = id + 1;
+
+        //keep the load factor at or under a half
+        if(names.size() * 2 > slots.size())
+            grow();
+
+        return id;
+    }
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace torq {
+
+    using SymbolId = uint32_t;
+
+    //interns strings into stable arena storage. Equal strings always get the same id, so
+    //names can be compared by id and the text is only copied the first time it is seen
+    class SymbolTable {
+      private:
+        static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+        std::vector<std::unique_ptr<char[]>> blocks;
+        char *block_pos;
+        std::size_t block_left;
+        std::size_t block_bytes;
+
+        std::vector<std::string_view> names;
+        std::vector<uint32_t> hashes;
+
+        //open addressed, power of two sized - holds id + 1, 0 marks an empty slot
+        std::vector<uint32_t> slots;
+
+        static uint32_t hash(std::string_view text);
+
+        const char* store(std::string_view text);
+        void grow();
+
+      public:
+        SymbolTable();
+
+        SymbolTable(const SymbolTable&) = delete;
+        SymbolTable& operator=(const SymbolTable&) = delete;
+
+        SymbolId intern(std::string_view text);
+
+        //returns true and sets id if the text has already been interned
+        bool find(std::string_view text, SymbolId &id) const;
+
+        std::string_view name(SymbolId id) const { return names[id]; }
+        std::size_t size() const { return names.size(); }
+
+        //forgets every string - ids handed out before no longer mean anything
+        void clear();
+
+        //bytes held for the text, the entries and the hash slots
+        std::size_t memory() const;
+    };
+
+}
@@ -0,0 +1,130 @@
+#include "stats.hpp"
+
+#include <cstdio>
+#include <ctime>
+#include <string>
+
+namespace torq {
+
+    namespace {
+
+        const char *const phase_names[] = {"total", "load", "lex", "parse", "optimize", "compile", "cache", "run"};
+
+        const char *const counter_names[] = {
+            "modules", "cached_modules", "bytes", "tokens", "nodes", "instructions", "executed"
+        };
+
+        //nested under load in the table
+        bool part_of_load(Phase phase) {
+            return (phase > Phase::LOAD) && (phase < Phase::RUN);
+        }
+
+        [[maybe_unused]] uint64_t now(clockid_t clock) {
+            timespec ts;
+            clock_gettime(clock, &ts);
+            return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+        }
+
+        std::string milliseconds(uint64_t ns) {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.3f", ns / 1e6);
+            return buffer;
+        }
+
+    }
+
+    const char* phase_name(Phase phase) {
+        return phase_names[static_cast<int>(phase)];
+    }
+
+    const char* counter_name(Counter counter) {
+        return counter_names[static_cast<int>(counter)];
+    }
+
+
+    Stats& Stats::global() {
+        static Stats stats;
+        return stats;
+    }
+
+    void Stats::reset() {
+        for(auto &t : wall)
+            t.store(0, std::memory_order_relaxed);
+        for(auto &t : cpu)
+            t.store(0, std::memory_order_relaxed);
+        for(auto &c : counters)
+            c.store(0, std::memory_order_relaxed);
+    }
+
+    void Stats::add_time(Phase phase, uint64_t wall_ns, uint64_t cpu_ns) {
+        if(!enabled())
+            return;
+        wall[static_cast<int>(phase)].fetch_add(wall_ns, std::memory_order_relaxed);
+        cpu[static_cast<int>(phase)].fetch_add(cpu_ns, std::memory_order_relaxed);
+    }
+
+    void Stats::report(std::ostream &out, bool json) const {
+        std::string text;
+
+        if(json) {
+            text += "{\"phases\": {";
+            for(int p = 0; p < static_cast<int>(Phase::COUNT); p++) {
+                Phase phase = static_cast<Phase>(p);
+                text += (p > 0) ? ", \"" : "\"";
+                text += phase_name(phase);
+                text += "\": {\"wall_ms\": " + milliseconds(wall_ns(phase)) + ", \"cpu_ms\": " + milliseconds(cpu_ns(phase)) + "}";
+            }
+            text += "}, \"counters\": {";
+            for(int c = 0; c < static_cast<int>(Counter::COUNT); c++) {
+                Counter counter = static_cast<Counter>(c);
+                text += (c > 0) ? ", \"" : "\"";
+                text += counter_name(counter);
+                text += "\": " + std::to_string(count(counter));
+            }
+            text += "}}\n";
+            out << text;
+            return;
+        }
+
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-14s %12s %12s\n", "phase", "wall ms", "cpu ms");
+        text += line;
+        for(int p = 0; p < static_cast<int>(Phase::COUNT); p++) {
+            Phase phase = static_cast<Phase>(p);
+            std::string name = part_of_load(phase) ? std::string("  ") + phase_name(phase) : phase_name(phase);
+            std::snprintf(line, sizeof(line), "%-14s %12s %12s\n", name.c_str(),
+                          milliseconds(wall_ns(phase)).c_str(), milliseconds(cpu_ns(phase)).c_str());
+            text += line;
+        }
+
+        text += "\n";
+        for(int c = 0; c < static_cast<int>(Counter::COUNT); c++) {
+            Counter counter = static_cast<Counter>(c);
+            std::snprintf(line, sizeof(line), "%-14s %12llu\n", counter_name(counter),
+                          static_cast<unsigned long long>(count(counter)));
+            text += line;
+        }
+        out << text;
+    }
+
+
+#if TORQ_STATS
+
+    PhaseTimer::PhaseTimer(Phase phase, bool process) :
+      phase(phase), process(process), active(Stats::global().enabled()), wall_start(0), cpu_start(0) {
+        if(active) {
+            wall_start = now(CLOCK_MONOTONIC);
+            cpu_start = now(process ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID);
+        }
+    }
+
+    PhaseTimer::~PhaseTimer() {
+        if(active) {
+            uint64_t cpu_end = now(process ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID);
+            Stats::global().add_time(phase, now(CLOCK_MONOTONIC) - wall_start, cpu_end - cpu_start);
+        }
+    }
+
+#endif
+
+}
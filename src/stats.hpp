@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+//the counters and timers behind --stats. They cost a relaxed load when stats are off, define
+//TORQ_NO_STATS to compile them out altogether
+#if !defined(TORQ_NO_STATS)
+    #define TORQ_STATS 1
+#else
+    #define TORQ_STATS 0
+#endif
+
+namespace torq {
+
+    enum class Phase : uint8_t { TOTAL, LOAD, LEX, PARSE, OPTIMIZE, COMPILE, CACHE, RUN, COUNT };
+
+    enum class Counter : uint8_t {
+        MODULES,
+        CACHED_MODULES,
+        BYTES,
+        TOKENS,
+        NODES,
+        INSTRUCTIONS,           //emitted by the compiler, or loaded from the cache
+        EXECUTED,               //by the interpreter, not counting native code
+        COUNT
+    };
+
+    const char* phase_name(Phase phase);
+    const char* counter_name(Counter counter);
+
+    //process wide, added to from whichever thread ran the work. Modules compile in parallel,
+    //so the CPU time of their phases can add up to more than the wall time of loading them
+    class Stats {
+      private:
+        std::atomic<bool> on{false};
+        std::atomic<uint64_t> wall[static_cast<int>(Phase::COUNT)]{};
+        std::atomic<uint64_t> cpu[static_cast<int>(Phase::COUNT)]{};
+        std::atomic<uint64_t> counters[static_cast<int>(Counter::COUNT)]{};
+
+      public:
+        static Stats& global();
+
+        void enable(bool yes = true) { on.store(yes, std::memory_order_relaxed); }
+        bool enabled() const { return TORQ_STATS && on.load(std::memory_order_relaxed); }
+        void reset();
+
+        void add(Counter counter, uint64_t n) {
+            if(enabled())
+                counters[static_cast<int>(counter)].fetch_add(n, std::memory_order_relaxed);
+        }
+        void add_time(Phase phase, uint64_t wall_ns, uint64_t cpu_ns);
+
+        uint64_t count(Counter counter) const { return counters[static_cast<int>(counter)].load(std::memory_order_relaxed); }
+        uint64_t wall_ns(Phase phase) const { return wall[static_cast<int>(phase)].load(std::memory_order_relaxed); }
+        uint64_t cpu_ns(Phase phase) const { return cpu[static_cast<int>(phase)].load(std::memory_order_relaxed); }
+
+        //a table, or one JSON object
+        void report(std::ostream &out, bool json) const;
+    };
+
+    //wall and CPU time of a scope, added to a phase when it closes. CPU time is the calling
+    //thread's, or the whole process's for phases that wait on other threads
+    class PhaseTimer {
+      private:
+        Phase phase;
+        bool process;
+        bool active;
+        uint64_t wall_start;
+        uint64_t cpu_start;
+
+      public:
+    #if TORQ_STATS
+        explicit PhaseTimer(Phase phase, bool process = false);
+        ~PhaseTimer();
+    #else
+        explicit PhaseTimer(Phase, bool = false) {}
+    #endif
+
+        PhaseTimer(const PhaseTimer&) = delete;
+        PhaseTimer& operator=(const PhaseTimer&) = delete;
+    };
+
+}
@@ -0,0 +1,362 @@
+#include "vm.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace torq {
+
+    namespace {
+
+        constexpr std::size_t FLUSH_SIZE = 64 * 1024;
+
+        std::string argument_error(const char *name, int expected, int count) {
+            return std::string(name) + "() takes " + std::to_string(expected) + " argument" +
+                (expected == 1 ? "" : "s") + ", got " + std::to_string(count);
+        }
+
+        //one printf style conversion. spec holds everything from the '%' up to and including
+        //the conversion character
+        bool format_one(VM &vm, std::string &out, std::string &spec, char conversion, const Value &value) {
+            char buffer[128];
+            int written;
+
+            switch(conversion) {
+                case 'd': case 'i': case 'x': case 'X': case 'o': case 'c': {
+                    if(!value.is_int() && !value.is_bool())
+                        return vm.fail(std::string("%") + conversion + " expects an int, got " + value_kind_name(value.kind()));
+                    long long i = value.is_int() ? value.as_int() : value.as_bool();
+                    if(conversion != 'c')
+                        spec.insert(spec.size() - 1, "ll");
+                    written = std::snprintf(buffer, sizeof(buffer), spec.c_str(), i);
+                    break;
+                }
+
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+                    if(!value.is_number())
+                        return vm.fail(std::string("%") + conversion + " expects a number, got " + value_kind_name(value.kind()));
+                    written = std::snprintf(buffer, sizeof(buffer), spec.c_str(), value.as_number());
+                    break;
+                }
+
+                case 's': {
+                    std::string text;
+                    append_value(text, value);
+                    if(spec.size() == 2) {
+                        out += text;
+                        return true;
+                    }
+                    int length = std::snprintf(nullptr, 0, spec.c_str(), text.c_str());
+                    std::size_t at = out.size();
+                    out.resize(at + length + 1);
+                    std::snprintf(out.data() + at, length + 1, spec.c_str(), text.c_str());
+                    out.resize(at + length);
+                    return true;
+                }
+
+                default:
+                    return vm.fail(std::string("unknown format conversion '%") + conversion + "'");
+            }
+
+            if(written < 0)
+                return vm.fail("invalid format '" + spec + "'");
+            if(static_cast<std::size_t>(written) >= sizeof(buffer))
+                return vm.fail("format '" + spec + "' produces too much output");
+            out.append(buffer, written);
+            return true;
+        }
+
+        //the printf spec a step was parsed from, for the conversions left to snprintf
+        std::string spec_of(const FormatStep &step) {
+            std::string spec = "%";
+            for(int flag = 0; flag < 5; flag++) {
+                if(step.flags & (1 << flag))
+                    spec += "-+ #0"[flag];
+            }
+            if(step.width > 0)
+                spec += std::to_string(step.width);
+            if(step.precision >= 0)
+                spec += "." + std::to_string(step.precision);
+            spec += step.conversion;
+            return spec;
+        }
+
+        //prefix (a sign) and body padded out to the step's width
+        void pad(std::string &out, const FormatStep &step, std::string_view prefix, std::string_view body, bool zeros) {
+            std::size_t size = prefix.size() + body.size();
+            std::size_t fill = (step.width > size) ? step.width - size : 0;
+
+            if(step.flags & FORMAT_LEFT) {
+                out += prefix;
+                out += body;
+                out.append(fill, ' ');
+            } else if( zeros && (step.flags & FORMAT_ZERO) ) {
+                out += prefix;
+                out.append(fill, '0');
+                out += body;
+            } else {
+                out.append(fill, ' ');
+                out += prefix;
+                out += body;
+            }
+        }
+
+        std::string_view sign_of(const FormatStep &step, bool negative) {
+            if(negative)
+                return "-";
+            if(step.flags & FORMAT_PLUS)
+                return "+";
+            if(step.flags & FORMAT_SPACE)
+                return " ";
+            return "";
+        }
+
+        //the common conversions go straight to to_chars, the rest and every type error
+        //through format_one()
+        bool convert(VM &vm, std::string &out, const FormatStep &step, const Value &value) {
+            char buffer[512];
+            std::to_chars_result result;
+
+            switch(step.conversion) {
+                case 'd': case 'i': {
+                    if( (!value.is_int() && !value.is_bool()) || (step.precision >= 0) )
+                        break;
+                    int64_t i = value.is_int() ? value.as_int() : value.as_bool();
+                    uint64_t magnitude = (i < 0) ? 0 - static_cast<uint64_t>(i) : i;
+                    result = std::to_chars(buffer, buffer + sizeof(buffer), magnitude);
+                    pad(out, step, sign_of(step, i < 0), std::string_view(buffer, result.ptr), true);
+                    return true;
+                }
+
+                case 'x': case 'X': case 'o': {
+                    if( (!value.is_int() && !value.is_bool()) || (step.precision >= 0) || (step.flags & FORMAT_ALT) )
+                        break;
+                    uint64_t u = value.is_int() ? value.as_int() : value.as_bool();
+                    result = std::to_chars(buffer, buffer + sizeof(buffer), u, (step.conversion == 'o') ? 8 : 16);
+                    if(step.conversion == 'X')
+                        std::transform(buffer, result.ptr, buffer, [](char c) { return std::toupper(c); });
+                    pad(out, step, "", std::string_view(buffer, result.ptr), true);
+                    return true;
+                }
+
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+                    if(!value.is_number() || (step.flags & FORMAT_ALT))
+                        break;
+                    double x = value.as_number();
+                    char lower = std::tolower(step.conversion);
+                    std::chars_format style = (lower == 'f') ? std::chars_format::fixed :
+                        (lower == 'e') ? std::chars_format::scientific : std::chars_format::general;
+
+                    result = std::to_chars(buffer, buffer + sizeof(buffer), std::fabs(x), style,
+                                           (step.precision >= 0) ? step.precision : 6);
+                    if(result.ec != std::errc())
+                        break;
+                    if(std::isupper(step.conversion))
+                        std::transform(buffer, result.ptr, buffer, [](char c) { return std::toupper(c); });
+                    pad(out, step, sign_of(step, std::signbit(x)), std::string_view(buffer, result.ptr), std::isfinite(x));
+                    return true;
+                }
+
+                //written in place, then cut to the precision and padded
+                case 's': {
+                    if(step.flags & FORMAT_ZERO)
+                        break;
+                    std::size_t at = out.size();
+                    append_value(out, value);
+                    if( (step.precision >= 0) && (out.size() - at > static_cast<std::size_t>(step.precision)) )
+                        out.resize(at + step.precision);
+
+                    std::size_t size = out.size() - at;
+                    if(step.width > size) {
+                        if(step.flags & FORMAT_LEFT)
+                            out.append(step.width - size, ' ');
+                        else
+                            out.insert(at, step.width - size, ' ');
+                    }
+                    return true;
+                }
+            }
+
+            std::string spec = spec_of(step);
+            return format_one(vm, out, spec, step.conversion, value);
+        }
+
+        bool format(VM &vm, std::string &out, std::string_view text, std::span<const FormatStep> steps,
+                    const Value *args, int count) {
+            int next = 0;
+
+            for(const FormatStep &step : steps) {
+                out.append(text.data() + step.literal, step.length);
+
+                if(step.conversion == 0) {
+                    if(step.flags & FORMAT_INCOMPLETE)
+                        return vm.fail("format string ends in the middle of a conversion");
+                    continue;
+                }
+
+                if(next >= count)
+                    return vm.fail("not enough arguments for format string");
+                if(!convert(vm, out, step, args[next++]))
+                    return false;
+            }
+
+            if(next < count)
+                return vm.fail("too many arguments for format string");
+            return true;
+        }
+
+
+        //print(format, ...) formats printf style when the first argument is a string with a
+        //conversion in it, otherwise the values are written separated by spaces
+        bool native_print(VM &vm, Value *args, int count, Value &result) {
+            std::string &out = vm.out();
+
+            const Str *text = ( (count > 0) && args[0].is_string() ) ? args[0].as_string() : nullptr;
+
+            //literal formats come parsed by the compiler, any other is parsed here
+            if(text && text->format) {
+                if(!format(vm, out, text->view(), std::span(text->format, text->format_size), args + 1, count - 1))
+                    return false;
+            } else if( text && (text->view().find('%') != std::string_view::npos) ) {
+                std::vector<FormatStep> steps;
+                plan_format(text->view(), steps);
+                if(!format(vm, out, text->view(), steps, args + 1, count - 1))
+                    return false;
+            } else {
+                for(int i = 0; i < count; i++) {
+                    if(i > 0)
+                        out += ' ';
+                    append_value(out, args[i]);
+                }
+            }
+
+            if(out.size() >= FLUSH_SIZE)
+                vm.flush();
+
+            result = Value();
+            return true;
+        }
+
+        bool native_len(VM &vm, Value *args, int count, Value &result) {
+            if(count != 1)
+                return vm.fail(argument_error("len", 1, count));
+
+            if(args[0].is_string())
+                result = vm.integer(args[0].as_string()->length);
+            else if(args[0].is_list())
+                result = vm.integer(args[0].as_list()->items.size());
+            else
+                return vm.fail(std::string("len() of a ") + value_kind_name(args[0].kind()));
+            return true;
+        }
+
+        bool native_str(VM &vm, Value *args, int count, Value &result) {
+            if(count != 1)
+                return vm.fail(argument_error("str", 1, count));
+
+            if(args[0].is_string()) {
+                result = args[0];
+                return true;
+            }
+            result = Value::string(vm.new_string(to_string(args[0])));
+            return true;
+        }
+
+        bool native_int(VM &vm, Value *args, int count, Value &result) {
+            if(count != 1)
+                return vm.fail(argument_error("to_int", 1, count));
+
+            const Value &value = args[0];
+            switch(value.kind()) {
+                case ValueKind::INT:
+                    result = value;
+                    return true;
+
+                case ValueKind::BOOL:
+                    result = vm.integer(value.as_bool());
+                    return true;
+
+                case ValueKind::FLOAT: {
+                    double f = std::trunc(value.as_float());
+                    if( !(f >= -9223372036854775808.0 && f < 9223372036854775808.0) )
+                        return vm.fail("float out of range for to_int()");
+                    result = vm.integer(static_cast<int64_t>(f));
+                    return true;
+                }
+
+                case ValueKind::STRING: {
+                    std::string_view text = value.as_string()->view();
+                    int64_t i;
+                    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), i);
+                    if( (ec != std::errc()) || (end != text.data() + text.size()) )
+                        return vm.fail("invalid int '" + std::string(text) + "'");
+                    result = vm.integer(i);
+                    return true;
+                }
+
+                default:
+                    return vm.fail(std::string("cannot convert a ") + value_kind_name(value.kind()) + " to int");
+            }
+        }
+
+        bool native_float(VM &vm, Value *args, int count, Value &result) {
+            if(count != 1)
+                return vm.fail(argument_error("to_float", 1, count));
+
+            const Value &value = args[0];
+            if(value.is_number()) {
+                result = Value::number(value.as_number());
+                return true;
+            }
+
+            if(value.is_string()) {
+                std::string_view text = value.as_string()->view();
+                double f;
+                auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), f);
+                if( (ec != std::errc()) || (end != text.data() + text.size()) )
+                    return vm.fail("invalid float '" + std::string(text) + "'");
+                result = Value::number(f);
+                return true;
+            }
+
+            return vm.fail(std::string("cannot convert a ") + value_kind_name(value.kind()) + " to float");
+        }
+
+        bool native_append(VM &vm, Value *args, int count, Value &result) {
+            if(count != 2)
+                return vm.fail(argument_error("append", 2, count));
+            if(!args[0].is_list())
+                return vm.fail(std::string("append() to a ") + value_kind_name(args[0].kind()));
+
+            args[0].as_list()->items.push_back(args[1]);
+            result = args[0];
+            return true;
+        }
+
+        const Native natives[] = {
+            {"print", native_print},
+            {"len", native_len},
+            {"str", native_str},
+            {"to_int", native_int},
+            {"to_float", native_float},
+            {"append", native_append}
+        };
+
+    }
+
+    void register_builtins(VM &vm) {
+        Module *std_module = vm.new_module("std");
+        vm.define_module("std", Value::module(std_module));
+
+        for(const Native &native : natives) {
+            vm.define(native.name, Value::native(&native));
+            std_module->members[native.name] = Value::native(&native);
+        }
+    }
+
+}
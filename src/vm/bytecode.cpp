@@ -0,0 +1,418 @@
+#include "bytecode.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+
+#include <sys/mman.h>
+
+namespace torq {
+
+    namespace {
+
+        const char *const op_names[] = {
+            #define TORQ_OPCODE_NAME(name, format) #name,
+            #define TORQ_PAIR_NAME(name, first, second) #name,
+            #define TORQ_TRIPLE_NAME(name, first, second, third) #name,
+            TORQ_OPCODES(TORQ_OPCODE_NAME)
+            TORQ_SUPERINSTRUCTIONS(TORQ_PAIR_NAME, TORQ_TRIPLE_NAME)
+            #undef TORQ_OPCODE_NAME
+            #undef TORQ_PAIR_NAME
+            #undef TORQ_TRIPLE_NAME
+        };
+
+        const OpFormat op_formats[] = {
+            #define TORQ_OPCODE_FORMAT(name, format) OpFormat::format,
+            TORQ_OPCODES(TORQ_OPCODE_FORMAT)
+            #undef TORQ_OPCODE_FORMAT
+        };
+
+        const std::array<Superinstruction, static_cast<std::size_t>(Op::COUNT) - BASE_OPS> superinstruction_table = {{
+            #define TORQ_PAIR_ENTRY(name, first, second) {Op::name, 2, {Op::first, Op::second, Op::COUNT}},
+            #define TORQ_TRIPLE_ENTRY(name, first, second, third) {Op::name, 3, {Op::first, Op::second, Op::third}},
+            TORQ_SUPERINSTRUCTIONS(TORQ_PAIR_ENTRY, TORQ_TRIPLE_ENTRY)
+            #undef TORQ_PAIR_ENTRY
+            #undef TORQ_TRIPLE_ENTRY
+        }};
+
+        void append_quoted(std::string &out, std::string_view text) {
+            out += '"';
+            for(char c : text) {
+                switch(c) {
+                    case '\n': out += "\\n"; break;
+                    case '\t': out += "\\t"; break;
+                    case '"': out += "\\\""; break;
+                    case '\\': out += "\\\\"; break;
+                    default: out += c;
+                }
+            }
+            out += '"';
+        }
+
+    }
+
+    const char* op_name(Op op) {
+        return (op < Op::COUNT) ? op_names[static_cast<int>(op)] : "?";
+    }
+
+    OpFormat op_format(Op op) {
+        return op_formats[static_cast<int>(first_part(op))];
+    }
+
+    std::span<const Superinstruction> superinstructions() {
+        return superinstruction_table;
+    }
+
+    const Superinstruction* superinstruction(Op op) {
+        return is_superinstruction(op) ? &superinstruction_table[static_cast<std::size_t>(op) - BASE_OPS] : nullptr;
+    }
+
+    Op first_part(Op op) {
+        return is_superinstruction(op) ? superinstruction_table[static_cast<std::size_t>(op) - BASE_OPS].parts[0] : op;
+    }
+
+
+    void plan_format(std::string_view format, std::vector<FormatStep> &steps) {
+        std::size_t literal = 0;
+
+        for(std::size_t i = 0; i < format.size(); i++) {
+            if(format[i] != '%')
+                continue;
+
+            FormatStep step{static_cast<uint32_t>(literal), static_cast<uint32_t>(i - literal), 0, 0, 0, -1};
+
+            if( (i + 1 < format.size()) && (format[i + 1] == '%') ) {
+                step.length++;
+                steps.push_back(step);
+                literal = ++i + 1;
+                continue;
+            }
+
+            //%[flags][width][.precision]conversion
+            for(i++; i < format.size(); i++) {
+                std::size_t flag = std::string_view("-+ #0").find(format[i]);
+                if(flag == std::string_view::npos)
+                    break;
+                step.flags |= 1 << flag;
+            }
+
+            unsigned width = 0;
+            for(; (i < format.size()) && (format[i] >= '0') && (format[i] <= '9'); i++)
+                width = std::min(width * 10 + (format[i] - '0'), 0xFFFFu);
+            step.width = width;
+
+            if( (i < format.size()) && (format[i] == '.') ) {
+                int precision = 0;
+                for(i++; (i < format.size()) && (format[i] >= '0') && (format[i] <= '9'); i++)
+                    precision = std::min(precision * 10 + (format[i] - '0'), 0xFFFF);
+                step.precision = precision;
+            }
+
+            if(i >= format.size()) {
+                step.flags |= FORMAT_INCOMPLETE;
+                steps.push_back(step);
+                return;
+            }
+
+            step.conversion = format[i];
+            steps.push_back(step);
+            literal = i + 1;
+        }
+
+        if(literal < format.size())
+            steps.push_back({static_cast<uint32_t>(literal), static_cast<uint32_t>(format.size() - literal), 0, 0, 0, -1});
+    }
+
+
+    const FunctionProto& Function::proto() const {
+        return program->functions[index];
+    }
+
+    const Instr* Function::code() const {
+        return program->code.data() + proto().code_start;
+    }
+
+    std::string_view Function::name() const {
+        return program->string(proto().name);
+    }
+
+
+    Program::~Program() {
+        if(mapping)
+            ::munmap(mapping, mapping_size);
+    }
+
+    uint32_t Program::add_string(std::string_view text) {
+        storage.string_refs.push_back({static_cast<uint32_t>(storage.string_data.size()), static_cast<uint32_t>(text.size())});
+        storage.string_data += text;
+        return storage.string_refs.size() - 1;
+    }
+
+    void Program::add_format(uint32_t string) {
+        std::string_view text = std::string_view(storage.string_data).substr(storage.string_refs[string].offset,
+                                                                           storage.string_refs[string].length);
+        if(text.find('%') == std::string_view::npos)
+            return;
+
+        uint32_t first = storage.format_steps.size();
+        plan_format(text, storage.format_steps);
+        storage.formats.push_back({string, first, static_cast<uint32_t>(storage.format_steps.size() - first)});
+    }
+
+    void Program::adopt_mapping(void *data, std::size_t size) {
+        if(mapping)
+            ::munmap(mapping, mapping_size);
+        mapping = data;
+        mapping_size = size;
+    }
+
+    void Program::set_source(std::string_view text) {
+        source = text;
+        lines.clear();
+    }
+
+    void Program::index_lines() const {
+        if(lines.empty())
+            lines.build(source.data(), source.size());
+    }
+
+    Location Program::locate(uint32_t offset) const {
+        index_lines();
+        return lines.locate(offset);
+    }
+
+    void Program::link() {
+        //a compiled program - a loaded one already has its views pointing into the mapping
+        if(!mapping) {
+            code = storage.code;
+            offsets = storage.offsets;
+            constants = storage.constants;
+            string_data = storage.string_data;
+            string_refs = storage.string_refs;
+            functions = storage.functions;
+            formats = storage.formats;
+            format_steps = storage.format_steps;
+        }
+
+        strings.assign(string_refs.size(), Str{});
+        for(std::size_t i = 0; i < string_refs.size(); i++) {
+            Str &s = strings[i];
+            s.kind = ObjectKind::STRING;
+            s.marked = true;        //never collected
+            s.next = nullptr;
+            s.length = string_refs[i].length;
+            s.chars = string_data.data() + string_refs[i].offset;
+        }
+
+        for(const FormatPlan &plan : formats) {
+            strings[plan.string].format = format_steps.data() + plan.first;
+            strings[plan.string].format_size = plan.count;
+        }
+
+        function_objects.clear();
+        for(std::size_t i = 0; i < functions.size(); i++)
+            function_objects.push_back(Function{this, static_cast<uint32_t>(i)});
+    }
+
+
+    bool verify(const Program &program) {
+        if( program.functions.empty() || (program.offsets.size() != program.code.size()) )
+            return false;
+
+        for(const StringRef &ref : program.string_refs) {
+            if(static_cast<uint64_t>(ref.offset) + ref.length > program.string_data.size())
+                return false;
+        }
+
+        //format steps are slices of their string
+        for(const FormatPlan &plan : program.formats) {
+            if( (plan.string >= program.string_refs.size()) ||
+                (static_cast<uint64_t>(plan.first) + plan.count > program.format_steps.size()) )
+                return false;
+
+            for(const FormatStep &step : program.format_steps.subspan(plan.first, plan.count)) {
+                if(static_cast<uint64_t>(step.literal) + step.length > program.string_refs[plan.string].length)
+                    return false;
+            }
+        }
+
+        //boxed ints would be pointers into nowhere
+        for(const Value &constant : program.constants) {
+            if(!constant.is_float() && !constant.is_small_int())
+                return false;
+        }
+
+        const std::size_t strings = program.string_refs.size();
+        const std::size_t constants = program.constants.size();
+        const std::size_t functions = program.functions.size();
+
+        for(const FunctionProto &proto : program.functions) {
+            if( (proto.name >= strings) || (proto.params > proto.registers) || (proto.code_size == 0) ||
+                (static_cast<uint64_t>(proto.code_start) + proto.code_size > program.code.size()) )
+                return false;
+
+            const unsigned registers = proto.registers;
+            const Instr *code = program.code.data() + proto.code_start;
+
+            //falling off the end would run into the next function
+            if(op_of(code[proto.code_size - 1]) != Op::RETURN)
+                return false;
+
+            for(uint32_t pc = 0; pc < proto.code_size; pc++) {
+                Instr instr = code[pc];
+                Op op = op_of(instr);
+                unsigned a = arg_a(instr), b = arg_b(instr), c = arg_c(instr), bx = arg_bx(instr);
+                long target = static_cast<long>(pc) + 1 + arg_sbx(instr);
+                bool ok;
+
+                //the parts after the first are ordinary instructions, checked in turn, but the
+                //interpreter runs them as the parts they should be
+                if(const Superinstruction *super = superinstruction(op)) {
+                    if(pc + super->length > proto.code_size)
+                        return false;
+                    for(unsigned k = 1; k < super->length; k++) {
+                        if(op_of(code[pc + k]) != super->parts[k])
+                            return false;
+                    }
+                    op = super->parts[0];
+                }
+
+                switch(op) {
+                    case Op::LOADNIL: case Op::LOADBOOL: case Op::LOADINT:
+                    case Op::GUARD_I64: case Op::GUARD_F64: case Op::GUARD_STR:
+                        ok = a < registers;
+                        break;
+                    case Op::LOADK:
+                        ok = (a < registers) && (bx < constants);
+                        break;
+                    case Op::LOADI64:
+                        ok = (a < registers) && (bx + 1 < constants) &&
+                            program.constants[bx].is_int() && program.constants[bx + 1].is_int();
+                        break;
+                    case Op::LOADSTR: case Op::GETGLOBAL: case Op::SETGLOBAL: case Op::IMPORT:
+                        ok = (a < registers) && (bx < strings);
+                        break;
+                    case Op::LOADFN:
+                        ok = (a < registers) && (bx < functions);
+                        break;
+                    case Op::MOVE: case Op::NEG: case Op::NOT:
+                    case Op::NEG_I64: case Op::NEG_F64: case Op::TOF64:
+                        ok = (a < registers) && (b < registers);
+                        break;
+                    case Op::NEWLIST:
+                        ok = (a < registers) && (b + c <= registers);
+                        break;
+                    case Op::JMP:
+                        ok = (target >= 0) && (target < proto.code_size);
+                        break;
+                    case Op::JMPIF: case Op::JMPIFNOT:
+                        ok = (a < registers) && (target >= 0) && (target < proto.code_size);
+                        break;
+                    case Op::FORPREP: case Op::FORLOOP:
+                    case Op::FORPREP_I64: case Op::FORLOOP_I64:
+                        ok = (a + 3 < registers) && (target >= 0) && (target < proto.code_size);
+                        break;
+                    case Op::CALL:
+                        ok = a + b < registers;
+                        break;
+                    case Op::RETURN:
+                        ok = (b == 0) || (a < registers);
+                        break;
+                    case Op::COUNT:
+                        ok = false;
+                        break;
+                    default:
+                        //three register operands
+                        ok = (op < Op::COUNT) && (a < registers) && (b < registers) && (c < registers);
+                        break;
+                }
+
+                if(!ok)
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    void disassemble(const Program &program, std::ostream &out) {
+        std::string line;
+        char buffer[64];
+
+        for(std::size_t f = 0; f < program.functions.size(); f++) {
+            const FunctionProto &proto = program.functions[f];
+
+            line.clear();
+            line += "fn ";
+            line += program.string(proto.name);
+            std::snprintf(buffer, sizeof(buffer), " (%d params, %d registers, %u instructions)\n",
+                proto.params, proto.registers, proto.code_size);
+            line += buffer;
+            out << line;
+
+            for(uint32_t pc = proto.code_start; pc < proto.code_start + proto.code_size; pc++) {
+                Instr instr = program.code[pc];
+                Op op = op_of(instr);
+                Location loc = program.location(pc);
+                int target = static_cast<int>(pc - proto.code_start) + 1 + arg_sbx(instr);
+
+                std::snprintf(buffer, sizeof(buffer), "  %04u  %4d:%-3d  %-10s", pc - proto.code_start, loc.line, loc.column, op_name(op));
+                line.assign(buffer);
+                if(line.back() != ' ')
+                    line += ' ';        //names longer than the column, superinstructions mostly
+
+                switch(op_format(op)) {
+                    case OpFormat::A:
+                        std::snprintf(buffer, sizeof(buffer), "%u", arg_a(instr));
+                        break;
+                    case OpFormat::AB:
+                        std::snprintf(buffer, sizeof(buffer), "%u %u", arg_a(instr), arg_b(instr));
+                        break;
+                    case OpFormat::ABC:
+                        std::snprintf(buffer, sizeof(buffer), "%u %u %u", arg_a(instr), arg_b(instr), arg_c(instr));
+                        break;
+                    case OpFormat::AK:
+                    case OpFormat::AS:
+                    case OpFormat::AF:
+                        std::snprintf(buffer, sizeof(buffer), "%u %u", arg_a(instr), arg_bx(instr));
+                        break;
+                    case OpFormat::AI:
+                        std::snprintf(buffer, sizeof(buffer), "%u %d", arg_a(instr), arg_sbx(instr));
+                        break;
+                    case OpFormat::AJ:
+                        std::snprintf(buffer, sizeof(buffer), "%u -> %04d", arg_a(instr), target);
+                        break;
+                    case OpFormat::J:
+                        std::snprintf(buffer, sizeof(buffer), "-> %04d", target);
+                        break;
+                }
+                line += buffer;
+
+                //show what constant and string operands refer to
+                if(op == Op::LOADI64) {
+                    line.resize(std::max<std::size_t>(line.size(), 40), ' ');
+                    line += "; ";
+                    line += std::to_string(wide_constant(program.constants.data(), arg_bx(instr)));
+                } else if(op_format(op) == OpFormat::AK) {
+                    line.resize(std::max<std::size_t>(line.size(), 40), ' ');
+                    line += "; ";
+                    append_value(line, program.constants[arg_bx(instr)]);
+                } else if(op_format(op) == OpFormat::AS) {
+                    line.resize(std::max<std::size_t>(line.size(), 40), ' ');
+                    line += "; ";
+                    append_quoted(line, program.string(arg_bx(instr)));
+                } else if(op_format(op) == OpFormat::AF) {
+                    line.resize(std::max<std::size_t>(line.size(), 40), ' ');
+                    line += "; fn ";
+                    line += program.string(program.functions[arg_bx(instr)].name);
+                }
+
+                line += '\n';
+                out << line;
+            }
+            out << '\n';
+        }
+    }
+
+}
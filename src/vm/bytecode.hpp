@@ -0,0 +1,345 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "value.hpp"
+#include "../parser/location.hpp"
+
+//superinstructions run a sequence of two or three instructions on one dispatch. Which
+//sequences get one is decided at build time from how often each ran over bench/programs, see
+//tools/superinstructions.cpp - the generated header lists them as PAIR(name, first, second)
+//and TRIPLE(name, first, second, third). Define TORQ_NO_SUPERINSTRUCTIONS to build without
+#if !defined(TORQ_NO_SUPERINSTRUCTIONS)
+    #include "superinstructions.hpp"
+#else
+    #define TORQ_SUPERINSTRUCTIONS(PAIR, TRIPLE)
+    #define TORQ_SUPERINSTRUCTIONS_ID 0
+#endif
+
+namespace torq {
+
+    //operand layouts, used by the disassembler
+    enum class OpFormat : uint8_t {
+        A,          //A
+        AB,         //A B
+        ABC,        //A B C
+        AK,         //A Bx - numeric constant
+        AS,         //A Bx - string table entry
+        AF,         //A Bx - function prototype
+        AI,         //A sBx - immediate integer
+        AJ,         //A sBx - jump offset
+        J           //sBx - jump offset
+    };
+
+    //name, operand layout. R[] are registers of the current frame, K[] numeric constants,
+    //S[] the string table, G[] globals. Jumps are relative to the following instruction
+    #define TORQ_OPCODES(X) \
+        X(MOVE, AB)         /* R[A] = R[B] */ \
+        X(LOADNIL, A)       /* R[A] = nil */ \
+        X(LOADBOOL, AB)     /* R[A] = B != 0 */ \
+        X(LOADINT, AI)      /* R[A] = sBx */ \
+        X(LOADK, AK)        /* R[A] = K[Bx] */ \
+        X(LOADI64, AK)      /* R[A] = K[Bx] << 32 | K[Bx+1], ints too wide for a Value */ \
+        X(LOADSTR, AS)      /* R[A] = S[Bx] */ \
+        X(LOADFN, AF)       /* R[A] = function Bx */ \
+        X(GETGLOBAL, AS)    /* R[A] = G[S[Bx]] */ \
+        X(SETGLOBAL, AS)    /* G[S[Bx]] = R[A] */ \
+        X(IMPORT, AS)       /* R[A] = module named S[Bx] */ \
+        X(NEWLIST, ABC)     /* R[A] = [R[B] .. R[B+C-1]] */ \
+        X(GETINDEX, ABC)    /* R[A] = R[B][R[C]] */ \
+        X(SETINDEX, ABC)    /* R[A][R[B]] = R[C] */ \
+        X(ADD, ABC)         /* R[A] = R[B] + R[C] */ \
+        X(SUB, ABC)         /* R[A] = R[B] - R[C] */ \
+        X(MUL, ABC)         /* R[A] = R[B] * R[C] */ \
+        X(DIV, ABC)         /* R[A] = R[B] / R[C] */ \
+        X(MOD, ABC)         /* R[A] = R[B] % R[C] */ \
+        X(NEG, AB)          /* R[A] = -R[B] */ \
+        X(NOT, AB)          /* R[A] = !R[B] */ \
+        X(EQ, ABC)          /* R[A] = R[B] == R[C] */ \
+        X(NE, ABC)          /* R[A] = R[B] != R[C] */ \
+        X(LT, ABC)          /* R[A] = R[B] < R[C] */ \
+        X(LE, ABC)          /* R[A] = R[B] <= R[C] */ \
+        X(JMP, J)           /* pc += sBx */ \
+        X(JMPIF, AJ)        /* if R[A] then pc += sBx */ \
+        X(JMPIFNOT, AJ)     /* if !R[A] then pc += sBx */ \
+        X(FORPREP, AJ)      /* if R[A] within R[A+1] then R[A+3] = R[A] else pc += sBx */ \
+        X(FORLOOP, AJ)      /* R[A] += R[A+2], if R[A] within R[A+1] then R[A+3] = R[A], pc += sBx */ \
+        X(CALL, AB)         /* R[A] = R[A](R[A+1] .. R[A+B]) */ \
+        X(RETURN, AB)       /* return B ? R[A] : nil */ \
+        \
+        /* the compiler has proved the operand types - no tag checks */ \
+        X(ADD_I64, ABC)     /* R[A] = R[B] + R[C], ints */ \
+        X(SUB_I64, ABC) \
+        X(MUL_I64, ABC) \
+        X(DIV_I64, ABC) \
+        X(MOD_I64, ABC) \
+        X(ADD_F64, ABC)     /* R[A] = R[B] + R[C], floats */ \
+        X(SUB_F64, ABC) \
+        X(MUL_F64, ABC) \
+        X(DIV_F64, ABC) \
+        X(MOD_F64, ABC) \
+        X(NEG_I64, AB) \
+        X(NEG_F64, AB) \
+        X(EQ_I64, ABC) \
+        X(NE_I64, ABC) \
+        X(LT_I64, ABC) \
+        X(LE_I64, ABC) \
+        X(EQ_F64, ABC) \
+        X(NE_F64, ABC) \
+        X(LT_F64, ABC) \
+        X(LE_F64, ABC) \
+        X(TOF64, AB)        /* R[A] = float(R[B]), R[B] an int */ \
+        X(FORPREP_I64, AJ)  /* FORPREP with int start, limit and step */ \
+        X(FORLOOP_I64, AJ) \
+        \
+        /* where untyped values meet typed registers */ \
+        X(GUARD_I64, A)     /* error unless R[A] is an int */ \
+        X(GUARD_F64, A)     /* ints become floats, error unless R[A] is a number */ \
+        X(GUARD_STR, A)     /* error unless R[A] is a string */
+
+    enum class Op : uint8_t {
+        #define TORQ_OPCODE_ENUM(name, format) name,
+        TORQ_OPCODES(TORQ_OPCODE_ENUM)
+        #undef TORQ_OPCODE_ENUM
+
+        #define TORQ_PAIR_ENUM(name, first, second) name,
+        #define TORQ_TRIPLE_ENUM(name, first, second, third) name,
+        TORQ_SUPERINSTRUCTIONS(TORQ_PAIR_ENUM, TORQ_TRIPLE_ENUM)
+        #undef TORQ_PAIR_ENUM
+        #undef TORQ_TRIPLE_ENUM
+        COUNT
+    };
+
+    //ops the compiler emits itself, superinstructions are numbered after them
+    #define TORQ_OPCODE_ONE(name, format) + 1
+    constexpr std::size_t BASE_OPS = 0 TORQ_OPCODES(TORQ_OPCODE_ONE);
+    #undef TORQ_OPCODE_ONE
+
+    const char* op_name(Op op);
+    OpFormat op_format(Op op);       //a superinstruction's is its first part's
+
+    constexpr bool is_superinstruction(Op op) {
+        return (static_cast<std::size_t>(op) >= BASE_OPS) && (op < Op::COUNT);
+    }
+
+    //ops that always carry on with the next instruction and that the interpreter can also
+    //run as part of a superinstruction. Every part but the last must be one of these
+    constexpr bool is_step(Op op) {
+        switch(op) {
+            case Op::MOVE: case Op::LOADNIL: case Op::LOADBOOL: case Op::LOADINT: case Op::LOADK:
+            case Op::LOADSTR: case Op::GETGLOBAL: case Op::GETINDEX:
+            case Op::ADD: case Op::SUB: case Op::MUL: case Op::EQ: case Op::NE: case Op::LT: case Op::LE: case Op::NOT:
+            case Op::ADD_I64: case Op::SUB_I64: case Op::MUL_I64: case Op::DIV_I64: case Op::MOD_I64:
+            case Op::ADD_F64: case Op::SUB_F64: case Op::MUL_F64: case Op::DIV_F64: case Op::MOD_F64:
+            case Op::NEG_I64: case Op::NEG_F64:
+            case Op::EQ_I64: case Op::NE_I64: case Op::LT_I64: case Op::LE_I64:
+            case Op::EQ_F64: case Op::NE_F64: case Op::LT_F64: case Op::LE_F64:
+            case Op::TOF64: case Op::GUARD_I64: case Op::GUARD_F64:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    struct Superinstruction {
+        Op op;
+        uint8_t length;
+        Op parts[3];
+    };
+
+    //longest first, in the order the compiler tries them
+    std::span<const Superinstruction> superinstructions();
+
+    //null unless op is a superinstruction
+    const Superinstruction* superinstruction(Op op);
+
+    //what an instruction runs first - op itself, or the first part of a superinstruction
+    Op first_part(Op op);
+
+
+    //op:8 A:8 B:8 C:8, with B and C read together as the 16 bit Bx / sBx
+    using Instr = uint32_t;
+
+    constexpr Instr make_abc(Op op, unsigned a, unsigned b, unsigned c) {
+        return static_cast<uint32_t>(op) | (a << 8) | (b << 16) | (c << 24);
+    }
+    constexpr Instr make_abx(Op op, unsigned a, unsigned bx) {
+        return static_cast<uint32_t>(op) | (a << 8) | (bx << 16);
+    }
+    constexpr Instr make_asbx(Op op, unsigned a, int sbx) {
+        return make_abx(op, a, static_cast<uint16_t>(static_cast<int16_t>(sbx)));
+    }
+
+    constexpr Op op_of(Instr i) { return static_cast<Op>(i & 0xff); }
+    constexpr unsigned arg_a(Instr i) { return (i >> 8) & 0xff; }
+    constexpr unsigned arg_b(Instr i) { return (i >> 16) & 0xff; }
+    constexpr unsigned arg_c(Instr i) { return i >> 24; }
+    constexpr unsigned arg_bx(Instr i) { return i >> 16; }
+    constexpr int arg_sbx(Instr i) { return static_cast<int16_t>(i >> 16); }
+
+    //bumped whenever the instruction set, the encoding, Value or the cache file header
+    //changes, so stale cache files are never run
+    constexpr uint32_t BYTECODE_VERSION = 6;
+
+    constexpr int MAX_SBX = INT16_MAX;
+    constexpr int MIN_SBX = INT16_MIN;
+    constexpr unsigned MAX_BX = UINT16_MAX;
+    constexpr unsigned MAX_REGISTERS = 255;
+
+
+    class Program;
+
+    struct FunctionProto {
+        uint32_t name;          //string table entry
+        uint32_t code_start;    //into Program::code
+        uint32_t code_size;
+        uint8_t params;
+        uint8_t registers;
+        uint16_t reserved;
+    };
+
+    //what function values point at - ties a prototype to the program holding its code
+    struct Function {
+        const Program *program;
+        uint32_t index;
+
+        const FunctionProto& proto() const;
+        const Instr* code() const;
+        std::string_view name() const;
+    };
+
+    using NativeFn = bool (*)(VM &vm, Value *args, int count, Value &result);
+
+    struct Native {
+        const char *name;
+        NativeFn fn;
+    };
+
+    struct StringRef {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    enum FormatFlag : uint8_t {
+        FORMAT_LEFT = 1,            //-
+        FORMAT_PLUS = 2,            //+
+        FORMAT_SPACE = 4,           //' '
+        FORMAT_ALT = 8,             //#
+        FORMAT_ZERO = 16,           //0
+        FORMAT_INCOMPLETE = 32      //the format ends inside this conversion
+    };
+
+    //one piece of a printf style format: some literal text, then a conversion unless
+    //conversion is 0. %% ends a piece after its first '%', so the text is always a slice of
+    //the format string itself
+    struct FormatStep {
+        uint32_t literal;           //offset and length of the text, in the format string
+        uint32_t length;
+        char conversion;
+        uint8_t flags;              //FormatFlag
+        uint16_t width;
+        int32_t precision;          //-1 when not given
+    };
+
+    //the steps of a string table entry, for string literals print is called with
+    struct FormatPlan {
+        uint32_t string;
+        uint32_t first;             //into Program::format_steps
+        uint32_t count;
+    };
+
+    //splits a format into steps, never fails - malformed conversions are kept for the
+    //formatter to report when it reaches them
+    void plan_format(std::string_view format, std::vector<FormatStep> &steps);
+
+
+    //a compiled module. Function 0 is the module's top level code. The interpreter only reads
+    //through the views, which point either at storage filled by the compiler or straight into
+    //a mapped cache file
+    class Program {
+      public:
+        //what the compiler appends to - link() points the views at it
+        struct Storage {
+            std::vector<Instr> code;
+            std::vector<uint32_t> offsets;
+            std::vector<Value> constants;
+            std::string string_data;
+            std::vector<StringRef> string_refs;
+            std::vector<FunctionProto> functions;
+            std::vector<FormatPlan> formats;
+            std::vector<FormatStep> format_steps;
+        };
+
+        std::string name;
+
+        std::span<const Instr> code;
+        std::span<const uint32_t> offsets;      //source offset of each instruction
+        std::span<const Value> constants;       //numbers only, strings live in the string table
+        std::string_view string_data;
+        std::span<const StringRef> string_refs;
+        std::span<const FunctionProto> functions;
+        std::span<const FormatPlan> formats;
+        std::span<const FormatStep> format_steps;
+
+        //runtime objects built by link() - strings and functions values point at these
+        std::vector<Str> strings;
+        std::vector<Function> function_objects;
+
+        Storage storage;
+
+      private:
+        //the text the offsets refer to, only indexed when a location is asked for
+        std::string_view source;
+        mutable LineIndex lines;
+
+        void *mapping = nullptr;
+        std::size_t mapping_size = 0;
+
+      public:
+        Program() = default;
+        ~Program();
+        Program(const Program&) = delete;
+        Program& operator=(const Program&) = delete;
+
+        std::string_view string(uint32_t index) const {
+            return string_data.substr(string_refs[index].offset, string_refs[index].length);
+        }
+
+        uint32_t add_string(std::string_view text);
+
+        //parses a string table entry as a format once, so print doesn't on every call
+        void add_format(uint32_t string);
+
+        //must be called once the views are set and before the program runs
+        void link();
+
+        //takes ownership of a mapped image the views point into
+        void adopt_mapping(void *data, std::size_t size);
+
+        //the text must outlive the program unless index_lines() is called while it's alive
+        void set_source(std::string_view text);
+        void index_lines() const;
+        Location locate(uint32_t offset) const;
+        Location location(uint32_t instruction) const { return locate(offsets[instruction]); }
+    };
+
+    //the int LOADI64 loads, kept as its high and low 32 bits in two small int constants
+    inline int64_t wide_constant(const Value *constants, uint32_t index) {
+        uint64_t high = static_cast<uint64_t>(constants[index].as_int());
+        uint64_t low = static_cast<uint32_t>(constants[index + 1].as_int());
+        return static_cast<int64_t>( (high << 32) | low );
+    }
+
+    //checks every operand stays inside its function's registers, the constant and string
+    //tables and the function's code, for programs that didn't come straight from the compiler
+    bool verify(const Program &program);
+
+    void disassemble(const Program &program, std::ostream &out);
+
+}
@@ -0,0 +1,232 @@
+#include "cache.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace torq {
+
+    namespace {
+
+        constexpr char MAGIC[4] = {'T', 'Q', 'C', '\0'};
+        constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+        struct Section {
+            uint32_t offset;        //from the start of the file, 8 byte aligned
+            uint32_t count;         //elements, not bytes
+        };
+
+        struct Header {
+            char magic[4];
+            uint32_t version;
+            uint32_t byte_order;    //files are only read back on the same kind of machine
+            uint32_t value_size;
+            uint32_t level;         //of the optimizer that produced the code
+            uint32_t superinstructions;     //the TORQ_SUPERINSTRUCTIONS_ID it was compiled for
+            uint64_t source_hash;
+            uint64_t source_size;
+
+            Section functions;
+            Section code;
+            Section offsets;
+            Section constants;
+            Section string_refs;
+            Section string_data;
+            Section formats;
+            Section format_steps;
+        };
+
+        template<typename T>
+        void append_section(std::vector<char> &image, Section &section, const T *data, std::size_t count) {
+            image.resize((image.size() + 7) & ~std::size_t(7), 0);
+            section.offset = image.size();
+            section.count = count;
+
+            const char *bytes = reinterpret_cast<const char*>(data);
+            image.insert(image.end(), bytes, bytes + count * sizeof(T));
+        }
+
+        template<typename T>
+        bool map_section(const char *base, std::size_t size, const Section &section, std::span<const T> &view) {
+            if( (section.offset % alignof(T) != 0) || (section.offset > size) ||
+                (section.count > (size - section.offset) / sizeof(T)) )
+                return false;
+
+            view = std::span<const T>(reinterpret_cast<const T*>(base + section.offset), section.count);
+            return true;
+        }
+
+        bool write_all(int fd, const char *data, std::size_t size) {
+            while(size > 0) {
+                ssize_t n = ::write(fd, data, size);
+                if(n < 0) {
+                    if(errno == EINTR)
+                        continue;
+                    return false;
+                }
+                data += n;
+                size -= n;
+            }
+            return true;
+        }
+
+    }
+
+    std::string cache_path(const std::string &source_path, int level) {
+        std::string suffix = ".O" + std::to_string(level) + ".tqc";
+        if( (source_path.size() > 3) && (source_path.compare(source_path.size() - 3, 3, ".tq") == 0) )
+            return source_path.substr(0, source_path.size() - 3) + suffix;
+        return source_path + suffix;
+    }
+
+    uint64_t hash_source(std::string_view text) {
+        //64 bit multiply-rotate over 8 byte words, with a murmur style finish so every input
+        //bit reaches every output bit
+        constexpr uint64_t k1 = 0x87c37b91114253d5ull;
+        constexpr uint64_t k2 = 0x4cf5ad432745937full;
+
+        const char *p = text.data();
+        std::size_t n = text.size();
+        uint64_t h = 0x9e3779b97f4a7c15ull ^ (n * k1);
+
+        for(; n >= 8; p += 8, n -= 8) {
+            uint64_t w;
+            std::memcpy(&w, p, 8);
+            w *= k1;
+            w = (w << 31) | (w >> 33);
+            w *= k2;
+            h ^= w;
+            h = ((h << 27) | (h >> 37)) * 5 + 0x52dce729;
+        }
+
+        if(n > 0) {
+            uint64_t w = 0;
+            std::memcpy(&w, p, n);
+            w *= k1;
+            w = (w << 31) | (w >> 33);
+            w *= k2;
+            h ^= w;
+        }
+
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+
+    bool save_cache(const std::string &path, const Program &program, std::string_view source, int level) {
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = BYTECODE_VERSION;
+        header.byte_order = BYTE_ORDER_MARK;
+        header.value_size = sizeof(Value);
+        header.level = level;
+        header.superinstructions = TORQ_SUPERINSTRUCTIONS_ID;
+        header.source_hash = hash_source(source);
+        header.source_size = source.size();
+
+        std::vector<char> image(sizeof(Header));
+        append_section(image, header.functions, program.functions.data(), program.functions.size());
+        append_section(image, header.code, program.code.data(), program.code.size());
+        append_section(image, header.offsets, program.offsets.data(), program.offsets.size());
+        append_section(image, header.constants, program.constants.data(), program.constants.size());
+        append_section(image, header.string_refs, program.string_refs.data(), program.string_refs.size());
+        append_section(image, header.string_data, program.string_data.data(), program.string_data.size());
+        append_section(image, header.formats, program.formats.data(), program.formats.size());
+        append_section(image, header.format_steps, program.format_steps.data(), program.format_steps.size());
+
+        if(image.size() > UINT32_MAX)
+            return false;
+        std::memcpy(image.data(), &header, sizeof(header));
+
+        std::string temporary = path + ".tmp" + std::to_string(::getpid());
+        int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd < 0)
+            return false;
+
+        bool ok = write_all(fd, image.data(), image.size());
+        ok = (::close(fd) == 0) && ok;
+
+        if(!ok || (::rename(temporary.c_str(), path.c_str()) != 0)) {
+            ::unlink(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool load_cache(const std::string &path, std::string_view source, int level, Program &program) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0)
+            return false;
+
+        struct stat info;
+        if( (::fstat(fd, &info) != 0) || !S_ISREG(info.st_mode) || (info.st_size < static_cast<off_t>(sizeof(Header))) ) {
+            ::close(fd);
+            return false;
+        }
+
+        std::size_t size = info.st_size;
+        void *addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(addr == MAP_FAILED)
+            return false;
+
+        const char *base = static_cast<const char*>(addr);
+        Header header;
+        std::memcpy(&header, base, sizeof(header));
+
+        Program loaded;
+        std::span<const char> string_data;
+
+        bool ok = (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0) &&
+            (header.version == BYTECODE_VERSION) &&
+            (header.byte_order == BYTE_ORDER_MARK) &&
+            (header.value_size == sizeof(Value)) &&
+            (header.level == static_cast<uint32_t>(level)) &&
+            (header.superinstructions == TORQ_SUPERINSTRUCTIONS_ID) &&
+            (header.source_size == source.size()) &&
+            (header.source_hash == hash_source(source)) &&
+            map_section(base, size, header.functions, loaded.functions) &&
+            map_section(base, size, header.code, loaded.code) &&
+            map_section(base, size, header.offsets, loaded.offsets) &&
+            map_section(base, size, header.constants, loaded.constants) &&
+            map_section(base, size, header.string_refs, loaded.string_refs) &&
+            map_section(base, size, header.string_data, string_data) &&
+            map_section(base, size, header.formats, loaded.formats) &&
+            map_section(base, size, header.format_steps, loaded.format_steps);
+
+        if(ok) {
+            loaded.string_data = std::string_view(string_data.data(), string_data.size());
+            ok = verify(loaded);
+        }
+
+        if(!ok) {
+            ::munmap(addr, size);
+            return false;
+        }
+
+        program.functions = loaded.functions;
+        program.code = loaded.code;
+        program.offsets = loaded.offsets;
+        program.constants = loaded.constants;
+        program.string_refs = loaded.string_refs;
+        program.string_data = loaded.string_data;
+        program.formats = loaded.formats;
+        program.format_steps = loaded.format_steps;
+
+        program.adopt_mapping(addr, size);
+        program.set_source(source);
+        program.link();
+        return true;
+    }
+
+}
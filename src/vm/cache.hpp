@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "bytecode.hpp"
+
+namespace torq {
+
+    //compiled programs saved next to their source - foo.tq is cached as foo.O1.tqc, one file
+    //per optimization level so runs at different levels don't overwrite each other. A cache
+    //file is the program's sections laid out as the interpreter reads them, so loading is a
+    //mmap, a header check and a verify pass. Files are keyed by a hash of the source text, the
+    //optimization level and BYTECODE_VERSION, anything else is treated as a miss
+
+    std::string cache_path(const std::string &source_path, int level);
+
+    uint64_t hash_source(std::string_view text);
+
+    //written to a temporary file and renamed into place, so readers never see half a file
+    bool save_cache(const std::string &path, const Program &program, std::string_view source, int level);
+
+    //fails on a missing, stale or damaged file, leaving program untouched
+    bool load_cache(const std::string &path, std::string_view source, int level, Program &program);
+
+}
@@ -0,0 +1,591 @@
+#include "jit.hpp"
+
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <map>
+
+#if TORQ_JIT
+    #include <sys/mman.h>
+#endif
+
+namespace torq {
+
+#if TORQ_JIT
+
+    namespace {
+
+        enum Reg : uint8_t { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6 };
+        enum Xmm : uint8_t { XMM0 = 0, XMM1 = 1 };
+
+        enum Cond : uint8_t {
+            CC_O = 0x0, CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7,
+            CC_S = 0x8, CC_P = 0xA, CC_NP = 0xB, CC_L = 0xC, CC_LE = 0xE, CC_G = 0xF
+        };
+
+        //opcode bytes of the two register forms used
+        enum Alu : uint8_t { ADD = 0x01, OR = 0x09, AND = 0x21, SUB = 0x29, CMP = 0x39, TEST = 0x85, MOV = 0x89 };
+        enum Shift : uint8_t { SHL = 4, SHR = 5, SAR = 7 };
+        enum SseOp : uint8_t { ADDSD = 0x58, MULSD = 0x59, SUBSD = 0x5C, DIVSD = 0x5E };
+
+        //the Value layout the templates depend on, taken from Value itself
+        const uint64_t NIL_BITS = std::bit_cast<uint64_t>(Value());
+        const uint64_t FALSE_BITS = std::bit_cast<uint64_t>(Value::boolean(false));
+        const uint64_t FIRST_BOXED = NIL_BITS;
+        const uint64_t CANONICAL_NAN = std::bit_cast<uint64_t>(Value::number(NAN));
+        const uint64_t SMALL_INT_TAG = std::bit_cast<uint64_t>(Value::small_int(0));
+        constexpr uint64_t PAYLOAD = 0x0000FFFFFFFFFFFFull;
+
+        //x86-64 encodings for the handful of instructions the templates use. Value stack
+        //registers are addressed as [rbx + 8 * register]
+        class Assembler {
+          public:
+            std::vector<uint8_t> bytes;
+
+            std::size_t here() const { return bytes.size(); }
+
+            void byte(uint8_t b) { bytes.push_back(b); }
+            void u32(uint32_t v) { for(int i = 0; i < 4; i++) byte(v >> (8 * i)); }
+            void u64(uint64_t v) { for(int i = 0; i < 8; i++) byte(v >> (8 * i)); }
+
+            void load(Reg r, unsigned slot) { byte(0x48); byte(0x8B); operand(r, slot); }
+            void store(unsigned slot, Reg r) { byte(0x48); byte(0x89); operand(r, slot); }
+            void mov_imm(Reg r, uint64_t v) { byte(0x48); byte(0xB8 + r); u64(v); }
+
+            void alu(Alu op, Reg dst, Reg src) { byte(0x48); byte(op); byte(0xC0 | (src << 3) | dst); }
+            void imul(Reg dst, Reg src) { byte(0x48); byte(0x0F); byte(0xAF); byte(0xC0 | (dst << 3) | src); }
+            void shift(Shift op, Reg r, uint8_t count) { byte(0x48); byte(0xC1); byte(0xC0 | (op << 3) | r); byte(count); }
+            void cqo() { byte(0x48); byte(0x99); }
+            void idiv(Reg r) { byte(0x48); byte(0xF7); byte(0xF8 | r); }
+            void neg(Reg r) { byte(0x48); byte(0xF7); byte(0xD8 | r); }
+            void cmp_imm(Reg r, int32_t v) { byte(0x48); byte(0x81); byte(0xF8 | r); u32(v); }
+            void and_imm(Reg r, int8_t v) { byte(0x48); byte(0x83); byte(0xE0 | r); byte(v); }
+            void flip_sign(Reg r) { byte(0x48); byte(0x0F); byte(0xBA); byte(0xF8 | r); byte(63); }
+
+            //low byte of r = condition, then eax = al
+            void setcc(Cond c, Reg r) { byte(0x0F); byte(0x90 + c); byte(0xC0 | r); }
+            void and_al_cl() { byte(0x20); byte(0xC8); }
+            void or_al_cl() { byte(0x08); byte(0xC8); }
+            void movzx_eax_al() { byte(0x0F); byte(0xB6); byte(0xC0); }
+
+            void to_xmm(Xmm x, Reg r) { byte(0x66); byte(0x48); byte(0x0F); byte(0x6E); byte(0xC0 | (x << 3) | r); }
+            void from_xmm(Reg r, Xmm x) { byte(0x66); byte(0x48); byte(0x0F); byte(0x7E); byte(0xC0 | (x << 3) | r); }
+            void sse(SseOp op, Xmm dst, Xmm src) { byte(0xF2); byte(0x0F); byte(op); byte(0xC0 | (dst << 3) | src); }
+            void ucomisd(Xmm a, Xmm b) { byte(0x66); byte(0x0F); byte(0x2E); byte(0xC0 | (a << 3) | b); }
+            void cvtsi2sd(Xmm x, Reg r) { byte(0xF2); byte(0x48); byte(0x0F); byte(0x2A); byte(0xC0 | (x << 3) | r); }
+
+            void push_rbx() { byte(0x53); }
+            void pop_rbx() { byte(0x5B); }
+            void ret() { byte(0xC3); }
+            void mov_eax(uint32_t v) { byte(0xB8); u32(v); }
+
+            //jumps leave a 32 bit displacement to patch, and return where it is
+            std::size_t jcc(Cond c) { byte(0x0F); byte(0x80 + c); u32(0); return here() - 4; }
+            std::size_t jmp() { byte(0xE9); u32(0); return here() - 4; }
+
+            void patch(std::size_t at, std::size_t target) {
+                int32_t rel = static_cast<int32_t>(target - (at + 4));
+                std::memcpy(&bytes[at], &rel, 4);
+            }
+            void patch_here(std::size_t at) { patch(at, here()); }
+
+          private:
+            void operand(Reg r, unsigned slot) { byte(0x80 | (r << 3) | RBX); u32(slot * 8); }
+        };
+
+
+        //one region of one program. Every instruction gets a template, jumps within the
+        //region are patched once all templates are laid out, and every way out shares a stub
+        //per (instruction, deopt) pair
+        class Translator {
+          private:
+            Assembler a;
+            const Program &program;
+            uint32_t start;
+            uint32_t last;
+            uint32_t pc;
+
+            std::vector<std::size_t> labels;
+
+            struct Fixup {
+                std::size_t at;
+                uint32_t target;
+            };
+            std::vector<Fixup> jumps;
+            std::map<uint32_t, std::vector<std::size_t>> exits;
+
+            bool inside(uint32_t target) const { return (target >= start) && (target <= last); }
+
+            void exit_at(std::size_t at, uint32_t target, bool deopt) {
+                exits[(target << 1) | (deopt ? 1 : 0)].push_back(at);
+            }
+
+            void deopt_if(Cond c) { exit_at(a.jcc(c), pc, true); }
+
+            void jump(uint32_t target) {
+                std::size_t at = a.jmp();
+                if(inside(target))
+                    jumps.push_back({at, target});
+                else
+                    exit_at(at, target, false);
+            }
+
+            void branch(Cond c, uint32_t target) {
+                std::size_t at = a.jcc(c);
+                if(inside(target))
+                    jumps.push_back({at, target});
+                else
+                    exit_at(at, target, false);
+            }
+
+            //jumps past the next instruction when the tag isn't a small int's
+            std::size_t unless_small_int(Reg r) {
+                a.alu(MOV, RSI, r);
+                a.shift(SHR, RSI, 48);
+                a.cmp_imm(RSI, static_cast<int32_t>(SMALL_INT_TAG >> 48));
+                return a.jcc(CC_NE);
+            }
+
+            void untag_int(Reg r) {
+                a.shift(SHL, r, 16);
+                a.shift(SAR, r, 16);
+            }
+
+            //boxed ints are left to the interpreter
+            void load_int(Reg r, unsigned slot) {
+                a.load(r, slot);
+                exit_at(unless_small_int(r), pc, true);
+                untag_int(r);
+            }
+
+            //rax, which has to fit a small int
+            void store_int(unsigned slot) {
+                a.alu(MOV, RSI, RAX);
+                untag_int(RSI);
+                a.alu(CMP, RSI, RAX);
+                deopt_if(CC_NE);
+
+                a.mov_imm(RSI, PAYLOAD);
+                a.alu(AND, RAX, RSI);
+                a.mov_imm(RSI, SMALL_INT_TAG);
+                a.alu(OR, RAX, RSI);
+                a.store(slot, RAX);
+            }
+
+            //typed registers hold floats, as the interpreter assumes too
+            void load_float(Xmm x, unsigned slot) {
+                a.load(RAX, slot);
+                a.to_xmm(x, RAX);
+            }
+
+            //xmm0, with every NaN folded into the canonical one
+            void store_float(unsigned slot) {
+                a.from_xmm(RAX, XMM0);
+                a.ucomisd(XMM0, XMM0);
+                std::size_t ordered = a.jcc(CC_NP);
+                a.mov_imm(RAX, CANONICAL_NAN);
+                a.patch_here(ordered);
+                a.store(slot, RAX);
+            }
+
+            //al, 0 or 1
+            void store_bool(unsigned slot) {
+                a.movzx_eax_al();
+                a.shift(SHL, RAX, 1);
+                a.mov_imm(RSI, FALSE_BITS);
+                a.alu(OR, RAX, RSI);
+                a.store(slot, RAX);
+            }
+
+            void int_compare(Cond c, Instr instr) {
+                load_int(RAX, arg_b(instr));
+                load_int(RCX, arg_c(instr));
+                a.alu(CMP, RAX, RCX);
+                a.setcc(c, RAX);
+                store_bool(arg_a(instr));
+            }
+
+            //ucomisd leaves unordered as ZF=PF=CF=1, so NaN compares false except for !=
+            void float_compare(Op op) {
+                switch(op) {
+                    case Op::LT_F64:
+                        a.ucomisd(XMM1, XMM0);
+                        a.setcc(CC_A, RAX);
+                        break;
+                    case Op::LE_F64:
+                        a.ucomisd(XMM1, XMM0);
+                        a.setcc(CC_AE, RAX);
+                        break;
+                    case Op::EQ_F64:
+                        a.ucomisd(XMM0, XMM1);
+                        a.setcc(CC_E, RAX);
+                        a.setcc(CC_NP, RCX);
+                        a.and_al_cl();
+                        break;
+                    default:
+                        a.ucomisd(XMM0, XMM1);
+                        a.setcc(CC_NE, RAX);
+                        a.setcc(CC_P, RCX);
+                        a.or_al_cl();
+                        break;
+                }
+            }
+
+            void int_arith(Op op) {
+                switch(op) {
+                    case Op::ADD_I64: a.alu(ADD, RAX, RCX); break;
+                    case Op::SUB_I64: a.alu(SUB, RAX, RCX); break;
+                    default: a.imul(RAX, RCX); break;
+                }
+            }
+
+            //generic ops on two small ints or two floats - any other mix is the interpreter's
+            void generic(Instr instr, Op int_op, Op float_op) {
+                a.load(RAX, arg_b(instr));
+                a.load(RCX, arg_c(instr));
+
+                std::size_t not_int = unless_small_int(RAX);
+                exit_at(unless_small_int(RCX), pc, true);
+                untag_int(RAX);
+                untag_int(RCX);
+
+                if( (int_op == Op::LT_I64) || (int_op == Op::LE_I64) ) {
+                    a.alu(CMP, RAX, RCX);
+                    a.setcc( (int_op == Op::LT_I64) ? CC_L : CC_LE, RAX );
+                    store_bool(arg_a(instr));
+                } else {
+                    int_arith(int_op);
+                    store_int(arg_a(instr));
+                }
+                std::size_t done = a.jmp();
+
+                a.patch_here(not_int);
+                a.mov_imm(RSI, FIRST_BOXED);
+                a.alu(CMP, RAX, RSI);
+                deopt_if(CC_AE);
+                a.alu(CMP, RCX, RSI);
+                deopt_if(CC_AE);
+                a.to_xmm(XMM0, RAX);
+                a.to_xmm(XMM1, RCX);
+
+                if( (float_op == Op::LT_F64) || (float_op == Op::LE_F64) ) {
+                    float_compare(float_op);
+                    store_bool(arg_a(instr));
+                } else {
+                    float_arith(float_op);
+                    store_float(arg_a(instr));
+                }
+                a.patch_here(done);
+            }
+
+            void float_arith(Op op) {
+                switch(op) {
+                    case Op::ADD_F64: a.sse(ADDSD, XMM0, XMM1); break;
+                    case Op::SUB_F64: a.sse(SUBSD, XMM0, XMM1); break;
+                    case Op::MUL_F64: a.sse(MULSD, XMM0, XMM1); break;
+                    default: a.sse(DIVSD, XMM0, XMM1); break;
+                }
+            }
+
+            //R[A] < R[A+1] going up, R[A] > R[A+1] going down
+            void past_limit(std::size_t &up, std::size_t &down) {
+                a.alu(TEST, RDX, RDX);
+                std::size_t negative = a.jcc(CC_S);
+                a.alu(CMP, RAX, RCX);
+                up = a.jcc(CC_G);
+                std::size_t checked = a.jmp();
+                a.patch_here(negative);
+                a.alu(CMP, RAX, RCX);
+                down = a.jcc(CC_L);
+                a.patch_here(checked);
+            }
+
+            bool translate(Instr instr);
+
+          public:
+            Translator(const Program &program, uint32_t start, uint32_t last) :
+              program(program), start(start), last(last) {}
+
+            bool run(std::vector<uint8_t> &out);
+        };
+
+        bool Translator::translate(Instr instr) {
+            //a superinstruction is its parts, which follow one by one anyway
+            Op op = first_part(op_of(instr));
+            uint32_t target = pc + 1 + arg_sbx(instr);
+
+            switch(op) {
+                case Op::MOVE:
+                    a.load(RAX, arg_b(instr));
+                    a.store(arg_a(instr), RAX);
+                    return true;
+
+                case Op::LOADNIL:
+                    a.mov_imm(RAX, NIL_BITS);
+                    a.store(arg_a(instr), RAX);
+                    return true;
+
+                case Op::LOADBOOL:
+                    a.mov_imm(RAX, std::bit_cast<uint64_t>(Value::boolean(arg_b(instr) != 0)));
+                    a.store(arg_a(instr), RAX);
+                    return true;
+
+                case Op::LOADINT:
+                    a.mov_imm(RAX, std::bit_cast<uint64_t>(Value::small_int(arg_sbx(instr))));
+                    a.store(arg_a(instr), RAX);
+                    return true;
+
+                case Op::LOADK:
+                    a.mov_imm(RAX, std::bit_cast<uint64_t>(program.constants[arg_bx(instr)]));
+                    a.store(arg_a(instr), RAX);
+                    return true;
+
+                case Op::ADD: generic(instr, Op::ADD_I64, Op::ADD_F64); return true;
+                case Op::SUB: generic(instr, Op::SUB_I64, Op::SUB_F64); return true;
+                case Op::MUL: generic(instr, Op::MUL_I64, Op::MUL_F64); return true;
+                case Op::LT: generic(instr, Op::LT_I64, Op::LT_F64); return true;
+                case Op::LE: generic(instr, Op::LE_I64, Op::LE_F64); return true;
+
+                case Op::ADD_I64:
+                case Op::SUB_I64:
+                case Op::MUL_I64:
+                    load_int(RAX, arg_b(instr));
+                    load_int(RCX, arg_c(instr));
+                    int_arith(op);
+                    store_int(arg_a(instr));
+                    return true;
+
+                //small ints can't overflow idiv - only the result can be too wide
+                case Op::DIV_I64:
+                case Op::MOD_I64:
+                    load_int(RAX, arg_b(instr));
+                    load_int(RCX, arg_c(instr));
+                    a.alu(TEST, RCX, RCX);
+                    exit_at(a.jcc(CC_E), pc, false);
+                    a.cqo();
+                    a.idiv(RCX);
+                    if(op == Op::MOD_I64)
+                        a.alu(MOV, RAX, RDX);
+                    store_int(arg_a(instr));
+                    return true;
+
+                case Op::NEG_I64:
+                    load_int(RAX, arg_b(instr));
+                    a.neg(RAX);
+                    store_int(arg_a(instr));
+                    return true;
+
+                case Op::ADD_F64:
+                case Op::SUB_F64:
+                case Op::MUL_F64:
+                case Op::DIV_F64:
+                    load_float(XMM0, arg_b(instr));
+                    load_float(XMM1, arg_c(instr));
+                    float_arith(op);
+                    store_float(arg_a(instr));
+                    return true;
+
+                case Op::NEG_F64:
+                    a.load(RAX, arg_b(instr));
+                    a.flip_sign(RAX);
+                    a.to_xmm(XMM0, RAX);
+                    store_float(arg_a(instr));
+                    return true;
+
+                case Op::EQ_I64: int_compare(CC_E, instr); return true;
+                case Op::NE_I64: int_compare(CC_NE, instr); return true;
+                case Op::LT_I64: int_compare(CC_L, instr); return true;
+                case Op::LE_I64: int_compare(CC_LE, instr); return true;
+
+                case Op::EQ_F64:
+                case Op::NE_F64:
+                case Op::LT_F64:
+                case Op::LE_F64:
+                    load_float(XMM0, arg_b(instr));
+                    load_float(XMM1, arg_c(instr));
+                    float_compare(op);
+                    store_bool(arg_a(instr));
+                    return true;
+
+                case Op::TOF64:
+                    load_int(RAX, arg_b(instr));
+                    a.cvtsi2sd(XMM0, RAX);
+                    store_float(arg_a(instr));
+                    return true;
+
+                case Op::GUARD_I64:
+                    a.load(RAX, arg_a(instr));
+                    exit_at(unless_small_int(RAX), pc, true);
+                    return true;
+
+                case Op::GUARD_F64: {
+                    a.load(RAX, arg_a(instr));
+                    a.mov_imm(RSI, FIRST_BOXED);
+                    a.alu(CMP, RAX, RSI);
+                    std::size_t is_float = a.jcc(CC_B);
+
+                    exit_at(unless_small_int(RAX), pc, true);
+                    untag_int(RAX);
+                    a.cvtsi2sd(XMM0, RAX);
+                    a.from_xmm(RAX, XMM0);
+                    a.store(arg_a(instr), RAX);
+
+                    a.patch_here(is_float);
+                    return true;
+                }
+
+                case Op::JMP:
+                    jump(target);
+                    return true;
+
+                case Op::JMPIF:
+                case Op::JMPIFNOT:
+                    //nil and false differ only in bit 0
+                    a.load(RAX, arg_a(instr));
+                    a.and_imm(RAX, -2);
+                    a.mov_imm(RSI, NIL_BITS);
+                    a.alu(CMP, RAX, RSI);
+                    branch( (op == Op::JMPIF) ? CC_NE : CC_E, target );
+                    return true;
+
+                case Op::FORPREP_I64: {
+                    unsigned r = arg_a(instr);
+                    load_int(RAX, r);
+                    load_int(RCX, r + 1);
+                    load_int(RDX, r + 2);
+
+                    //a zero step is the interpreter's error to raise
+                    a.alu(TEST, RDX, RDX);
+                    exit_at(a.jcc(CC_E), pc, false);
+
+                    std::size_t up, down;
+                    past_limit(up, down);
+                    for(std::size_t at : {up, down}) {
+                        if(inside(target))
+                            jumps.push_back({at, target});
+                        else
+                            exit_at(at, target, false);
+                    }
+
+                    a.load(RAX, r);
+                    a.store(r + 3, RAX);
+                    return true;
+                }
+
+                case Op::FORLOOP_I64: {
+                    unsigned r = arg_a(instr);
+                    load_int(RAX, r);
+                    load_int(RDX, r + 2);
+                    load_int(RCX, r + 1);
+
+                    a.alu(ADD, RAX, RDX);
+                    std::size_t overflow = a.jcc(CC_O);
+
+                    std::size_t up, down;
+                    past_limit(up, down);
+
+                    store_int(r);
+                    a.store(r + 3, RAX);
+                    jump(target);
+
+                    a.patch_here(overflow);
+                    a.patch_here(up);
+                    a.patch_here(down);
+                    return true;
+                }
+
+                //the interpreter pops the frame
+                case Op::RETURN:
+                    exit_at(a.jmp(), pc, false);
+                    return true;
+
+                default:
+                    return false;
+            }
+        }
+
+        bool Translator::run(std::vector<uint8_t> &out) {
+            a.push_rbx();
+            a.byte(0x48); a.byte(0x89); a.byte(0xFB);       //mov rbx, rdi
+
+            for(pc = start; pc <= last; pc++) {
+                labels.push_back(a.here());
+                if(!translate(program.code[pc]))
+                    return false;
+            }
+            exit_at(a.jmp(), last + 1, false);
+
+            for(const Fixup &fixup : jumps)
+                a.patch(fixup.at, labels[fixup.target - start]);
+
+            for(const auto &[code, sites] : exits) {
+                for(std::size_t at : sites)
+                    a.patch_here(at);
+                a.mov_eax(code);
+                a.pop_rbx();
+                a.ret();
+            }
+
+            out = std::move(a.bytes);
+            return true;
+        }
+
+    }
+
+    bool Jit::compile(const Program &program, Site &site, uint32_t start, uint32_t last) {
+        std::vector<uint8_t> bytes;
+        Translator translator(program, start, last);
+
+        void *memory = MAP_FAILED;
+        if( (start <= last) && (last < program.code.size()) && translator.run(bytes) )
+            memory = mmap(nullptr, bytes.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        //written, then made executable and never writable again
+        if( (memory == MAP_FAILED) ||
+            (std::memcpy(memory, bytes.data(), bytes.size()), mprotect(memory, bytes.size(), PROT_READ | PROT_EXEC) != 0) ) {
+            if(memory != MAP_FAILED)
+                munmap(memory, bytes.size());
+            site.countdown = UINT32_MAX;
+            return false;
+        }
+
+        code.push_back({memory, bytes.size()});
+        site.entry = reinterpret_cast<Entry>(memory);
+        compiled_regions++;
+        return true;
+    }
+
+    Jit::~Jit() {
+        for(const Code &region : code)
+            munmap(region.memory, region.size);
+    }
+
+#else
+
+    bool Jit::compile(const Program&, Site &site, uint32_t, uint32_t) {
+        site.countdown = UINT32_MAX;
+        return false;
+    }
+
+    Jit::~Jit() {}
+
+#endif
+
+    Jit::Site* Jit::sites(const Program *program) {
+        std::vector<Site> &sites = program_sites[program];
+        if(sites.empty())
+            sites.resize(program->code.size());
+        return sites.data();
+    }
+
+    void Jit::deopted(Site &site) {
+        deopt_count++;
+
+        //a region whose assumptions keep failing is cheaper left to the interpreter
+        if(++site.deopts > MAX_DEOPTS) {
+            site.entry = nullptr;
+            site.countdown = UINT32_MAX;
+        }
+    }
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "bytecode.hpp"
+#include "value.hpp"
+
+//native code is only emitted for x86-64 Linux. Define TORQ_NO_JIT to leave it out everywhere
+#if defined(__x86_64__) && defined(__linux__) && !defined(TORQ_NO_JIT)
+    #define TORQ_JIT 1
+#else
+    #define TORQ_JIT 0
+#endif
+
+namespace torq {
+
+    //baseline template JIT. Once a loop header or a function entry has been reached often
+    //enough, the instructions from there to the loop's back edge - or to the end of the
+    //function - are translated one at a time into x86-64, as long as every one of them is
+    //an instruction the JIT knows. Registers stay in the VM's value stack, so the native
+    //code can hand control back to the interpreter before any instruction: at a jump or
+    //RETURN leaving the region, and as a deopt whenever a value isn't what the fast path
+    //expects - a boxed int, an int result too wide for a Value, a mixed int and float
+    //operand, a failed type guard. The interpreter then runs that instruction itself. A
+    //region that keeps deopting is thrown away
+    class Jit {
+      public:
+        //native entry point - runs from the region's first instruction until it exits, and
+        //returns the program instruction to resume at, shifted left one, with bit 0 set for
+        //a deopt
+        using Entry = uint64_t (*)(Value *base);
+
+        static constexpr uint32_t HOT = 1000;
+        static constexpr uint32_t MAX_DEOPTS = 100;
+
+        //one per instruction of a program - only the ones at loop headers and function
+        //entries are ever used
+        struct Site {
+            Entry entry = nullptr;
+            uint32_t countdown = HOT;
+            uint32_t deopts = 0;
+        };
+
+      private:
+        struct Code {
+            void *memory;
+            std::size_t size;
+        };
+
+        std::unordered_map<const Program*, std::vector<Site>> program_sites;
+        std::vector<Code> code;
+
+        std::size_t compiled_regions = 0;
+        std::size_t deopt_count = 0;
+
+      public:
+        Jit() = default;
+        ~Jit();
+
+        Jit(const Jit&) = delete;
+        Jit& operator=(const Jit&) = delete;
+
+        //false when this build can't emit native code
+        static bool available() { return TORQ_JIT; }
+
+        Site* sites(const Program *program);
+
+        //translates instructions start to last of program into native code for site. On
+        //failure the site is left to the interpreter for good
+        bool compile(const Program &program, Site &site, uint32_t start, uint32_t last);
+
+        //runs a site's native code and returns the instruction to carry on interpreting at
+        uint32_t run(Site &site, Value *base) {
+            uint64_t exit = site.entry(base);
+            if(exit & 1) [[unlikely]]
+                deopted(site);
+            return static_cast<uint32_t>(exit >> 1);
+        }
+
+        std::size_t compiled() const { return compiled_regions; }
+        std::size_t deopts() const { return deopt_count; }
+
+      private:
+        void deopted(Site &site);
+    };
+
+}
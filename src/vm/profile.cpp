@@ -0,0 +1,155 @@
+#include "profile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <sys/time.h>
+
+namespace torq {
+
+    volatile std::sig_atomic_t Profiler::sample_due = 0;
+
+    void Profiler::on_signal(int) {
+        sample_due = 1;
+    }
+
+    Profiler::Profiler() : pairs(BASE_OPS * BASE_OPS), triples(BASE_OPS * BASE_OPS * BASE_OPS) {
+        struct sigaction action{};
+        action.sa_handler = on_signal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, &previous_action);
+
+        sample_due = 0;
+        itimerval timer{};
+        timer.it_interval.tv_usec = INTERVAL_US;
+        timer.it_value.tv_usec = INTERVAL_US;
+        setitimer(ITIMER_PROF, &timer, nullptr);
+    }
+
+    Profiler::~Profiler() {
+        itimerval timer{};
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        sigaction(SIGPROF, &previous_action, nullptr);
+        sample_due = 0;
+    }
+
+    void Profiler::count(const Instr *at, const Instr *end) {
+        Op op = op_of(*at);
+        op_counts[static_cast<std::size_t>(op)]++;
+
+        //a superinstruction's parts all ran, each starting its own sequences
+        const Superinstruction *super = superinstruction(op);
+        for(const Instr *part = at; part < at + (super ? super->length : 1); part++) {
+            if(part + 1 >= end)
+                break;
+            std::size_t a = static_cast<std::size_t>(first_part(op_of(part[0])));
+            std::size_t b = static_cast<std::size_t>(first_part(op_of(part[1])));
+            pairs[a * BASE_OPS + b]++;
+            if(part + 2 < end)
+                triples[(a * BASE_OPS + b) * BASE_OPS + static_cast<std::size_t>(first_part(op_of(part[2])))]++;
+        }
+    }
+
+    void Profiler::sample(const std::vector<Frame> &stack) {
+        sample_due = 0;
+        if(stack.empty())
+            return;
+        sample_count++;
+
+        //name (file:line:column) for each frame, at the line it's running or calling from
+        std::string folded;
+        for(std::size_t i = 0; i < stack.size(); i++) {
+            auto [function, pc] = stack[i];
+            const Program *program = function->program;
+            Location location = program->location(pc);
+
+            if(i > 0)
+                folded += ';';
+            folded += function->name();
+            folded += " (" + program->name + ":" + std::to_string(location.line) + ":" + std::to_string(location.column) + ")";
+
+            //recursion counts once towards inclusive time
+            bool seen = std::any_of(stack.begin(), stack.begin() + i, [&](const Frame &f) { return f.first == function; });
+            if(!seen)
+                functions[function].inclusive++;
+        }
+
+        functions[stack.back().first].exclusive++;
+        stacks[folded]++;
+    }
+
+    void Profiler::report(std::ostream &out) const {
+        std::string text;
+        char line[256];
+        const double ms = INTERVAL_US / 1000.0;
+
+        std::snprintf(line, sizeof(line), "profile: %llu samples, %.1f ms each\n\n",
+                      static_cast<unsigned long long>(sample_count), ms);
+        text += line;
+
+        std::vector<std::pair<const Function*, Times>> by_time(functions.begin(), functions.end());
+        std::sort(by_time.begin(), by_time.end(), [](const auto &a, const auto &b) {
+            return (a.second.inclusive != b.second.inclusive) ? (a.second.inclusive > b.second.inclusive)
+                                                              : (a.second.exclusive > b.second.exclusive);
+        });
+
+        std::snprintf(line, sizeof(line), "%12s %12s  %s\n", "inclusive ms", "exclusive ms", "function");
+        text += line;
+        for(const auto &[function, times] : by_time) {
+            std::snprintf(line, sizeof(line), "%12.1f %12.1f  %.*s (%s)\n", times.inclusive * ms, times.exclusive * ms,
+                          static_cast<int>(function->name().size()), function->name().data(), function->program->name.c_str());
+            text += line;
+        }
+
+        std::vector<std::pair<uint64_t, Op>> by_count;
+        for(std::size_t i = 0; i < op_counts.size(); i++) {
+            if(op_counts[i] > 0)
+                by_count.push_back({op_counts[i], static_cast<Op>(i)});
+        }
+        std::sort(by_count.begin(), by_count.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+
+        std::snprintf(line, sizeof(line), "\n%-12s %14s\n", "opcode", "executed");
+        text += line;
+        for(const auto &[count, op] : by_count) {
+            std::snprintf(line, sizeof(line), "%-12s %14llu\n", op_name(op), static_cast<unsigned long long>(count));
+            text += line;
+        }
+
+        out << text;
+    }
+
+    void Profiler::write_sequences(std::ostream &out) const {
+        std::vector<std::pair<uint64_t, std::string>> lines;
+        for(std::size_t i = 0; i < pairs.size(); i++) {
+            if(pairs[i] > 0)
+                lines.push_back({pairs[i], std::string(op_name(static_cast<Op>(i / BASE_OPS))) + " " + op_name(static_cast<Op>(i % BASE_OPS))});
+        }
+        for(std::size_t i = 0; i < triples.size(); i++) {
+            if(triples[i] > 0) {
+                std::string ops = op_name(static_cast<Op>(i / (BASE_OPS * BASE_OPS)));
+                ops += " ";
+                ops += op_name(static_cast<Op>(i / BASE_OPS % BASE_OPS));
+                ops += " ";
+                ops += op_name(static_cast<Op>(i % BASE_OPS));
+                lines.push_back({triples[i], ops});
+            }
+        }
+        std::sort(lines.begin(), lines.end(), [](const auto &a, const auto &b) {
+            return (a.first != b.first) ? (a.first > b.first) : (a.second < b.second);
+        });
+
+        for(const auto &[count, ops] : lines)
+            out << count << ' ' << ops << '\n';
+    }
+
+    void Profiler::write_folded(std::ostream &out) const {
+        //sorted, so the same run gives the same file
+        std::vector<std::pair<std::string, uint64_t>> lines(stacks.begin(), stacks.end());
+        std::sort(lines.begin(), lines.end());
+
+        for(const auto &[stack, count] : lines)
+            out << stack << ' ' << count << '\n';
+    }
+
+}
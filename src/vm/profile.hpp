@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "bytecode.hpp"
+
+namespace torq {
+
+    //--profile. Counts every opcode the interpreter dispatches, and samples the call stack
+    //on a CPU time timer: SIGPROF only raises a flag, the interpreter takes the sample at its
+    //next dispatch. Samples give each function's inclusive time (on the stack) and exclusive
+    //time (running), and are kept as folded stacks for flamegraph tools. Only one profiler can
+    //run at a time.
+    //
+    //It also counts the sequences of two and three instructions starting at each one run, as
+    //if no superinstructions had been fused, which is what tools/superinstructions picks them
+    //from
+    class Profiler {
+      public:
+        static constexpr unsigned INTERVAL_US = 1000;
+
+        //a frame of a sample: the function and the instruction it's at
+        using Frame = std::pair<const Function*, uint32_t>;
+
+      private:
+        struct Times {
+            uint64_t inclusive = 0;
+            uint64_t exclusive = 0;
+        };
+
+        std::array<uint64_t, static_cast<std::size_t>(Op::COUNT)> op_counts{};
+        std::vector<uint64_t> pairs;        //BASE_OPS x BASE_OPS
+        std::vector<uint64_t> triples;      //BASE_OPS x BASE_OPS x BASE_OPS
+        std::unordered_map<std::string, uint64_t> stacks;
+        std::unordered_map<const Function*, Times> functions;
+        uint64_t sample_count = 0;
+
+        struct sigaction previous_action;
+
+        static volatile std::sig_atomic_t sample_due;
+        static void on_signal(int);
+
+      public:
+        Profiler();
+        ~Profiler();
+
+        Profiler(const Profiler&) = delete;
+        Profiler& operator=(const Profiler&) = delete;
+
+        static bool due() { return sample_due != 0; }
+
+        //the instruction at is being dispatched, end is the end of its function's code
+        void count(const Instr *at, const Instr *end);
+
+        //stack runs outermost first
+        void sample(const std::vector<Frame> &stack);
+
+        uint64_t count_of(Op op) const { return op_counts[static_cast<std::size_t>(op)]; }
+        uint64_t samples() const { return sample_count; }
+
+        //functions by inclusive time, then opcodes by count
+        void report(std::ostream &out) const;
+
+        //one line per distinct stack: frames separated by ';', then the sample count
+        void write_folded(std::ostream &out) const;
+
+        //"count OP OP" and "count OP OP OP" lines, most frequent first
+        void write_sequences(std::ostream &out) const;
+    };
+
+}
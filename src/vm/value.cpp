@@ -0,0 +1,155 @@
+#include "value.hpp"
+#include "bytecode.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <vector>
+
+namespace torq {
+
+    ValueKind Value::kind() const {
+        if(is_float())
+            return ValueKind::FLOAT;
+
+        switch( (bits >> 48) & 7 ) {
+            case SPECIAL: return (bits == NIL_BITS) ? ValueKind::NIL : ValueKind::BOOL;
+            case FUNCTION: return ValueKind::FUNCTION;
+            case SMALL_INT: case BOXED_INT: return ValueKind::INT;
+            case STRING: return ValueKind::STRING;
+            case LIST: return ValueKind::LIST;
+            case MODULE: return ValueKind::MODULE;
+            default: return ValueKind::NATIVE;
+        }
+    }
+
+    bool Value::equals(const Value &other) const {
+        ValueKind a = kind(), b = other.kind();
+        if(a != b) {
+            if(is_number() && other.is_number())
+                return as_number() == other.as_number();
+            return false;
+        }
+
+        switch(a) {
+            case ValueKind::INT: return as_int() == other.as_int();
+            case ValueKind::FLOAT: return as_float() == other.as_float();
+            case ValueKind::STRING: return (bits == other.bits) || (as_string()->view() == other.as_string()->view());
+            default: return bits == other.bits;
+        }
+    }
+
+    const char* value_kind_name(ValueKind kind) {
+        switch(kind) {
+            case ValueKind::NIL: return "nil";
+            case ValueKind::BOOL: return "bool";
+            case ValueKind::INT: return "int";
+            case ValueKind::FLOAT: return "float";
+            case ValueKind::STRING: return "string";
+            case ValueKind::LIST: return "list";
+            case ValueKind::MODULE: return "module";
+            case ValueKind::FUNCTION: return "function";
+            case ValueKind::NATIVE: return "function";
+        }
+        return "?";
+    }
+
+    namespace {
+        //lists nested deeper than this print as [...] too, rather than run out of stack
+        constexpr std::size_t MAX_PRINT_DEPTH = 1000;
+
+        //printing holds the lists being printed, outermost first - a list that contains itself
+        //prints as [...] the second time round
+        void append_value(std::string &out, const Value &value, std::vector<const List*> &printing) {
+            char buffer[32];
+
+            switch(value.kind()) {
+                case ValueKind::NIL:
+                    out += "nil";
+                    break;
+
+                case ValueKind::BOOL:
+                    out += value.as_bool() ? "true" : "false";
+                    break;
+
+                case ValueKind::INT: {
+                    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value.as_int());
+                    out.append(buffer, end);
+                    break;
+                }
+
+                case ValueKind::FLOAT: {
+                    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value.as_float());
+                    std::string_view text(buffer, end - buffer);
+                    out += text;
+                    //keep floats recognisable - 2.0 rather than 2
+                    if(text.find_first_of(".ein") == std::string_view::npos)
+                        out += ".0";
+                    break;
+                }
+
+                case ValueKind::STRING:
+                    out += value.as_string()->view();
+                    break;
+
+                case ValueKind::LIST: {
+                    const List *list = value.as_list();
+                    if( (printing.size() >= MAX_PRINT_DEPTH) || (std::find(printing.begin(), printing.end(), list) != printing.end()) ) {
+                        out += "[...]";
+                        break;
+                    }
+                    printing.push_back(list);
+
+                    out += "[";
+                    bool first = true;
+                    for(const Value &item : list->items) {
+                        if(!first)
+                            out += ", ";
+                        first = false;
+
+                        if(item.is_string()) {
+                            out += "\"";
+                            out += item.as_string()->view();
+                            out += "\"";
+                        } else {
+                            append_value(out, item, printing);
+                        }
+                    }
+                    out += "]";
+
+                    printing.pop_back();
+                    break;
+                }
+
+                case ValueKind::MODULE:
+                    out += "<module ";
+                    out += value.as_module()->name;
+                    out += ">";
+                    break;
+
+                case ValueKind::FUNCTION:
+                    out += "<fn ";
+                    out += value.as_function()->name();
+                    out += ">";
+                    break;
+
+                case ValueKind::NATIVE:
+                    out += "<native ";
+                    out += value.as_native()->name;
+                    out += ">";
+                    break;
+            }
+        }
+    }
+
+    void append_value(std::string &out, const Value &value) {
+        std::vector<const List*> printing;
+        append_value(out, value, printing);
+    }
+
+    std::string to_string(const Value &value) {
+        std::string out;
+        append_value(out, value);
+        return out;
+    }
+
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace torq {
+
+    class VM;
+    struct Function;
+    struct Native;
+    struct FormatStep;
+
+    enum class ValueKind : uint8_t { NIL, BOOL, INT, FLOAT, STRING, LIST, MODULE, FUNCTION, NATIVE };
+
+    enum class ObjectKind : uint8_t { STRING, LIST, MODULE, INT };
+
+    //header shared by everything the collector manages
+    struct Object {
+        ObjectKind kind;
+        bool marked;
+        Object *next;
+    };
+
+    //immutable. Program constants point their chars into the program's string data, heap
+    //strings carry their chars directly after the header
+    struct Str : Object {
+        uint32_t length;
+        uint32_t format_size;
+        const char *chars;
+        const FormatStep *format;   //the parsed format of a program constant print is given
+
+        std::string_view view() const { return std::string_view(chars, length); }
+    };
+
+    class Value;
+
+    struct List : Object {
+        std::vector<Value> items;
+    };
+
+    struct Module : Object {
+        std::string_view name;
+        std::unordered_map<std::string_view, Value> members;
+    };
+
+
+    //ints that don't fit a Value's 48 bit payload
+    struct BoxedInt : Object {
+        int64_t value;
+    };
+
+
+    //one NaN-boxed 64 bit word. Doubles are stored as themselves, with every NaN folded into
+    //one canonical quiet NaN. Everything else lives in the NaN space above that: the top 13
+    //bits set, a 3 bit tag, then a 48 bit payload - a sign extended int, a pointer, or for
+    //the special tag nil/false/true. Ints outside 48 bits are boxed on the heap by the VM,
+    //see VM::integer(). All access goes through these members, so the interpreter never
+    //depends on the layout
+    class Value {
+      private:
+        enum Tag : uint64_t { SPECIAL, FUNCTION, SMALL_INT, BOXED_INT, STRING, LIST, MODULE, NATIVE };
+
+        static constexpr uint64_t BOXED = 0xFFF8000000000000ull;
+        static constexpr uint64_t PAYLOAD = 0x0000FFFFFFFFFFFFull;
+        static constexpr uint64_t CANONICAL_NAN = 0x7FF8000000000000ull;
+
+        //the special tag's payload is 0 for nil, 1 for false and 3 for true
+        static constexpr uint64_t NIL_BITS = BOXED;
+        static constexpr uint64_t FALSE_BITS = BOXED | 1;
+        static constexpr uint64_t TRUE_BITS = BOXED | 3;
+
+        static constexpr uint64_t tagged(Tag tag) { return BOXED | (static_cast<uint64_t>(tag) << 48); }
+
+        uint64_t bits;
+
+        explicit constexpr Value(uint64_t bits, int) : bits(bits) {}
+
+        static Value pointer(Tag tag, const void *p) { return Value(tagged(tag) | reinterpret_cast<uintptr_t>(p), 0); }
+        bool has(Tag tag) const { return (bits >> 48) == (tagged(tag) >> 48); }
+        void* payload() const { return reinterpret_cast<void*>(bits & PAYLOAD); }
+
+      public:
+        static constexpr int64_t MIN_SMALL_INT = -(int64_t(1) << 47);
+        static constexpr int64_t MAX_SMALL_INT = (int64_t(1) << 47) - 1;
+
+        constexpr Value() : bits(NIL_BITS) {}
+
+        static Value nil() { return Value(); }
+        static Value boolean(bool b) { return Value(b ? TRUE_BITS : FALSE_BITS, 0); }
+        static Value number(double f) { return Value( (f != f) ? CANONICAL_NAN : std::bit_cast<uint64_t>(f), 0); }
+        static Value string(Str *s) { return pointer(STRING, s); }
+        static Value list(List *l) { return pointer(LIST, l); }
+        static Value module(Module *m) { return pointer(MODULE, m); }
+        static Value function(const Function *fn) { return pointer(FUNCTION, fn); }
+        static Value native(const Native *n) { return pointer(NATIVE, n); }
+
+        //ints are only built through these two, anything that may not fit goes through the VM
+        static bool fits(int64_t i) { return (i >= MIN_SMALL_INT) && (i <= MAX_SMALL_INT); }
+        static Value small_int(int64_t i) { return Value(tagged(SMALL_INT) | (static_cast<uint64_t>(i) & PAYLOAD), 0); }
+        static Value boxed_int(BoxedInt *b) { return pointer(BOXED_INT, b); }
+
+        ValueKind kind() const;
+
+        bool is_nil() const { return bits == NIL_BITS; }
+        bool is_bool() const { return (bits & ~uint64_t(2)) == FALSE_BITS; }
+        bool is_int() const { return (bits >> 49) == (tagged(SMALL_INT) >> 49); }
+        bool is_small_int() const { return has(SMALL_INT); }
+        bool is_float() const { return bits < BOXED; }
+        bool is_number() const { return is_float() || is_int(); }
+        bool is_string() const { return has(STRING); }
+        bool is_list() const { return has(LIST); }
+        bool is_module() const { return has(MODULE); }
+        bool is_function() const { return has(FUNCTION); }
+        bool is_native() const { return has(NATIVE); }
+        //boxed ints, strings, lists and modules - the collector's objects
+        bool is_object() const { return (bits >> 48) - (tagged(BOXED_INT) >> 48) <= MODULE - BOXED_INT; }
+
+        bool as_bool() const { return (bits >> 1) & 1; }
+        int64_t as_int() const {
+            if(has(SMALL_INT))
+                return static_cast<int64_t>(bits << 16) >> 16;
+            return static_cast<const BoxedInt*>(payload())->value;
+        }
+        double as_float() const { return std::bit_cast<double>(bits); }
+        double as_number() const { return is_float() ? as_float() : static_cast<double>(as_int()); }
+        Str* as_string() const { return static_cast<Str*>(payload()); }
+        List* as_list() const { return static_cast<List*>(payload()); }
+        Module* as_module() const { return static_cast<Module*>(payload()); }
+        Object* as_object() const { return static_cast<Object*>(payload()); }
+        const Function* as_function() const { return static_cast<const Function*>(payload()); }
+        const Native* as_native() const { return static_cast<const Native*>(payload()); }
+
+        //nil and false are false, everything else is true
+        bool truthy() const { return (bits & ~uint64_t(1)) != NIL_BITS; }
+
+        //identity for objects, value for everything else. Ints and floats compare numerically
+        bool equals(const Value &other) const;
+    };
+
+    static_assert(sizeof(Value) == 8, "Value should be one 64 bit word");
+    static_assert(sizeof(void*) == 8, "pointers are stored in 48 bits of a Value");
+
+
+    const char* value_kind_name(ValueKind kind);
+
+    //the text print() and str() produce
+    void append_value(std::string &out, const Value &value);
+    std::string to_string(const Value &value);
+
+}
@@ -0,0 +1,1168 @@
+#include "vm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+//labels-as-values dispatch where the compiler has it, a plain switch everywhere else
+#if defined(__GNUC__) && !defined(TORQ_NO_COMPUTED_GOTO)
+    #define TORQ_COMPUTED_GOTO 1
+#else
+    #define TORQ_COMPUTED_GOTO 0
+#endif
+
+namespace torq {
+
+    namespace {
+
+        constexpr std::size_t MIN_COLLECTION = 1024 * 1024;
+
+        //integer arithmetic wraps rather than trapping
+        inline int64_t wrap_add(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b)); }
+        inline int64_t wrap_sub(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b)); }
+        inline int64_t wrap_mul(int64_t a, int64_t b) { return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b)); }
+
+        //what an object counts for towards the next collection
+        std::size_t object_size(const Object *object) {
+            switch(object->kind) {
+                case ObjectKind::STRING: return sizeof(Str) + static_cast<const Str*>(object)->length;
+                case ObjectKind::LIST: return sizeof(List);
+                case ObjectKind::MODULE: return sizeof(Module);
+                case ObjectKind::INT: return sizeof(BoxedInt);
+            }
+            return 0;
+        }
+
+        std::string operand_error(const char *what, const Value &left, const Value &right) {
+            std::string message = "cannot ";
+            message += what;
+            message += " ";
+            message += value_kind_name(left.kind());
+            message += " and ";
+            message += value_kind_name(right.kind());
+            return message;
+        }
+
+        bool list_slot(const List *list, const Value &index, std::size_t &slot, std::string &message) {
+            if(!index.is_int()) {
+                message = "list index must be an int, not ";
+                message += value_kind_name(index.kind());
+                return false;
+            }
+            int64_t i = index.as_int();
+            if( (i < 0) || (static_cast<uint64_t>(i) >= list->items.size()) ) {
+                message = "list index " + std::to_string(i) + " out of range";
+                return false;
+            }
+            slot = static_cast<std::size_t>(i);
+            return true;
+        }
+
+    }
+
+
+    VM::VM(std::ostream &sink) : stack(new Value[STACK_SIZE]), top(stack.get()), objects(nullptr),
+        allocated(0), next_collection(MIN_COLLECTION), sink(sink) {
+        frames.reserve(MAX_FRAMES);
+        register_builtins(*this);
+    }
+
+    VM::~VM() {
+        flush();
+        while(objects) {
+            Object *next = objects->next;
+            free_object(objects);
+            objects = next;
+        }
+    }
+
+    bool VM::enable_jit() {
+        if(!Jit::available())
+            return false;
+        if(!native)
+            native = std::make_unique<Jit>();
+        return true;
+    }
+
+    Profiler* VM::enable_profile() {
+        if(!profiler)
+            profiler = std::make_unique<Profiler>();
+        return profiler.get();
+    }
+
+    void VM::profile_sample(const Instr *pc) {
+        //suspended frames are at the call they made, the innermost at pc
+        std::vector<Profiler::Frame> stack;
+        stack.reserve(frames.size());
+        for(std::size_t i = 0; i < frames.size(); i++) {
+            const Function *function = frames[i].function;
+            const Instr *at = (i + 1 < frames.size()) ? frames[i].pc : pc;
+            stack.push_back({function, static_cast<uint32_t>(at - 1 - function->program->code.data())});
+        }
+        profiler->sample(stack);
+    }
+
+    Value VM::global(std::string_view name) const {
+        auto it = globals.find(name);
+        return (it != globals.end()) ? it->second : Value();
+    }
+
+    void VM::flush() {
+        if(!output.empty()) {
+            sink.write(output.data(), output.size());
+            sink.flush();
+            output.clear();
+        }
+    }
+
+
+    bool VM::run(const Program &program) {
+        last_error = RuntimeError{};
+        frames.clear();
+
+        bool ok = execute(&program.function_objects[0], stack.get());
+
+        frames.clear();
+        top = stack.get();
+        flush();
+        return ok;
+    }
+
+    bool VM::run_module(const Program &program, std::string_view name) {
+        Module *module = new_module(name);
+        define_module(name, Value::module(module));
+        module_scopes[&program] = module;
+        scope_version++;
+
+        return run(program);
+    }
+
+    VM::Scope* VM::scope_of(const Program *program) {
+        auto it = module_scopes.find(program);
+        return (it != module_scopes.end()) ? &it->second->members : &globals;
+    }
+
+    VM::GlobalCache* VM::caches_of(const Program *program) {
+        std::vector<GlobalCache> &caches = global_caches[program];
+        if(caches.empty())
+            caches.resize(program->code.size());
+        return caches.data();
+    }
+
+    Value* VM::builtin(std::string_view name) {
+        auto std_module = modules.find("std");
+        if(std_module == modules.end())
+            return nullptr;
+
+        Scope &members = std_module->second.as_module()->members;
+        auto it = members.find(name);
+        return (it != members.end()) ? &it->second : nullptr;
+    }
+
+    void VM::error_at(const Function *function, const Instr *pc, std::string message) {
+        const Program *program = function->program;
+        last_error.message = std::move(message);
+        last_error.file = program->name;
+        last_error.location = program->location(static_cast<uint32_t>(pc - 1 - program->code.data()));
+    }
+
+
+    bool VM::execute(const Function *entry, Value *base) {
+        const Function *function = entry;
+        const Program *program = function->program;
+        const Value *constants = program->constants.data();
+        Scope *scope = scope_of(program);
+        GlobalCache *caches = caches_of(program);
+        Jit::Site *sites = native ? native->sites(program) : nullptr;
+        Profiler *profiling = profiler.get();
+        const Instr *pc = function->code();
+        Instr instr;
+
+        const std::size_t entry_depth = frames.size();
+        {
+            const FunctionProto &proto = function->proto();
+            Value *frame_top = base + proto.registers;
+            for(Value *r = base + proto.params; r < frame_top; r++)
+                *r = Value();
+            top = std::max(top, frame_top);
+            frames.push_back({function, nullptr, base, top, nullptr});
+        }
+
+        #define RA (base[arg_a(instr)])
+        #define RB (base[arg_b(instr)])
+        #define RC (base[arg_c(instr)])
+
+        #define THROW(message) do { error_at(function, pc, message); return false; } while(0)
+        #define CHECK(call) do { if(!(call)) THROW(std::move(last_error.message)); } while(0)
+
+        //pc has just reached a loop header or a function entry. Once it's hot, the code from
+        //there to last runs natively until it hands back the instruction to carry on at
+        #define HOT(last) do { \
+                if(sites) { \
+                    uint32_t at = static_cast<uint32_t>(pc - program->code.data()); \
+                    Jit::Site &site = sites[at]; \
+                    if( site.entry || ((--site.countdown == 0) && native->compile(*program, site, at, last)) ) \
+                        pc = program->code.data() + native->run(site, base); \
+                } \
+            } while(0)
+
+        //after a taken jump - a backwards one closes a loop ending at the jump itself
+        #define BACK_EDGE() do { \
+                if(arg_sbx(instr) < 0) \
+                    HOT(static_cast<uint32_t>(pc - arg_sbx(instr) - 1 - program->code.data())); \
+            } while(0)
+
+        //int op int stays an int, any other mix of numbers is a float. op is spelled out, as
+        //the instruction may be the first part of a superinstruction
+        #define ARITH(op, int_expr, float_expr) { \
+                const Value &left = RB, &right = RC; \
+                if(left.is_int() && right.is_int()) { \
+                    int64_t x = left.as_int(), y = right.as_int(); \
+                    RA = integer(int_expr); \
+                } else if(left.is_number() && right.is_number()) { \
+                    double x = left.as_number(), y = right.as_number(); \
+                    RA = Value::number(float_expr); \
+                } else { \
+                    Value result; \
+                    CHECK(arith(op, left, right, result)); \
+                    RA = result; \
+                } \
+            }
+
+        #define COMPARE(op, cmp) { \
+                const Value &left = RB, &right = RC; \
+                if(left.is_int() && right.is_int()) { \
+                    RA = Value::boolean(left.as_int() cmp right.as_int()); \
+                } else if(left.is_number() && right.is_number()) { \
+                    RA = Value::boolean(left.as_number() cmp right.as_number()); \
+                } else { \
+                    bool result; \
+                    CHECK(compare(op, left, right, result)); \
+                    RA = Value::boolean(result); \
+                } \
+            }
+
+        //the instructions is_step() lets a superinstruction run before its last part. Each
+        //is the whole of its own TARGET too
+        #define STEP_MOVE() RA = RB
+        #define STEP_LOADNIL() RA = Value()
+        #define STEP_LOADBOOL() RA = Value::boolean(arg_b(instr) != 0)
+        #define STEP_LOADINT() RA = Value::small_int(arg_sbx(instr))
+        #define STEP_LOADK() RA = constants[arg_bx(instr)]
+        #define STEP_LOADSTR() RA = Value::string(const_cast<Str*>(&program->strings[arg_bx(instr)]))
+        #define STEP_GETGLOBAL() do { \
+                GlobalCache &cache = caches[pc - 1 - program->code.data()]; \
+                if(cache.version != scope_version) [[unlikely]] { \
+                    std::string_view name = program->string(arg_bx(instr)); \
+                    auto it = scope->find(name); \
+                    Value *slot = (it != scope->end()) ? &it->second : nullptr; \
+                    /* modules see the builtins, but not the entry script's globals */ \
+                    if(!slot && (scope != &globals)) \
+                        slot = builtin(name); \
+                    if(!slot) \
+                        THROW("undefined name '" + std::string(name) + "'"); \
+                    cache = {slot, scope_version}; \
+                } \
+                RA = *cache.slot; \
+            } while(0)
+        #define STEP_GETINDEX() do { \
+                Value result; \
+                CHECK(get_index(RB, RC, result)); \
+                RA = result; \
+            } while(0)
+        #define STEP_ADD() ARITH(Op::ADD, wrap_add(x, y), x + y)
+        #define STEP_SUB() ARITH(Op::SUB, wrap_sub(x, y), x - y)
+        #define STEP_MUL() ARITH(Op::MUL, wrap_mul(x, y), x * y)
+        #define STEP_EQ() RA = Value::boolean(RB.equals(RC))
+        #define STEP_NE() RA = Value::boolean(!RB.equals(RC))
+        #define STEP_LT() COMPARE(Op::LT, <)
+        #define STEP_LE() COMPARE(Op::LE, <=)
+        #define STEP_NOT() RA = Value::boolean(!RB.truthy())
+        #define STEP_ADD_I64() RA = integer(wrap_add(RB.as_int(), RC.as_int()))
+        #define STEP_SUB_I64() RA = integer(wrap_sub(RB.as_int(), RC.as_int()))
+        #define STEP_MUL_I64() RA = integer(wrap_mul(RB.as_int(), RC.as_int()))
+        #define STEP_DIV_I64() do { \
+                int64_t y = RC.as_int(); \
+                if(y == 0) \
+                    THROW("division by zero"); \
+                RA = integer( (y == -1) ? wrap_sub(0, RB.as_int()) : RB.as_int() / y ); \
+            } while(0)
+        #define STEP_MOD_I64() do { \
+                int64_t y = RC.as_int(); \
+                if(y == 0) \
+                    THROW("division by zero"); \
+                RA = integer( (y == -1) ? 0 : RB.as_int() % y ); \
+            } while(0)
+        #define STEP_ADD_F64() RA = Value::number(RB.as_float() + RC.as_float())
+        #define STEP_SUB_F64() RA = Value::number(RB.as_float() - RC.as_float())
+        #define STEP_MUL_F64() RA = Value::number(RB.as_float() * RC.as_float())
+        #define STEP_DIV_F64() RA = Value::number(RB.as_float() / RC.as_float())
+        #define STEP_MOD_F64() RA = Value::number(std::fmod(RB.as_float(), RC.as_float()))
+        #define STEP_NEG_I64() RA = integer(wrap_sub(0, RB.as_int()))
+        #define STEP_NEG_F64() RA = Value::number(-RB.as_float())
+        #define STEP_EQ_I64() RA = Value::boolean(RB.as_int() == RC.as_int())
+        #define STEP_NE_I64() RA = Value::boolean(RB.as_int() != RC.as_int())
+        #define STEP_LT_I64() RA = Value::boolean(RB.as_int() < RC.as_int())
+        #define STEP_LE_I64() RA = Value::boolean(RB.as_int() <= RC.as_int())
+        #define STEP_EQ_F64() RA = Value::boolean(RB.as_float() == RC.as_float())
+        #define STEP_NE_F64() RA = Value::boolean(RB.as_float() != RC.as_float())
+        #define STEP_LT_F64() RA = Value::boolean(RB.as_float() < RC.as_float())
+        #define STEP_LE_F64() RA = Value::boolean(RB.as_float() <= RC.as_float())
+        #define STEP_TOF64() RA = Value::number(static_cast<double>(RB.as_int()))
+        #define STEP_GUARD_I64() do { \
+                if(!RA.is_int()) \
+                    THROW(std::string("expected an int, got ") + value_kind_name(RA.kind())); \
+            } while(0)
+        #define STEP_GUARD_F64() do { \
+                if(RA.is_int()) \
+                    RA = Value::number(static_cast<double>(RA.as_int())); \
+                else if(!RA.is_float()) \
+                    THROW(std::string("expected a float, got ") + value_kind_name(RA.kind())); \
+            } while(0)
+
+        //for --stats, one add per instruction the interpreter runs
+        #if TORQ_STATS
+            #define COUNT_INSTRUCTION() executed++
+        #else
+            #define COUNT_INSTRUCTION() do {} while(0)
+        #endif
+
+        //for --profile, the instruction about to run - the sample waits for the timer's flag
+        #define PROFILE() do { \
+                profiling->count(pc - 1, function->code() + function->proto().code_size); \
+                if(Profiler::due()) \
+                    profile_sample(pc); \
+            } while(0)
+
+        #if TORQ_COMPUTED_GOTO
+            static const void *const dispatch_table[] = {
+                #define TORQ_OPCODE_LABEL(name, format) &&op_##name,
+                #define TORQ_PAIR_LABEL(name, first, second) &&op_##name,
+                #define TORQ_TRIPLE_LABEL(name, first, second, third) &&op_##name,
+                TORQ_OPCODES(TORQ_OPCODE_LABEL)
+                TORQ_SUPERINSTRUCTIONS(TORQ_PAIR_LABEL, TORQ_TRIPLE_LABEL)
+                #undef TORQ_OPCODE_LABEL
+                #undef TORQ_PAIR_LABEL
+                #undef TORQ_TRIPLE_LABEL
+            };
+
+            //the same, through the profiler first. Choosing the table once keeps the
+            //unprofiled dispatch as it was
+            static const void *const counting_table[] = {
+                #define TORQ_OPCODE_LABEL(name, format) &&count_##name,
+                #define TORQ_PAIR_LABEL(name, first, second) &&count_##name,
+                #define TORQ_TRIPLE_LABEL(name, first, second, third) &&count_##name,
+                TORQ_OPCODES(TORQ_OPCODE_LABEL)
+                TORQ_SUPERINSTRUCTIONS(TORQ_PAIR_LABEL, TORQ_TRIPLE_LABEL)
+                #undef TORQ_OPCODE_LABEL
+                #undef TORQ_PAIR_LABEL
+                #undef TORQ_TRIPLE_LABEL
+            };
+            const void *const *table = profiling ? counting_table : dispatch_table;
+
+            #define TARGET(name) case Op::name: op_##name:
+            #define DISPATCH() do { COUNT_INSTRUCTION(); instr = *pc++; goto *table[static_cast<uint8_t>(op_of(instr))]; } while(0)
+            #define LAST_PART(name) goto op_##name
+        #else
+            #define TARGET(name) case Op::name:
+            #define DISPATCH() break
+            #define LAST_PART(name) goto run_instruction
+        #endif
+
+        //a superinstruction runs its parts back to back, the last one through its own TARGET
+        #define PAIR_TARGET(name, first, second) TARGET(name) { \
+                STEP_##first(); \
+                instr = *pc++; \
+                LAST_PART(second); \
+            }
+        #define TRIPLE_TARGET(name, first, second, third) TARGET(name) { \
+                STEP_##first(); \
+                instr = *pc++; \
+                STEP_##second(); \
+                instr = *pc++; \
+                LAST_PART(third); \
+            }
+
+        for(;;) {
+            COUNT_INSTRUCTION();
+            instr = *pc++;
+            if(profiling)
+                PROFILE();
+
+        #if !TORQ_COMPUTED_GOTO
+          run_instruction:
+        #endif
+            switch(op_of(instr)) {
+                TARGET(MOVE) {
+                    STEP_MOVE();
+                    DISPATCH();
+                }
+
+                TARGET(LOADNIL) {
+                    STEP_LOADNIL();
+                    DISPATCH();
+                }
+
+                TARGET(LOADBOOL) {
+                    STEP_LOADBOOL();
+                    DISPATCH();
+                }
+
+                TARGET(LOADINT) {
+                    STEP_LOADINT();
+                    DISPATCH();
+                }
+
+                TARGET(LOADK) {
+                    STEP_LOADK();
+                    DISPATCH();
+                }
+
+                TARGET(LOADI64) {
+                    RA = integer(wide_constant(constants, arg_bx(instr)));
+                    DISPATCH();
+                }
+
+                TARGET(LOADSTR) {
+                    STEP_LOADSTR();
+                    DISPATCH();
+                }
+
+                TARGET(LOADFN) {
+                    RA = Value::function(&program->function_objects[arg_bx(instr)]);
+                    DISPATCH();
+                }
+
+                TARGET(GETGLOBAL) {
+                    STEP_GETGLOBAL();
+                    DISPATCH();
+                }
+
+                TARGET(SETGLOBAL) {
+                    GlobalCache &cache = caches[pc - 1 - program->code.data()];
+                    if(cache.version != scope_version) [[unlikely]] {
+                        auto [it, inserted] = scope->try_emplace(program->string(arg_bx(instr)));
+                        if(inserted)
+                            scope_version++;
+                        cache = {&it->second, scope_version};
+                    }
+                    *cache.slot = RA;
+                    DISPATCH();
+                }
+
+                TARGET(IMPORT) {
+                    auto it = modules.find(program->string(arg_bx(instr)));
+                    if(it == modules.end())
+                        THROW("no module named '" + std::string(program->string(arg_bx(instr))) + "'");
+                    RA = it->second;
+                    DISPATCH();
+                }
+
+                TARGET(NEWLIST) {
+                    List *list = new_list();
+                    list->items.assign(&RB, &RB + arg_c(instr));
+                    RA = Value::list(list);
+                    DISPATCH();
+                }
+
+                TARGET(GETINDEX) {
+                    STEP_GETINDEX();
+                    DISPATCH();
+                }
+
+                TARGET(SETINDEX) {
+                    CHECK(set_index(RA, RB, RC));
+                    DISPATCH();
+                }
+
+                TARGET(ADD) {
+                    STEP_ADD();
+                    DISPATCH();
+                }
+
+                TARGET(SUB) {
+                    STEP_SUB();
+                    DISPATCH();
+                }
+
+                TARGET(MUL) {
+                    STEP_MUL();
+                    DISPATCH();
+                }
+
+                TARGET(DIV) {
+                    const Value &left = RB, &right = RC;
+                    if(left.is_int() && right.is_int()) {
+                        int64_t y = right.as_int();
+                        if(y == 0)
+                            THROW("division by zero");
+                        RA = integer( (y == -1) ? wrap_sub(0, left.as_int()) : left.as_int() / y );
+                    } else if(left.is_number() && right.is_number()) {
+                        RA = Value::number(left.as_number() / right.as_number());
+                    } else {
+                        THROW(operand_error("divide", left, right));
+                    }
+                    DISPATCH();
+                }
+
+                TARGET(MOD) {
+                    const Value &left = RB, &right = RC;
+                    if(left.is_int() && right.is_int()) {
+                        int64_t y = right.as_int();
+                        if(y == 0)
+                            THROW("division by zero");
+                        RA = integer( (y == -1) ? 0 : left.as_int() % y );
+                    } else if(left.is_number() && right.is_number()) {
+                        RA = Value::number(std::fmod(left.as_number(), right.as_number()));
+                    } else {
+                        THROW(operand_error("take the remainder of", left, right));
+                    }
+                    DISPATCH();
+                }
+
+                TARGET(NEG) {
+                    const Value &operand = RB;
+                    if(operand.is_int())
+                        RA = integer(wrap_sub(0, operand.as_int()));
+                    else if(operand.is_float())
+                        RA = Value::number(-operand.as_float());
+                    else
+                        THROW(std::string("cannot negate ") + value_kind_name(operand.kind()));
+                    DISPATCH();
+                }
+
+                TARGET(NOT) {
+                    STEP_NOT();
+                    DISPATCH();
+                }
+
+                TARGET(EQ) {
+                    STEP_EQ();
+                    DISPATCH();
+                }
+
+                TARGET(NE) {
+                    STEP_NE();
+                    DISPATCH();
+                }
+
+                TARGET(LT) {
+                    STEP_LT();
+                    DISPATCH();
+                }
+
+                TARGET(LE) {
+                    STEP_LE();
+                    DISPATCH();
+                }
+
+                TARGET(JMP) {
+                    pc += arg_sbx(instr);
+                    BACK_EDGE();
+                    DISPATCH();
+                }
+
+                TARGET(JMPIF) {
+                    if(RA.truthy()) {
+                        pc += arg_sbx(instr);
+                        BACK_EDGE();
+                    }
+                    DISPATCH();
+                }
+
+                TARGET(JMPIFNOT) {
+                    if(!RA.truthy()) {
+                        pc += arg_sbx(instr);
+                        BACK_EDGE();
+                    }
+                    DISPATCH();
+                }
+
+                TARGET(FORPREP) {
+                    Value *r = &RA;
+                    if(r[0].is_int() && r[1].is_int() && r[2].is_int()) {
+                        int64_t step = r[2].as_int();
+                        if(step == 0)
+                            THROW("for loop step is zero");
+                        if( (step > 0) ? (r[0].as_int() <= r[1].as_int()) : (r[0].as_int() >= r[1].as_int()) )
+                            r[3] = r[0];
+                        else
+                            pc += arg_sbx(instr);
+                    } else if(r[0].is_number() && r[1].is_number() && r[2].is_number()) {
+                        //any float makes the whole loop run in floats
+                        double start = r[0].as_number(), limit = r[1].as_number(), step = r[2].as_number();
+                        if(step == 0.0)
+                            THROW("for loop step is zero");
+                        r[0] = Value::number(start);
+                        r[1] = Value::number(limit);
+                        r[2] = Value::number(step);
+                        if( (step > 0.0) ? (start <= limit) : (start >= limit) )
+                            r[3] = r[0];
+                        else
+                            pc += arg_sbx(instr);
+                    } else {
+                        THROW("for loop start, limit and step must be numbers");
+                    }
+                    DISPATCH();
+                }
+
+                TARGET(FORLOOP) {
+                    Value *r = &RA;
+                    if(r[0].is_int()) {
+                        int64_t step = r[2].as_int(), i;
+                        if( !__builtin_add_overflow(r[0].as_int(), step, &i) &&
+                            ((step > 0) ? (i <= r[1].as_int()) : (i >= r[1].as_int())) ) {
+                            r[0] = r[3] = integer(i);
+                            pc += arg_sbx(instr);
+                        }
+                    } else {
+                        double step = r[2].as_float(), i = r[0].as_float() + step;
+                        if( (step > 0.0) ? (i <= r[1].as_float()) : (i >= r[1].as_float()) ) {
+                            r[0] = r[3] = Value::number(i);
+                            pc += arg_sbx(instr);
+                        }
+                    }
+                    DISPATCH();
+                }
+
+                TARGET(CALL) {
+                    Value callee = RA;
+                    Value *args = &RA + 1;
+                    int count = arg_b(instr);
+
+                    if(callee.is_function()) {
+                        const Function *target = callee.as_function();
+                        const FunctionProto &proto = target->proto();
+
+                        if(count != proto.params)
+                            THROW(std::string(target->name()) + "() takes " + std::to_string(proto.params) +
+                                " arguments, got " + std::to_string(count));
+
+                        Value *frame_top = args + proto.registers;
+                        if( (frames.size() >= MAX_FRAMES) || (frame_top > stack.get() + STACK_SIZE) )
+                            THROW("stack overflow");
+
+                        for(Value *r = args + count; r < frame_top; r++)
+                            *r = Value();
+
+                        frames.back().pc = pc;
+                        top = std::max(top, frame_top);
+                        frames.push_back({target, nullptr, args, top, &RA});
+
+                        function = target;
+                        if(target->program != program) {
+                            program = target->program;
+                            constants = program->constants.data();
+                            scope = scope_of(program);
+                            caches = caches_of(program);
+                            if(sites)
+                                sites = native->sites(program);
+                        }
+                        base = args;
+                        pc = target->code();
+                        HOT(proto.code_start + proto.code_size - 1);
+                        DISPATCH();
+                    }
+
+                    if(callee.is_native()) {
+                        Value result;
+                        CHECK(callee.as_native()->fn(*this, args, count, result));
+                        RA = result;
+                        DISPATCH();
+                    }
+
+                    THROW(std::string("cannot call a ") + value_kind_name(callee.kind()));
+                }
+
+                TARGET(RETURN) {
+                    Value result = arg_b(instr) ? RA : Value();
+                    Value *dest = frames.back().result;
+                    frames.pop_back();
+
+                    if(frames.size() == entry_depth) {
+                        if(dest)
+                            *dest = result;
+                        return true;
+                    }
+
+                    *dest = result;
+
+                    const Frame &caller = frames.back();
+                    function = caller.function;
+                    if(function->program != program) {
+                        program = function->program;
+                        constants = program->constants.data();
+                        scope = scope_of(program);
+                        caches = caches_of(program);
+                        if(sites)
+                            sites = native->sites(program);
+                    }
+                    base = caller.base;
+                    top = caller.top;
+                    pc = caller.pc;
+                    DISPATCH();
+                }
+
+                TARGET(ADD_I64) {
+                    STEP_ADD_I64();
+                    DISPATCH();
+                }
+
+                TARGET(SUB_I64) {
+                    STEP_SUB_I64();
+                    DISPATCH();
+                }
+
+                TARGET(MUL_I64) {
+                    STEP_MUL_I64();
+                    DISPATCH();
+                }
+
+                TARGET(DIV_I64) {
+                    STEP_DIV_I64();
+                    DISPATCH();
+                }
+
+                TARGET(MOD_I64) {
+                    STEP_MOD_I64();
+                    DISPATCH();
+                }
+
+                TARGET(ADD_F64) {
+                    STEP_ADD_F64();
+                    DISPATCH();
+                }
+
+                TARGET(SUB_F64) {
+                    STEP_SUB_F64();
+                    DISPATCH();
+                }
+
+                TARGET(MUL_F64) {
+                    STEP_MUL_F64();
+                    DISPATCH();
+                }
+
+                TARGET(DIV_F64) {
+                    STEP_DIV_F64();
+                    DISPATCH();
+                }
+
+                TARGET(MOD_F64) {
+                    STEP_MOD_F64();
+                    DISPATCH();
+                }
+
+                TARGET(NEG_I64) {
+                    STEP_NEG_I64();
+                    DISPATCH();
+                }
+
+                TARGET(NEG_F64) {
+                    STEP_NEG_F64();
+                    DISPATCH();
+                }
+
+                TARGET(EQ_I64) {
+                    STEP_EQ_I64();
+                    DISPATCH();
+                }
+
+                TARGET(NE_I64) {
+                    STEP_NE_I64();
+                    DISPATCH();
+                }
+
+                TARGET(LT_I64) {
+                    STEP_LT_I64();
+                    DISPATCH();
+                }
+
+                TARGET(LE_I64) {
+                    STEP_LE_I64();
+                    DISPATCH();
+                }
+
+                TARGET(EQ_F64) {
+                    STEP_EQ_F64();
+                    DISPATCH();
+                }
+
+                TARGET(NE_F64) {
+                    STEP_NE_F64();
+                    DISPATCH();
+                }
+
+                TARGET(LT_F64) {
+                    STEP_LT_F64();
+                    DISPATCH();
+                }
+
+                TARGET(LE_F64) {
+                    STEP_LE_F64();
+                    DISPATCH();
+                }
+
+                TARGET(TOF64) {
+                    STEP_TOF64();
+                    DISPATCH();
+                }
+
+                TARGET(FORPREP_I64) {
+                    Value *r = &RA;
+                    int64_t step = r[2].as_int();
+                    if(step == 0)
+                        THROW("for loop step is zero");
+                    if( (step > 0) ? (r[0].as_int() <= r[1].as_int()) : (r[0].as_int() >= r[1].as_int()) )
+                        r[3] = r[0];
+                    else
+                        pc += arg_sbx(instr);
+                    DISPATCH();
+                }
+
+                TARGET(FORLOOP_I64) {
+                    Value *r = &RA;
+                    int64_t step = r[2].as_int(), i;
+                    if( !__builtin_add_overflow(r[0].as_int(), step, &i) &&
+                        ((step > 0) ? (i <= r[1].as_int()) : (i >= r[1].as_int())) ) {
+                        r[0] = r[3] = integer(i);
+                        pc += arg_sbx(instr);
+                        BACK_EDGE();
+                    }
+                    DISPATCH();
+                }
+
+                TARGET(GUARD_I64) {
+                    STEP_GUARD_I64();
+                    DISPATCH();
+                }
+
+                TARGET(GUARD_F64) {
+                    STEP_GUARD_F64();
+                    DISPATCH();
+                }
+
+                TARGET(GUARD_STR) {
+                    if(!RA.is_string())
+                        THROW(std::string("expected a string, got ") + value_kind_name(RA.kind()));
+                    DISPATCH();
+                }
+
+                TORQ_SUPERINSTRUCTIONS(PAIR_TARGET, TRIPLE_TARGET)
+
+                default:
+                    THROW("invalid instruction");
+            }
+        }
+
+        #if TORQ_COMPUTED_GOTO
+            #define TORQ_OPCODE_LABEL(name, format) count_##name: PROFILE(); goto op_##name;
+            #define TORQ_PAIR_LABEL(name, first, second) count_##name: PROFILE(); goto op_##name;
+            #define TORQ_TRIPLE_LABEL(name, first, second, third) count_##name: PROFILE(); goto op_##name;
+            TORQ_OPCODES(TORQ_OPCODE_LABEL)
+            TORQ_SUPERINSTRUCTIONS(TORQ_PAIR_LABEL, TORQ_TRIPLE_LABEL)
+            #undef TORQ_OPCODE_LABEL
+            #undef TORQ_PAIR_LABEL
+            #undef TORQ_TRIPLE_LABEL
+        #endif
+
+        #undef RA
+        #undef RB
+        #undef RC
+        #undef THROW
+        #undef CHECK
+        #undef HOT
+        #undef COUNT_INSTRUCTION
+        #undef PROFILE
+        #undef BACK_EDGE
+        #undef ARITH
+        #undef COMPARE
+        #undef STEP_MOVE
+        #undef STEP_LOADNIL
+        #undef STEP_LOADBOOL
+        #undef STEP_LOADINT
+        #undef STEP_LOADK
+        #undef STEP_LOADSTR
+        #undef STEP_GETGLOBAL
+        #undef STEP_GETINDEX
+        #undef STEP_ADD
+        #undef STEP_SUB
+        #undef STEP_MUL
+        #undef STEP_EQ
+        #undef STEP_NE
+        #undef STEP_LT
+        #undef STEP_LE
+        #undef STEP_NOT
+        #undef STEP_ADD_I64
+        #undef STEP_SUB_I64
+        #undef STEP_MUL_I64
+        #undef STEP_DIV_I64
+        #undef STEP_MOD_I64
+        #undef STEP_ADD_F64
+        #undef STEP_SUB_F64
+        #undef STEP_MUL_F64
+        #undef STEP_DIV_F64
+        #undef STEP_MOD_F64
+        #undef STEP_NEG_I64
+        #undef STEP_NEG_F64
+        #undef STEP_EQ_I64
+        #undef STEP_NE_I64
+        #undef STEP_LT_I64
+        #undef STEP_LE_I64
+        #undef STEP_EQ_F64
+        #undef STEP_NE_F64
+        #undef STEP_LT_F64
+        #undef STEP_LE_F64
+        #undef STEP_TOF64
+        #undef STEP_GUARD_I64
+        #undef STEP_GUARD_F64
+        #undef TARGET
+        #undef DISPATCH
+        #undef LAST_PART
+        #undef PAIR_TARGET
+        #undef TRIPLE_TARGET
+    }
+
+
+    bool VM::arith(Op op, const Value &left, const Value &right, Value &result) {
+        if(op == Op::ADD) {
+            if(left.is_string() && right.is_string()) {
+                std::string_view a = left.as_string()->view(), b = right.as_string()->view();
+                char *chars;
+                Str *s = new_string(a.size() + b.size(), chars);
+                std::memcpy(chars, a.data(), a.size());
+                std::memcpy(chars + a.size(), b.data(), b.size());
+                result = Value::string(s);
+                return true;
+            }
+
+            if(left.is_list() && right.is_list()) {
+                List *list = new_list();
+                const auto &a = left.as_list()->items, &b = right.as_list()->items;
+                list->items.reserve(a.size() + b.size());
+                list->items.insert(list->items.end(), a.begin(), a.end());
+                list->items.insert(list->items.end(), b.begin(), b.end());
+                result = Value::list(list);
+                return true;
+            }
+        }
+
+        const char *what = "add";
+        switch(op) {
+            case Op::SUB: what = "subtract"; break;
+            case Op::MUL: what = "multiply"; break;
+            default: break;
+        }
+        return fail(operand_error(what, left, right));
+    }
+
+    bool VM::compare(Op op, const Value &left, const Value &right, bool &result) {
+        if(left.is_string() && right.is_string()) {
+            int order = left.as_string()->view().compare(right.as_string()->view());
+            result = (op == Op::LT) ? (order < 0) : (order <= 0);
+            return true;
+        }
+        return fail(operand_error("compare", left, right));
+    }
+
+    bool VM::get_index(const Value &target, const Value &index, Value &result) {
+        std::string message;
+
+        if(target.is_list()) {
+            std::size_t slot;
+            if(!list_slot(target.as_list(), index, slot, message))
+                return fail(std::move(message));
+            result = target.as_list()->items[slot];
+            return true;
+        }
+
+        if(target.is_string()) {
+            std::string_view text = target.as_string()->view();
+            if(!index.is_int())
+                return fail(std::string("string index must be an int, not ") + value_kind_name(index.kind()));
+            int64_t i = index.as_int();
+            if( (i < 0) || (static_cast<uint64_t>(i) >= text.size()) )
+                return fail("string index " + std::to_string(i) + " out of range");
+            result = Value::string(new_string(text.substr(i, 1)));
+            return true;
+        }
+
+        if(target.is_module() && index.is_string()) {
+            Module *module = target.as_module();
+            auto it = module->members.find(index.as_string()->view());
+            if(it == module->members.end())
+                return fail("module '" + std::string(module->name) + "' has no member '" + std::string(index.as_string()->view()) + "'");
+            result = it->second;
+            return true;
+        }
+
+        return fail(std::string("cannot index a ") + value_kind_name(target.kind()));
+    }
+
+    bool VM::set_index(const Value &target, const Value &index, const Value &value) {
+        if(target.is_list()) {
+            std::string message;
+            std::size_t slot;
+            if(!list_slot(target.as_list(), index, slot, message))
+                return fail(std::move(message));
+            target.as_list()->items[slot] = value;
+            return true;
+        }
+        return fail(std::string("cannot assign into a ") + value_kind_name(target.kind()));
+    }
+
+
+    //heap strings keep their characters directly after the header
+    Str* VM::new_string(std::size_t length, char *&chars) {
+        maybe_collect();
+
+        void *memory = std::malloc(sizeof(Str) + length);
+        if(!memory)
+            throw std::bad_alloc();
+
+        Str *s = new(memory) Str{};
+        s->kind = ObjectKind::STRING;
+        s->marked = false;
+        s->next = objects;
+        s->length = static_cast<uint32_t>(length);
+        chars = reinterpret_cast<char*>(s + 1);
+        s->chars = chars;
+
+        objects = s;
+        allocated += sizeof(Str) + length;
+        return s;
+    }
+
+    Str* VM::new_string(std::string_view text) {
+        char *chars;
+        Str *s = new_string(text.size(), chars);
+        std::memcpy(chars, text.data(), text.size());
+        return s;
+    }
+
+    List* VM::new_list() {
+        maybe_collect();
+
+        List *list = new List{};
+        list->kind = ObjectKind::LIST;
+        list->marked = false;
+        list->next = objects;
+
+        objects = list;
+        allocated += sizeof(List);
+        return list;
+    }
+
+    Module* VM::new_module(std::string_view name) {
+        maybe_collect();
+
+        Module *module = new Module{};
+        module->kind = ObjectKind::MODULE;
+        module->marked = false;
+        module->next = objects;
+        module->name = name;
+
+        objects = module;
+        allocated += sizeof(Module);
+        return module;
+    }
+
+    BoxedInt* VM::new_int(int64_t value) {
+        maybe_collect();
+
+        BoxedInt *boxed = new BoxedInt{};
+        boxed->kind = ObjectKind::INT;
+        boxed->marked = false;
+        boxed->next = objects;
+        boxed->value = value;
+
+        objects = boxed;
+        allocated += sizeof(BoxedInt);
+        return boxed;
+    }
+
+    void VM::free_object(Object *object) {
+        switch(object->kind) {
+            case ObjectKind::STRING:
+                std::free(object);
+                break;
+            case ObjectKind::LIST:
+                delete static_cast<List*>(object);
+                break;
+            case ObjectKind::MODULE:
+                delete static_cast<Module*>(object);
+                break;
+            case ObjectKind::INT:
+                delete static_cast<BoxedInt*>(object);
+                break;
+        }
+    }
+
+
+    void VM::maybe_collect() {
+        if(allocated >= next_collection) {
+            collect();
+            next_collection = std::max(allocated * 2, MIN_COLLECTION);
+        }
+    }
+
+    void VM::mark(Value value) {
+        if(value.is_object())
+            mark_object(value.as_object());
+    }
+
+    void VM::mark_object(Object *object) {
+        //program constants are created marked and never enter the object list
+        if(object->marked)
+            return;
+        object->marked = true;
+        if(object->kind == ObjectKind::LIST || object->kind == ObjectKind::MODULE)
+            gray.push_back(object);
+    }
+
+    void VM::trace() {
+        while(!gray.empty()) {
+            Object *object = gray.back();
+            gray.pop_back();
+            if(object->kind == ObjectKind::LIST) {
+                for(const Value &item : static_cast<List*>(object)->items)
+                    mark(item);
+            } else {
+                for(const auto &[name, member] : static_cast<Module*>(object)->members)
+                    mark(member);
+            }
+        }
+    }
+
+    //mark and sweep. The roots are the registers of every live frame and the globals
+    std::size_t VM::collect() {
+        for(Value *r = stack.get(); r < top; r++)
+            mark(*r);
+        for(const auto &[name, value] : globals)
+            mark(value);
+        for(const auto &[name, value] : modules)
+            mark(value);
+        trace();
+
+        std::size_t freed = 0;
+        Object **link = &objects;
+        allocated = 0;
+
+        while(*link) {
+            Object *object = *link;
+            if(object->marked) {
+                object->marked = false;
+                allocated += object_size(object);
+                link = &object->next;
+            } else {
+                *link = object->next;
+                free_object(object);
+                freed++;
+            }
+        }
+        return freed;
+    }
+
+}
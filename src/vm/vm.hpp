@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "bytecode.hpp"
+#include "jit.hpp"
+#include "profile.hpp"
+#include "../stats.hpp"
+#include "value.hpp"
+
+namespace torq {
+
+    constexpr std::size_t STACK_SIZE = 64 * 1024;
+    constexpr std::size_t MAX_FRAMES = 1024;
+
+    struct RuntimeError {
+        std::string message;
+        std::string file;
+        Location location;
+    };
+
+
+    //register machine. Each call gets a window of the value stack, sized by its prototype,
+    //starting at the callee's first argument
+    class VM {
+      private:
+        struct Frame {
+            const Function *function;
+            const Instr *pc;        //resume point, only valid while the frame is suspended
+            Value *base;
+            Value *top;
+            Value *result;          //where RETURN stores to in the caller
+        };
+
+        std::unique_ptr<Value[]> stack;
+        Value *top;                 //end of the innermost frame's registers, for the collector
+        std::vector<Frame> frames;
+
+        using Scope = std::unordered_map<std::string_view, Value>;
+
+        //the entry script's globals. Each imported module's globals are its members instead,
+        //found by the program its code belongs to
+        Scope globals;
+        Scope modules;
+        std::unordered_map<const Program*, Module*> module_scopes;
+
+        //GETGLOBAL and SETGLOBAL remember the slot their name resolved to, one cache per
+        //instruction. Slots are map nodes, which never move, so a cached slot sees every
+        //reassignment. Only a name being added can change what a lookup resolves to, and
+        //that bumps scope_version, which invalidates every cache at once
+        struct GlobalCache {
+            Value *slot = nullptr;
+            uint64_t version = 0;
+        };
+        std::unordered_map<const Program*, std::vector<GlobalCache>> global_caches;
+        uint64_t scope_version = 1;
+
+        //every collectable object, linked through Object::next
+        Object *objects;
+        std::size_t allocated;
+        std::size_t next_collection;
+
+        //marked objects whose items aren't marked yet. A worklist, so deep lists can't overflow the stack
+        std::vector<Object*> gray;
+
+        std::ostream &sink;
+        std::string output;
+
+        RuntimeError last_error;
+
+        //null unless enable_jit() was called
+        std::unique_ptr<Jit> native;
+
+        //null unless enable_profile() was called
+        std::unique_ptr<Profiler> profiler;
+
+        uint64_t executed = 0;
+
+        bool execute(const Function *entry, Value *base);
+
+        //hands the profiler the call stack, pc being just past the running instruction
+        void profile_sample(const Instr *pc);
+
+        //everything the interpreter loop doesn't handle inline
+        bool arith(Op op, const Value &left, const Value &right, Value &result);
+        bool compare(Op op, const Value &left, const Value &right, bool &result);
+        bool get_index(const Value &target, const Value &index, Value &result);
+        bool set_index(const Value &target, const Value &index, const Value &value);
+
+        void error_at(const Function *function, const Instr *pc, std::string message);
+
+        Scope* scope_of(const Program *program);
+        GlobalCache* caches_of(const Program *program);
+        Value* builtin(std::string_view name);
+
+        void maybe_collect();
+        void mark(Value value);
+        void mark_object(Object *object);
+        void trace();
+        void free_object(Object *object);
+
+      public:
+        VM(std::ostream &sink = std::cout);
+        ~VM();
+
+        VM(const VM&) = delete;
+        VM& operator=(const VM&) = delete;
+
+        //runs the top level code of a linked program
+        bool run(const Program &program);
+
+        //runs an imported module's top level code with its own globals, which become the
+        //members of the module bound to name. Imports must run before the code importing them
+        bool run_module(const Program &program, std::string_view name);
+
+        const RuntimeError& error() const { return last_error; }
+
+        //compiles hot loops and functions to native code from here on. False when this build
+        //has no JIT
+        bool enable_jit();
+        const Jit* jit() const { return native.get(); }
+
+        //counts opcodes and samples the call stack from here on, until the VM is destroyed.
+        //Code the JIT compiled isn't seen
+        Profiler* enable_profile();
+        const Profiler* profile() const { return profiler.get(); }
+
+        //instructions interpreted so far, always 0 when built with TORQ_NO_STATS
+        uint64_t instructions() const { return executed; }
+
+        void define(std::string_view name, Value value) {
+            if(globals.insert_or_assign(name, value).second)
+                scope_version++;
+        }
+        void define_module(std::string_view name, Value module) { modules[name] = module; scope_version++; }
+        Value global(std::string_view name) const;
+
+        //allocation - may run the collector, so anything not yet reachable from registers or
+        //globals must not be held across these calls
+        Str* new_string(std::string_view text);
+        Str* new_string(std::size_t length, char *&chars);
+        List* new_list();
+        Module* new_module(std::string_view name);
+        BoxedInt* new_int(int64_t value);
+
+        //every int the VM produces goes through here, the few too wide for a Value are boxed
+        Value integer(int64_t i) {
+            if(Value::fits(i)) [[likely]]
+                return Value::small_int(i);
+            return Value::boxed_int(new_int(i));
+        }
+
+        //for natives: records the message, the VM adds the location
+        bool fail(std::string message) { last_error.message = std::move(message); return false; }
+
+        //buffered, written to the sink when full and when a run finishes
+        std::string& out() { return output; }
+        void flush();
+
+        std::size_t collect();
+    };
+
+    //print, len, str, ... as globals and as members of the std module
+    void register_builtins(VM &vm);
+
+}
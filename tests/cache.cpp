@@ -0,0 +1,163 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "../src/vm/cache.hpp"
+#include "helpers.hpp"
+
+namespace {
+    const std::string source =
+        "fn square(int x): int\n"
+        "    return x * x\n"
+        "end\n"
+        "names = [\"a\", \"b\"]\n"
+        "for i = 1, 3 do print(\"%s%d \", names[i % 2], square(i) + 100000) end\n";
+
+    void compile(const std::string &text, torq::Program &program) {
+        REQUIRE( helpers::compile(text, program) );
+    }
+
+    std::string run(const torq::Program &program) {
+        helpers::Ran ran = helpers::run(program);
+        REQUIRE( ran.ok );
+        return ran.output;
+    }
+
+    std::string disassembly(const torq::Program &program) {
+        std::ostringstream out;
+        torq::disassemble(program, out);
+        return out.str();
+    }
+
+    std::string read_file(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    void write_file(const std::string &path, const std::string &data) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << data;
+    }
+}
+
+TEST_CASE("cache files sit next to the source", "[cache]") {
+    REQUIRE( torq::cache_path("scripts/foo.tq", 1) == "scripts/foo.O1.tqc" );
+    REQUIRE( torq::cache_path("foo", 2) == "foo.O2.tqc" );
+}
+
+TEST_CASE("source hash sees every byte", "[cache]") {
+    REQUIRE( torq::hash_source(source) == torq::hash_source(std::string(source)) );
+    REQUIRE( torq::hash_source("abcdefghi") != torq::hash_source("abcdefghj") );
+    REQUIRE( torq::hash_source("a") != torq::hash_source(std::string_view("a\0", 2)) );
+}
+
+TEST_CASE("cached programs run in place", "[cache]") {
+    const std::string path = "cache_test.tqc";
+
+    torq::Program compiled;
+    compile(source, compiled);
+    REQUIRE( torq::save_cache(path, compiled, source, 0) );
+
+    torq::Program loaded;
+    REQUIRE( torq::load_cache(path, source, 0, loaded) );
+
+    //nothing was copied out of the file
+    REQUIRE( loaded.storage.code.empty() );
+    REQUIRE( loaded.storage.string_data.empty() );
+    REQUIRE( loaded.formats.size() == 1 );
+    REQUIRE( loaded.format_steps.size() == compiled.format_steps.size() );
+
+    REQUIRE( disassembly(loaded) == disassembly(compiled) );
+    REQUIRE( run(loaded) == "b100001 a100004 b100009 " );
+    REQUIRE( run(loaded) == run(compiled) );
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("each optimization level keeps its own cache file", "[cache]") {
+    //alternating levels hits the cache every time, rather than rewriting one file
+    for(int level : {1, 2}) {
+        torq::Program compiled;
+        REQUIRE( helpers::compile(source, compiled, level) );
+        REQUIRE( torq::save_cache(torq::cache_path("cache_test.tq", level), compiled, source, level) );
+    }
+
+    for(int round = 0; round < 2; round++) {
+        for(int level : {1, 2}) {
+            torq::Program loaded;
+            REQUIRE( torq::load_cache(torq::cache_path("cache_test.tq", level), source, level, loaded) );
+            REQUIRE( run(loaded) == "b100001 a100004 b100009 " );
+        }
+    }
+
+    for(int level : {1, 2})
+        std::remove(torq::cache_path("cache_test.tq", level).c_str());
+}
+
+TEST_CASE("stale and damaged cache files are ignored", "[cache]") {
+    const std::string path = "cache_test.tqc";
+
+    torq::Program compiled;
+    compile(source, compiled);
+    REQUIRE( torq::save_cache(path, compiled, source, 0) );
+    const std::string image = read_file(path);
+
+    torq::Program program;
+
+    SECTION("missing") {
+        std::remove(path.c_str());
+        REQUIRE( !torq::load_cache(path, source, 0, program) );
+    }
+
+    SECTION("source changed") {
+        REQUIRE( !torq::load_cache(path, source + " ", 0, program) );
+        std::string edited = source;
+        edited[edited.size() - 5] = 'X';
+        REQUIRE( !torq::load_cache(path, edited, 0, program) );
+    }
+
+    SECTION("other optimization level") {
+        REQUIRE( !torq::load_cache(path, source, 1, program) );
+    }
+
+    SECTION("other bytecode version") {
+        std::string bad = image;
+        bad[4] ^= 0x40;
+        write_file(path, bad);
+        REQUIRE( !torq::load_cache(path, source, 0, program) );
+    }
+
+    SECTION("other superinstructions") {
+        std::string bad = image;
+        bad[20] ^= 0x01;
+        write_file(path, bad);
+        REQUIRE( !torq::load_cache(path, source, 0, program) );
+    }
+
+    SECTION("truncated") {
+        write_file(path, image.substr(0, image.size() - 3));
+        REQUIRE( !torq::load_cache(path, source, 0, program) );
+        write_file(path, image.substr(0, 10));
+        REQUIRE( !torq::load_cache(path, source, 0, program) );
+    }
+
+    SECTION("corrupt code") {
+        //every byte flipped in turn - each either fails to load or still
+        //verifies, which is all that keeps the interpreter in bounds
+        for(std::size_t i = 0; i < image.size(); i++) {
+            std::string bad = image;
+            bad[i] ^= 0xff;
+            write_file(path, bad);
+
+            torq::Program damaged;
+            if(torq::load_cache(path, source, 0, damaged))
+                REQUIRE( torq::verify(damaged) );
+        }
+    }
+
+    REQUIRE( program.code.empty() );
+    std::remove(path.c_str());
+}
@@ -0,0 +1,138 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "helpers.hpp"
+
+namespace {
+    struct Compiled {
+        torq::Program program;
+        std::vector<torq::Diagnostic> errors;
+        bool ok;
+    };
+
+    void compile(const std::string &source, Compiled &out) {
+        out.ok = helpers::compile(source, out.program, 0, true, &out.errors);
+    }
+
+    //opcode names of one function, to compare against
+    std::string ops(const torq::Program &program, std::size_t function) {
+        const torq::FunctionProto &proto = program.functions[function];
+        std::string out;
+        for(uint32_t pc = proto.code_start; pc < proto.code_start + proto.code_size; pc++) {
+            if(!out.empty())
+                out += " ";
+            out += torq::op_name(torq::op_of(program.code[pc]));
+        }
+        return out;
+    }
+}
+
+TEST_CASE("instruction encoding round trips", "[compiler]") {
+    torq::Instr i = torq::make_abc(torq::Op::ADD, 1, 2, 255);
+    REQUIRE( torq::op_of(i) == torq::Op::ADD );
+    REQUIRE( torq::arg_a(i) == 1 );
+    REQUIRE( torq::arg_b(i) == 2 );
+    REQUIRE( torq::arg_c(i) == 255 );
+
+    torq::Instr j = torq::make_asbx(torq::Op::JMP, 0, -300);
+    REQUIRE( torq::arg_sbx(j) == -300 );
+    REQUIRE( torq::arg_bx(torq::make_abx(torq::Op::LOADK, 3, 65535)) == 65535 );
+}
+
+TEST_CASE("locals live in registers", "[compiler]") {
+    Compiled c;
+    compile(
+        "fn area(float radius): float\n"
+        "    return 2.0 * radius * PI\n"
+        "end\n", c);
+    REQUIRE( c.ok );
+    REQUIRE( c.program.functions.size() == 2 );
+
+    //radius is checked on entry and read straight from its register, PI is a global
+    REQUIRE( ops(c.program, 1) == "GUARD_F64 LOADK MUL_F64 GETGLOBAL MUL RETURN RETURN" );
+    REQUIRE( c.program.functions[1].params == 1 );
+    REQUIRE( ops(c.program, 0) == "LOADFN SETGLOBAL RETURN" );
+}
+
+TEST_CASE("calls are built in place", "[compiler]") {
+    Compiled c;
+    compile("print(1, 2)", c);
+    REQUIRE( c.ok );
+    REQUIRE( ops(c.program, 0) == "GETGLOBAL LOADINT LOADINT CALL RETURN" );
+    REQUIRE( c.program.functions[0].registers == 3 );
+}
+
+TEST_CASE("constants and strings", "[compiler]") {
+    Compiled c;
+    compile("a = 1.5 + 1.5 + 100000 + 100000 + 7", c);
+    REQUIRE( c.ok );
+    //deduplicated, ints added to a float become float constants
+    REQUIRE( c.program.constants.size() == 3 );
+    REQUIRE( c.program.string(c.program.functions[0].name) == "<main>" );
+}
+
+TEST_CASE("typed code uses specialized instructions", "[compiler]") {
+    Compiled c;
+    compile(
+        "fn f(int n, float x): float\n"
+        "    total = 0\n"
+        "    for i = 0, n do\n"
+        "        total = total + i * 2\n"
+        "    end\n"
+        "    return total + x\n"
+        "end\n", c);
+    REQUIRE( c.ok );
+
+    //total is inferred as an int from its assignments, the loop counts in ints
+    REQUIRE( ops(c.program, 1) ==
+        "GUARD_I64 GUARD_F64 LOADINT LOADINT LOADINT MOVE LOADINT FORPREP_I64 "
+        "LOADINT MUL_I64 ADD_I64 FORLOOP_I64 TOF64 ADD_F64 RETURN RETURN" );
+}
+
+TEST_CASE("inference gives up on mixed assignments", "[compiler]") {
+    Compiled c;
+    compile(
+        "fn f(a)\n"
+        "    x = 1\n"
+        "    x = a\n"
+        "    return x + 1\n"
+        "end\n", c);
+    REQUIRE( c.ok );
+    REQUIRE( ops(c.program, 1) == "LOADINT MOVE LOADINT ADD RETURN RETURN" );
+}
+
+TEST_CASE("compile errors", "[compiler]") {
+    Compiled c;
+    compile("break", c);
+    REQUIRE( !c.ok );
+    REQUIRE( c.errors.size() == 1 );
+    REQUIRE( c.errors[0].message == "break outside a loop" );
+
+    Compiled typed;
+    compile("fn f()\n    int n = \"x\"\nend\n", typed);
+    REQUIRE( !typed.ok );
+    REQUIRE( typed.errors[0].message == "cannot assign a string to int 'n'" );
+
+    Compiled twice;
+    compile("fn f()\n    int n\n    float n\nend\n", twice);
+    REQUIRE( !twice.ok );
+    REQUIRE( twice.errors[0].message == "'n' is already declared as int" );
+}
+
+TEST_CASE("disassembly shows operands and source lines", "[compiler]") {
+    Compiled c;
+    compile("x = \"hi\"\nprint(x)\n", c);
+    REQUIRE( c.ok );
+
+    std::ostringstream out;
+    torq::disassemble(c.program, out);
+    std::string text = out.str();
+
+    REQUIRE( text.find("fn <main> (0 params") == 0 );
+    REQUIRE( text.find("LOADSTR") != std::string::npos );
+    REQUIRE( text.find("; \"hi\"") != std::string::npos );
+    REQUIRE( text.find("   2:1    GETGLOBAL") != std::string::npos );
+}
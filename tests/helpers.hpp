@@ -0,0 +1,80 @@
+#pragma once
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/compiler/compiler.hpp"
+#include "../src/compiler/optimizer.hpp"
+#include "../src/parser/lexer.hpp"
+#include "../src/parser/parser.hpp"
+#include "../src/vm/vm.hpp"
+
+//the lex, parse, compile and run steps the tests share - the same steps the loader takes
+namespace helpers {
+
+    inline std::string messages(const std::vector<torq::Diagnostic> &diagnostics) {
+        std::string joined;
+        for(auto &d : diagnostics)
+            joined += d.message + "\n";
+        return joined;
+    }
+
+    //the source has to parse. Compile errors are left in errors, when given
+    inline bool compile(const std::string &source, torq::Program &program, int level = 0, bool fuse = true,
+                        std::vector<torq::Diagnostic> *errors = nullptr) {
+        torq::Lexer l(source);
+        torq::Parser p(l);
+        torq::Ast ast = p.parse();
+        INFO( messages(ast.errors) );
+        REQUIRE( ast.ok() );
+
+        torq::Optimizer(ast, level).run();
+        torq::Compiler c(ast, source, level, fuse);
+        bool ok = c.compile(program);
+        //the caller's REQUIRE is the next assertion, so the messages have to outlive this scope
+        if(!ok)
+            UNSCOPED_INFO( messages(c.errors) );
+        if(errors)
+            *errors = c.errors;
+        return ok;
+    }
+
+    struct RunOptions {
+        bool jit = false;
+    };
+
+    struct Ran {
+        bool ok = false;
+        std::string output;
+        torq::RuntimeError error;
+        uint64_t instructions = 0;
+
+        //native code, with jit
+        std::size_t compiled = 0;
+        std::size_t deopts = 0;
+    };
+
+    inline Ran run(const torq::Program &program, const RunOptions &options = {}) {
+        std::ostringstream out;
+        torq::VM vm(out);
+        if(options.jit)
+            REQUIRE( vm.enable_jit() );
+
+        Ran ran;
+        ran.ok = vm.run(program);
+        ran.output = out.str();
+        ran.error = vm.error();
+        ran.instructions = vm.instructions();
+        if(options.jit) {
+            ran.compiled = vm.jit()->compiled();
+            ran.deopts = vm.jit()->deopts();
+        }
+        return ran;
+    }
+
+}
@@ -0,0 +1,148 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <random>
+#include <string>
+
+#include "../src/parser/incremental.hpp"
+#include "../src/parser/lexer.hpp"
+
+namespace {
+    //the incremental tokens have to match lexing the edited source from scratch
+    void require_relexed(torq::IncrementalLexer &inc) {
+        std::string source(inc.source());
+        torq::Lexer l(source);
+
+        for(std::size_t i = 0; ; i++) {
+            torq::Token expected = l.next();
+            REQUIRE( i < inc.tokens() );
+
+            torq::Token t = inc.token(i);
+            REQUIRE( t.type == expected.type );
+            REQUIRE( t.offset == expected.offset );
+
+            switch(t.type) {
+                case torq::INTEGER_LIT: REQUIRE( t.i_value == expected.i_value ); break;
+                case torq::FLOAT_LIT: REQUIRE( t.f_value == expected.f_value ); break;
+                case torq::IDENTIFIER:
+                case torq::STRING_LIT:
+                case torq::ERROR:
+                    REQUIRE( inc.text(t) == l.text(expected) );
+                    break;
+                default:
+                    break;
+            }
+
+            if(expected.type == torq::EOS) {
+                REQUIRE( inc.tokens() == i + 1 );
+                break;
+            }
+        }
+
+        REQUIRE( inc.lines() == static_cast<std::size_t>(l.location(source.size()).line) );
+        for(uint32_t offset = 0; offset <= source.size(); offset += 7) {
+            torq::Location want = l.location(offset);
+            torq::Location got = inc.location(offset);
+            REQUIRE( got.line == want.line );
+            REQUIRE( got.column == want.column );
+        }
+    }
+
+    std::string lines(std::size_t count) {
+        std::string source;
+        for(std::size_t i = 0; i < count; i++)
+            source += "x" + std::to_string(i) + " = y + 12 * 0.5 # note\n";
+        return source;
+    }
+}
+
+TEST_CASE("edits re-lex the same as a fresh lexer", "[incremental]") {
+    const char *pieces[] = {
+        "", "x", "12", ".5", " ", "\n", "\"", "\"\"\"", "#", "end\n", "\"a b\"", "\\", "0x", "_1",
+    };
+
+    torq::IncrementalLexer inc(
+        "fn f(int n): int\n"
+        "    s = \"\"\"one\n"
+        "two\"\"\" # comment\n"
+        "    return n * 0x1F + 1.5e3\n"
+        "end\n"
+        "print(f(2), \"x\\ty\")\n");
+    require_relexed(inc);
+
+    std::mt19937 rng(7);
+    for(int i = 0; i < 2000; i++) {
+        uint32_t size = inc.source().size();
+        uint32_t offset = rng() % (size + 1);
+        uint32_t removed = std::min<uint32_t>(rng() % 4, size - offset);
+        const char *inserted = pieces[rng() % std::size(pieces)];
+
+        INFO(inc.source());
+        INFO("edit " << offset << " " << removed << " '" << inserted << "'");
+        REQUIRE( inc.edit(offset, removed, inserted) );
+        require_relexed(inc);
+    }
+}
+
+TEST_CASE("a local edit only re-lexes its line", "[incremental]") {
+    torq::IncrementalLexer inc(lines(5000));
+    std::size_t tokens = inc.tokens();
+
+    uint32_t middle = inc.source().find("x2500 ");
+    REQUIRE( inc.edit(middle + 1, 0, "9") );
+    REQUIRE( inc.relexed() <= 8 );
+    REQUIRE( inc.tokens() == tokens );
+    REQUIRE( inc.text(inc.token(2500 * 7)) == "x92500" );
+
+    //typing a new line in, a key at a time
+    uint32_t at = inc.source().find("x100 ");
+    for(char ch : std::string("z = 1\n")) {
+        REQUIRE( inc.edit(at++, 0, std::string(1, ch)) );
+        REQUIRE( inc.relexed() <= 8 );
+    }
+    REQUIRE( inc.tokens() == tokens + 4 );
+    REQUIRE( inc.location(at).line == 102 );
+    require_relexed(inc);
+
+    REQUIRE( !inc.edit(inc.source().size() + 1, 0, "x") );
+    REQUIRE( !inc.edit(0, inc.source().size() + 1, "") );
+}
+
+TEST_CASE("opening a multi-line string re-lexes up to its end", "[incremental]") {
+    torq::IncrementalLexer inc(lines(100));
+
+    uint32_t at = inc.source().find("x50 ");
+    REQUIRE( inc.edit(at, 0, "\"\"\"") );
+    REQUIRE( inc.token(inc.tokens() - 2).type == torq::ERROR );
+    require_relexed(inc);
+
+    //closing it again brings the rest of the file back
+    uint32_t close = inc.source().find("x60 ");
+    REQUIRE( inc.edit(close, 0, "\"\"\"") );
+    REQUIRE( inc.token(inc.tokens() - 2).type == torq::FLOAT_LIT );
+    require_relexed(inc);
+
+    //an edit inside the string restarts before it
+    REQUIRE( inc.edit(at + 10, 0, "\n\n") );
+    REQUIRE( inc.relexed() == 1 );
+    require_relexed(inc);
+
+    REQUIRE( inc.edit(at, 3, "") );
+    require_relexed(inc);
+}
+
+TEST_CASE("commenting out a line", "[incremental]") {
+    torq::IncrementalLexer inc(lines(10));
+
+    uint32_t at = inc.source().find("x5 ");
+    REQUIRE( inc.edit(at, 0, "#") );
+    require_relexed(inc);
+
+    REQUIRE( inc.edit(at, 1, "") );
+    require_relexed(inc);
+
+    //joining two lines
+    uint32_t nl = inc.source().find('\n');
+    REQUIRE( inc.edit(nl, 1, "") );
+    REQUIRE( inc.location(nl + 1).line == 1 );
+    require_relexed(inc);
+}
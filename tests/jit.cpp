@@ -0,0 +1,171 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+
+#include "helpers.hpp"
+
+namespace {
+    struct Result {
+        std::string output;
+        std::string error;
+        std::size_t compiled = 0;
+        std::size_t deopts = 0;
+    };
+
+    Result run(const std::string &source, bool jit) {
+        torq::Program program;
+        REQUIRE( helpers::compile(source, program, 1) );
+
+        helpers::Ran ran = helpers::run(program, {.jit = jit});
+
+        Result result;
+        if(!ran.ok)
+            result.error = ran.error.message;
+        result.output = ran.output;
+        result.compiled = ran.compiled;
+        result.deopts = ran.deopts;
+        return result;
+    }
+
+    //the same output and error with and without native code, which did get used
+    Result same(const std::string &source) {
+        Result interpreted = run(source, false);
+        Result native = run(source, true);
+        REQUIRE( native.output == interpreted.output );
+        REQUIRE( native.error == interpreted.error );
+        REQUIRE( native.compiled > 0 );
+        return native;
+    }
+}
+
+#if TORQ_JIT
+
+TEST_CASE("hot loops run natively", "[jit]") {
+    SECTION("typed int loop") {
+        same(
+            "fn sum(int n): int\n"
+            "    int total = 0\n"
+            "    for i = 1, n do\n"
+            "        if i % 3 == 0 then total = total + i else total = total - 1 end\n"
+            "    end\n"
+            "    return total\n"
+            "end\n"
+            "print(sum(100000), sum(7))\n");
+    }
+
+    SECTION("typed float loop") {
+        same(
+            "fn f(int n, float x): float\n"
+            "    float y = 0\n"
+            "    for i = 1, n do\n"
+            "        y = y * 0.5 + x * i - 1.0 / x\n"
+            "        if y > 1000.0 then y = -y end\n"
+            "    end\n"
+            "    return y\n"
+            "end\n"
+            "print(f(50000, 1.5), f(3, 0.0))\n");
+    }
+
+    SECTION("untyped while loop") {
+        same(
+            "i = 0\n"
+            "fn count(n)\n"
+            "    a = 0\n"
+            "    b = 0.5\n"
+            "    while a < n do\n"
+            "        a = a + 1\n"
+            "        b = b * 1.0001\n"
+            "    end\n"
+            "    return [a, b]\n"
+            "end\n"
+            "print(count(20000))\n");
+    }
+
+    SECTION("counting down") {
+        same(
+            "fn down(int n): int\n"
+            "    int k = 0\n"
+            "    for i = n, 1, -2 do k = k + i end\n"
+            "    return k\n"
+            "end\n"
+            "print(down(30001))\n");
+    }
+
+    SECTION("hot function") {
+        same(
+            "fn clamp(int x): int\n"
+            "    if x < 0 then return 0 end\n"
+            "    if x > 100 then return 100 end\n"
+            "    return x\n"
+            "end\n"
+            "int total = 0\n"
+            "for i = -5000, 5000 do total = total + clamp(i) end\n"
+            "print(total)\n");
+    }
+}
+
+TEST_CASE("native code hands unexpected values back", "[jit]") {
+    SECTION("ints wider than a Value") {
+        Result result = same(
+            "fn grow(int n): int\n"
+            "    int x = 1\n"
+            "    for i = 1, n do x = x + x / 2 + 1 end\n"
+            "    return x\n"
+            "end\n"
+            "print(grow(2000), grow(80))\n");
+        REQUIRE( result.deopts > 0 );
+    }
+
+    SECTION("float NaN") {
+        same(
+            "fn f(int n): float\n"
+            "    float z = 0\n"
+            "    float y = 0\n"
+            "    for i = 1, n do y = z / z end\n"
+            "    return y\n"
+            "end\n"
+            "print(f(5000))\n");
+    }
+
+    SECTION("a guard failing after warm up") {
+        Result result = same(
+            "fn sq(float r) return r * r end\n"
+            "items = []\n"
+            "for i = 1, 3000 do append(items, i) end\n"
+            "append(items, \"x\")\n"
+            "total = 0.0\n"
+            "for k = 0, len(items) - 1 do total = total + sq(items[k]) end\n");
+        REQUIRE( result.error == "expected a float, got string" );
+    }
+}
+
+TEST_CASE("regions that keep deopting go back to the interpreter", "[jit]") {
+    //compiled while comparing two ints, then only ever comparing an int with a float
+    Result result = same(
+        "fn mix(n, step)\n"
+        "    a = 0\n"
+        "    i = 0\n"
+        "    while i < n do\n"
+        "        a = a + step\n"
+        "        i = i + 1\n"
+        "    end\n"
+        "    return a\n"
+        "end\n"
+        "print(mix(5000, 1))\n"
+        "for k = 1, 2000 do mix(3.5, 0.5) end\n"
+        "print(mix(20.5, 0.25))\n");
+
+    //the loop and the function entry each give up after MAX_DEOPTS
+    REQUIRE( result.deopts > torq::Jit::MAX_DEOPTS );
+    REQUIRE( result.deopts <= 2 * (torq::Jit::MAX_DEOPTS + 1) );
+}
+
+#else
+
+TEST_CASE("builds without a JIT interpret", "[jit]") {
+    torq::VM vm;
+    REQUIRE( !vm.enable_jit() );
+    REQUIRE( vm.jit() == nullptr );
+}
+
+#endif
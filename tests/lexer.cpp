@@ -1,8 +1,13 @@
 #include <catch2/catch_session.hpp>
 #include <catch2/catch_test_macros.hpp>
 
+#include <algorithm>
 #include <format>
 #include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
 
 #include "../src/parser/lexer.hpp"
 
@@ -368,23 +373,26 @@ TEST_CASE("single line strings", "[lexer]"){
     torq::Lexer l(R"( "this is a test" "newline\n\\\ttest" )");
 
     torq::Token t = l.next();
-    INFO(t.s_value);
+    INFO(l.text(t));
     REQUIRE( t.type == torq::STRING_LIT );
-    REQUIRE( t.s_value == "this is a test" );
+    REQUIRE( l.text(t) == "this is a test" );
 
     t = l.next();
-    INFO(t.s_value);
+    INFO(l.text(t));
     REQUIRE( t.type == torq::STRING_LIT );
-    REQUIRE( t.s_value == "newline\n\\\ttest" );
+    REQUIRE( l.text(t) == "newline\n\\\ttest" );
 }
 
 TEST_CASE("multi-line string", "[lexer]"){
     torq::Lexer l(" \"\"\"this is a test\nwith multiple lines\nof text\"\"\" ");
 
     torq::Token t = l.next();
-    INFO(t.s_value);
+    INFO(l.text(t));
     REQUIRE( t.type == torq::STRING_LIT );
-    REQUIRE( t.s_value == "this is a test\nwith multiple lines\nof text" );
+    REQUIRE( l.text(t) == "this is a test\nwith multiple lines\nof text" );
+
+    t = l.next();
+    REQUIRE( t.type == torq::EOS );
 }
 
 TEST_CASE("bad single line strings", "[lexer]"){
@@ -454,15 +462,56 @@ TEST_CASE("identifiers", "[lexer]"){
 
     torq::Token t = l.next();
     REQUIRE( t.type == torq::IDENTIFIER );
-    REQUIRE( t.s_value == "fred");
+    REQUIRE( l.text(t) == "fred");
 
     t = l.next();
     REQUIRE( t.type == torq::IDENTIFIER );
-    REQUIRE( t.s_value == "_range");
+    REQUIRE( l.text(t) == "_range");
 
     t = l.next();
     REQUIRE( t.type == torq::IDENTIFIER );
-    REQUIRE( t.s_value == "TESTVAL");
+    REQUIRE( l.text(t) == "TESTVAL");
+}
+
+TEST_CASE("token locations", "[lexer]"){
+    torq::Lexer l("import std\n\nfn area(float radius)\n  \"\"\"two\nlines\"\"\" x");
+
+    torq::Token t = l.next();
+    REQUIRE( t.type == torq::IMPORT );
+    REQUIRE( l.location(t).line == 1 );
+    REQUIRE( l.location(t).column == 1 );
+
+    t = l.next();
+    REQUIRE( t.type == torq::IDENTIFIER );
+    REQUIRE( l.location(t).line == 1 );
+    REQUIRE( l.location(t).column == 8 );
+
+    t = l.next();
+    REQUIRE( t.type == torq::ENDL );
+    t = l.next();
+    REQUIRE( t.type == torq::ENDL );
+    REQUIRE( l.location(t).line == 2 );
+
+    t = l.next();
+    REQUIRE( t.type == torq::FUNCTION );
+    REQUIRE( l.location(t).line == 3 );
+    REQUIRE( l.location(t).column == 1 );
+
+    t = l.next();
+    t = l.next();
+    t = l.next();
+    REQUIRE( t.type == torq::FLOAT_TYPE );
+    REQUIRE( l.location(t).column == 9 );
+
+    t = l.next();
+    t = l.next();
+    t = l.next();
+    REQUIRE( t.type == torq::ENDL );
+
+    t = l.next();
+    REQUIRE( t.type == torq::STRING_LIT );
+    REQUIRE( l.location(t).line == 4 );
+    REQUIRE( l.location(t).column == 3 );
 }
 
 TEST_CASE("lexer test file", "[lexer]"){
@@ -478,9 +527,294 @@ TEST_CASE("lexer test file", "[lexer]"){
         if(t.type == torq::EOS)
             break;
 
-        msg = std::format("error on line: {} at column: {}", t.line, t.column);
+        torq::Location loc = l.location(t);
+        msg = std::format("error on line: {} at column: {}", loc.line, loc.column);
 
         INFO(msg);
         REQUIRE( t.type != torq::ERROR);
     }
 }
+
+TEST_CASE("tokenize_all matches next()", "[lexer]"){
+    std::ifstream test_file("../tests/data/data_002.tq");
+    torq::Lexer stream_lexer(test_file);
+    torq::TokenStream tokens = stream_lexer.tokenize_all();
+
+    test_file.clear();
+    test_file.seekg(0);
+    torq::Lexer l(test_file);
+
+    REQUIRE( tokens.size() > 1 );
+
+    for(std::size_t i = 0; i < tokens.size(); i++) {
+        torq::Token t = l.next();
+
+        REQUIRE( tokens.type(i) == t.type );
+        REQUIRE( tokens.offset(i) == t.offset );
+
+        if(t.type == torq::IDENTIFIER || t.type == torq::STRING_LIT)
+            REQUIRE( stream_lexer.symbols().name(tokens.symbol(i)) == l.text(t) );
+        else if(t.type == torq::FLOAT_LIT)
+            REQUIRE( tokens.f_value(i) == t.f_value );
+        else if(t.type == torq::INTEGER_LIT)
+            REQUIRE( tokens.i_value(i) == t.i_value );
+    }
+
+    REQUIRE( tokens.type(tokens.size() - 1) == torq::EOS );
+    REQUIRE( tokens[5].type == torq::ASSIGN );
+}
+
+TEST_CASE("peeks several tokens ahead", "[lexer]") {
+    torq::Lexer l("a = 3 + b");
+
+    REQUIRE( l.peek(3).type == torq::INTEGER_LIT );
+    REQUIRE( l.peek(5).type == torq::IDENTIFIER );
+    REQUIRE( l.peek(6).type == torq::EOS );
+    REQUIRE( l.peek(2).type == torq::ASSIGN );
+
+    torq::Token t = l.next();
+    REQUIRE( t.type == torq::IDENTIFIER );
+    REQUIRE( l.text(t) == "a" );
+
+    REQUIRE( l.peek().type == torq::ASSIGN );
+    REQUIRE( l.peek(2).i_value == 3 );
+
+    t = l.next();
+    REQUIRE( t.type == torq::ASSIGN );
+
+    torq::TokenStream rest = l.tokenize_all();
+    REQUIRE( rest.size() == 4 );
+    REQUIRE( rest.type(0) == torq::INTEGER_LIT );
+    REQUIRE( rest.type(3) == torq::EOS );
+}
+
+TEST_CASE("peeks the full lookahead window", "[lexer]") {
+    torq::Lexer l("( ) [ ] , . ; : ( )");
+
+    REQUIRE( l.peek(torq::Lexer::MAX_LOOKAHEAD).type == torq::COLON );
+
+    torq::Token t = l.next();
+    REQUIRE( t.type == torq::LPAREN );
+    REQUIRE( l.peek(torq::Lexer::MAX_LOOKAHEAD).type == torq::LPAREN );
+}
+
+TEST_CASE("peeking past the lookahead window is an error", "[lexer]") {
+    torq::Lexer l("( ) [ ] , . ; : ( )");
+
+    torq::Token t = l.peek(torq::Lexer::MAX_LOOKAHEAD + 1);
+    REQUIRE( t.type == torq::ERROR );
+    REQUIRE( l.text(t) == "Peek depth out of range" );
+    REQUIRE( l.peek(0).type == torq::ERROR );
+
+    //and nothing was lexed or skipped
+    REQUIRE( l.next().type == torq::LPAREN );
+    REQUIRE( l.peek(torq::Lexer::MAX_LOOKAHEAD).type == torq::LPAREN );
+}
+
+TEST_CASE("keyword prefixes and extensions are identifiers", "[lexer]"){
+    torq::Lexer l("i iff ends fo format doit returns imports f then_ _if");
+
+    for(int i = 0; i < 11; i++) {
+        torq::Token t = l.next();
+        REQUIRE( t.type == torq::IDENTIFIER );
+    }
+
+    REQUIRE( l.next().type == torq::EOS );
+}
+
+TEST_CASE("number literals with separators", "[lexer]"){
+    torq::Lexer l("1_000_000 0x7fff_ffff_ffff_ffff 1_000.25 3. 0b1_0_1");
+
+    torq::Token t = l.next();
+    REQUIRE( t.type == torq::INTEGER_LIT );
+    REQUIRE( t.i_value == 1000000 );
+
+    t = l.next();
+    REQUIRE( t.type == torq::INTEGER_LIT );
+    REQUIRE( t.i_value == 0x7fffffffffffffff );
+
+    t = l.next();
+    REQUIRE( t.type == torq::FLOAT_LIT );
+    REQUIRE( t.f_value == 1000.25 );
+
+    t = l.next();
+    REQUIRE( t.type == torq::FLOAT_LIT );
+    REQUIRE( t.f_value == 3.0 );
+
+    t = l.next();
+    REQUIRE( t.type == torq::INTEGER_LIT );
+    REQUIRE( t.i_value == 5 );
+}
+
+TEST_CASE("out of range number literals are errors", "[lexer]"){
+    torq::Lexer l("9223372036854775808 9_223_372_036_854_775_807 0x1_0000_0000_0000_0000 1e999 )");
+
+    torq::Token t = l.next();
+    REQUIRE( t.type == torq::ERROR );
+
+    t = l.next();
+    REQUIRE( t.type == torq::INTEGER_LIT );
+    REQUIRE( t.i_value == 9223372036854775807 );
+
+    t = l.next();
+    REQUIRE( t.type == torq::ERROR );
+
+    t = l.next();
+    REQUIRE( t.type == torq::ERROR );
+
+    t = l.next();
+    REQUIRE( t.type == torq::RPAREN );
+}
+
+namespace {
+    //every token of a stream lexer against the same source lexed from memory
+    void require_same_tokens(const std::string &source, std::size_t window, torq::Lexer::Retain retain) {
+        torq::Lexer whole(source);
+        std::istringstream in(source);
+        torq::Lexer streamed(in, window, retain);
+
+        while(true) {
+            torq::Token a = whole.next();
+            torq::Token b = streamed.next();
+
+            REQUIRE( a.type == b.type );
+            REQUIRE( a.offset == b.offset );
+            REQUIRE( whole.location(a).line == streamed.location(b).line );
+            REQUIRE( whole.location(a).column == streamed.location(b).column );
+
+            if(a.type == torq::IDENTIFIER || a.type == torq::STRING_LIT || a.type == torq::ERROR)
+                REQUIRE( whole.text(a) == streamed.text(b) );
+            else if(a.type == torq::INTEGER_LIT)
+                REQUIRE( a.i_value == b.i_value );
+            else if(a.type == torq::FLOAT_LIT)
+                REQUIRE( a.f_value == b.f_value );
+
+            if(a.type == torq::EOS)
+                break;
+        }
+    }
+}
+
+TEST_CASE("streams tokens that span windows", "[lexer]"){
+    std::string long_name(300, 'n');
+    std::string long_comment(500, '-');
+
+    std::string source =
+        "x = " + long_name + "1 + 0x7fff_ffff 0b1_01 1_000.25e+3 # " + long_comment + "\n"
+        "s = \"\"\"first line\n"
+        "  second \\t \\\"line\\\"\n"
+        "third\"\"\"\n"
+        "t = \"tab\\tand \\\\\" u = \"\"\n"
+        "if a >= b then c != d end" + std::string(40, ' ') + "\n"
+        "e = \"not closed\n"
+        "1e+";
+
+    for(std::size_t window : {16, 17, 31, 64, 4096})
+    {
+        require_same_tokens(source, window, torq::Lexer::Retain::ALL);
+        require_same_tokens(source, window, torq::Lexer::Retain::WINDOW);
+    }
+}
+
+TEST_CASE("streams peek and tokenize_all the same", "[lexer]"){
+    std::istringstream in("fn f(a, b)\n    return a + b\nend\nprint(f(1, 2))\n");
+    torq::Lexer l(in, 16);
+
+    REQUIRE( l.peek(8).type == torq::ENDL );
+    REQUIRE( l.next().type == torq::FUNCTION );
+
+    torq::TokenStream tokens = l.tokenize_all();
+    REQUIRE( tokens.size() == 25 );
+    REQUIRE( l.symbols().name(tokens.symbol(0)) == "f" );
+    REQUIRE( tokens.type(tokens.size() - 1) == torq::EOS );
+}
+
+namespace {
+    std::string numbered_line(int i) {
+        return "value_" + std::to_string(i) + " = " + std::to_string(i) + " # comment\n";
+    }
+
+    //lexes lines of unique names, checking each token's text and location as it's returned,
+    //and gives the most the lexer held at any point
+    std::size_t peak_memory(torq::Lexer &l, int lines, bool peeking) {
+        std::size_t peak = 0;
+        int line = 0;
+        std::string peeked;
+
+        while(true) {
+            //peeked tokens keep their text across anything forgotten
+            if(peeking) {
+                l.peek(torq::Lexer::MAX_LOOKAHEAD);
+                torq::Token ahead = l.peek();
+                peeked = (ahead.type == torq::IDENTIFIER) ? std::string(l.text(ahead)) : "";
+            }
+
+            torq::Token t = l.next();
+            peak = std::max(peak, l.memory());
+            if(t.type == torq::EOS)
+                break;
+
+            if(t.type == torq::IDENTIFIER) {
+                REQUIRE( l.text(t) == "value_" + std::to_string(line) );
+                if(peeking)
+                    REQUIRE( l.text(t) == peeked );
+
+                torq::Location at = l.location(t);
+                REQUIRE( at.line == line + 1 );
+                REQUIRE( at.column == 1 );
+                line++;
+            }
+        }
+
+        REQUIRE( line == lines );
+        return peak;
+    }
+
+    std::size_t peak_memory(int lines, torq::Lexer::Retain retain, bool peeking = false) {
+        std::string source;
+        for(int i = 0; i < lines; i++)
+            source += numbered_line(i);
+
+        std::istringstream in(source);
+        torq::Lexer l(in, 4096, retain);
+        return peak_memory(l, lines, peeking);
+    }
+}
+
+TEST_CASE("streams in constant memory when only the window is retained", "[lexer]"){
+    std::size_t small = peak_memory(20000, torq::Lexer::Retain::WINDOW);
+    std::size_t large = peak_memory(200000, torq::Lexer::Retain::WINDOW);
+    std::size_t peeking = peak_memory(200000, torq::Lexer::Retain::WINDOW, true);
+
+    //ten times the input, the same footprint - window, line starts and symbols together
+    REQUIRE( large <= small + small / 4 );
+    REQUIRE( peeking <= small + small / 4 );
+    REQUIRE( large <= 4096 + torq::Lexer::SYMBOL_BUDGET + 128 * 1024 );
+
+    //where retaining everything grows with it
+    REQUIRE( peak_memory(200000, torq::Lexer::Retain::ALL) > 4 * large );
+}
+
+TEST_CASE("streams a pipe in constant memory", "[lexer]"){
+    int fds[2];
+    REQUIRE( pipe(fds) == 0 );
+
+    //a few MB, more than the pipe holds, written as it's read
+    const int lines = 200000;
+    std::thread writer([&] {
+        for(int i = 0; i < lines; i++) {
+            std::string line = numbered_line(i);
+            if(write(fds[1], line.data(), line.size()) != (ssize_t)line.size())
+                break;
+        }
+        close(fds[1]);
+    });
+
+    std::ifstream in("/dev/fd/" + std::to_string(fds[0]));
+    torq::Lexer l(in, 4096, torq::Lexer::Retain::WINDOW);
+    std::size_t peak = peak_memory(l, lines, false);
+    writer.join();
+    close(fds[0]);
+
+    REQUIRE( peak <= 4096 + torq::Lexer::SYMBOL_BUDGET + 128 * 1024 );
+}
@@ -0,0 +1,192 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "../src/compiler/loader.hpp"
+#include "../src/compiler/pool.hpp"
+#include "../src/vm/vm.hpp"
+
+namespace {
+    //a scratch project directory, removed again at the end of the test
+    struct Project {
+        std::string root = "loader_test";
+
+        Project() { std::filesystem::remove_all(root); }
+        ~Project() { std::filesystem::remove_all(root); }
+
+        void write(const std::string &file, const std::string &text) {
+            std::filesystem::path path = root + "/" + file;
+            std::filesystem::create_directories(path.parent_path());
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out << text;
+        }
+
+        std::string path(const std::string &file) const { return root + "/" + file; }
+    };
+
+    std::string names(const torq::ModuleLoader &loader) {
+        std::string out;
+        for(const torq::LoadedModule *module : loader.modules_in_order())
+            out += (module->name.empty() ? "<main>" : module->name) + " ";
+        return out;
+    }
+
+    //output, or the error it stopped at
+    std::string run(const torq::ModuleLoader &loader) {
+        std::ostringstream out;
+        torq::VM vm(out);
+        for(const torq::LoadedModule *module : loader.modules_in_order()) {
+            bool ok = module->name.empty() ? vm.run(module->program) : vm.run_module(module->program, module->name);
+            if(!ok)
+                return out.str() + "error: " + vm.error().message;
+        }
+        return out.str();
+    }
+}
+
+TEST_CASE("thread pool runs nested tasks", "[loader]") {
+    torq::ThreadPool pool(4);
+    std::atomic<int> count = 0;
+
+    //a binary tree of tasks, each submitting its children
+    std::function<void(int)> spawn = [&](int depth) {
+        count++;
+        if(depth > 0) {
+            pool.submit([&, depth] { spawn(depth - 1); });
+            pool.submit([&, depth] { spawn(depth - 1); });
+        }
+    };
+
+    pool.submit([&] { spawn(10); });
+    pool.wait();
+    REQUIRE( count == 2047 );
+
+    pool.submit([&] { count++; });
+    pool.wait();
+    REQUIRE( count == 2048 );
+}
+
+TEST_CASE("modules run after their imports", "[loader]") {
+    Project project;
+    project.write("main.tq",
+        "import shapes.circle\n"
+        "import util\n"
+        "print(circle.area(2.0), util.twice(21))\n");
+    project.write("shapes/circle.tq",
+        "import util\n"
+        "PI = 3.0\n"
+        "fn area(float r): float\n"
+        "    return util.twice(1) * 0.5 * PI * r * r\n"
+        "end\n");
+    project.write("util.tq",
+        "factor = 2\n"
+        "fn twice(x)\n"
+        "    return x * factor\n"
+        "end\n"
+        "print(\"util \")\n");
+
+    for(unsigned threads : {1u, 4u}) {
+        torq::ModuleLoader loader(1, false, threads);
+        REQUIRE( loader.load(project.path("main.tq")) );
+        REQUIRE( names(loader) == "util shapes.circle <main> " );
+
+        //each module keeps its own globals, and only runs once
+        REQUIRE( run(loader) == "util 12.0 42" );
+    }
+}
+
+TEST_CASE("modules don't see the script's globals", "[loader]") {
+    Project project;
+    project.write("main.tq", "secret = 1\nimport peek\nprint(peek.f())\n");
+    project.write("peek.tq", "fn f() return str(secret) end\n");
+
+    torq::ModuleLoader loader(1, false, 2);
+    REQUIRE( loader.load(project.path("main.tq")) );
+    REQUIRE( run(loader) == "error: undefined name 'secret'" );
+}
+
+TEST_CASE("a module's own names shadow builtins from then on", "[loader]") {
+    Project project;
+    project.write("main.tq", "import m\nprint(m.a, m.b)\n");
+    project.write("m.tq",
+        "fn size(x) return len(x) end\n"
+        "a = size([1, 2])\n"
+        "fn len(x) return 99 end\n"
+        "b = size([1])\n");
+
+    torq::ModuleLoader loader(1, false, 1);
+    REQUIRE( loader.load(project.path("main.tq")) );
+    REQUIRE( run(loader) == "2 99" );
+}
+
+TEST_CASE("load errors are reported in order", "[loader]") {
+    Project project;
+
+    SECTION("missing module") {
+        project.write("main.tq", "x = 1\nimport nope\n");
+        torq::ModuleLoader loader(1, false, 2);
+        REQUIRE( !loader.load(project.path("main.tq")) );
+        REQUIRE( loader.errors().size() == 1 );
+        REQUIRE( loader.errors()[0].location.line == 2 );
+        REQUIRE( loader.errors()[0].message == "no module named 'nope' (looked for loader_test/nope.tq)" );
+    }
+
+    SECTION("errors in several modules") {
+        project.write("main.tq", "import a\nimport b\n");
+        project.write("a.tq", "x = (\n");
+        project.write("b.tq", "y = )\n");
+        torq::ModuleLoader loader(1, false, 4);
+        REQUIRE( !loader.load(project.path("main.tq")) );
+        REQUIRE( loader.errors().size() == 2 );
+        REQUIRE( loader.errors()[0].file == project.path("a.tq") );
+        REQUIRE( loader.errors()[1].file == project.path("b.tq") );
+    }
+
+    SECTION("cycle") {
+        project.write("main.tq", "import a\n");
+        project.write("a.tq", "import b\n");
+        project.write("b.tq", "\nimport a\n");
+        torq::ModuleLoader loader(1, false, 2);
+        REQUIRE( !loader.load(project.path("main.tq")) );
+        REQUIRE( loader.errors().size() == 1 );
+        REQUIRE( loader.errors()[0].file == project.path("b.tq") );
+        REQUIRE( loader.errors()[0].location.line == 2 );
+        REQUIRE( loader.errors()[0].message == "import cycle: a -> b -> a" );
+    }
+}
+
+TEST_CASE("hundreds of modules load the same on any number of threads", "[loader]") {
+    Project project;
+
+    //module i imports a few lower numbered ones, main imports them all
+    const int count = 200;
+    std::string main;
+    for(int i = 0; i < count; i++) {
+        std::string text;
+        for(int j = i / 2; j < i; j += 1 + i / 4)
+            text += "import m" + std::to_string(j) + "\n";
+        text += "fn value() return " + std::to_string(i) + " end\n";
+        project.write("m" + std::to_string(i) + ".tq", text);
+        main += "import m" + std::to_string(i) + "\n";
+    }
+    main += "total = 0\n";
+    for(int i = 0; i < count; i += 10)
+        main += "total = total + m" + std::to_string(i) + ".value()\n";
+    project.write("main.tq", main + "print(total)\n");
+
+    std::string first;
+    for(unsigned threads : {1u, 3u, 8u}) {
+        torq::ModuleLoader loader(0, false, threads);
+        REQUIRE( loader.load(project.path("main.tq")) );
+        REQUIRE( loader.modules_in_order().size() == count + 1 );
+        REQUIRE( run(loader) == "1900" );
+
+        if(first.empty())
+            first = names(loader);
+        REQUIRE( names(loader) == first );
+    }
+}
@@ -0,0 +1,208 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+
+#include "helpers.hpp"
+
+namespace {
+    void compile(const std::string &source, int level, torq::Program &program, bool fuse = true) {
+        REQUIRE( helpers::compile(source, program, level, fuse) );
+        REQUIRE( torq::verify(program) );
+    }
+
+    //superinstructions aside, which only rename the first of their parts
+    std::string ops(const std::string &source, int level, std::size_t function = 0) {
+        torq::Program program;
+        compile(source, level, program);
+
+        const torq::FunctionProto &proto = program.functions[function];
+        std::string out;
+        for(uint32_t pc = proto.code_start; pc < proto.code_start + proto.code_size; pc++) {
+            if(!out.empty())
+                out += " ";
+            out += torq::op_name(torq::first_part(torq::op_of(program.code[pc])));
+        }
+        return out;
+    }
+
+    //output, or the error it stopped at
+    std::string run(const std::string &source, int level) {
+        torq::Program program;
+        compile(source, level, program);
+
+        helpers::Ran ran = helpers::run(program);
+        if(!ran.ok)
+            return ran.output + "error: " + ran.error.message;
+        return ran.output;
+    }
+
+    //the same, with where the error was, and how many dispatches it took
+    std::string run_fused(const std::string &source, bool fuse, uint64_t &dispatches) {
+        torq::Program program;
+        compile(source, 1, program, fuse);
+
+        helpers::Ran ran = helpers::run(program);
+        dispatches = ran.instructions;
+        if(!ran.ok) {
+            torq::Location at = ran.error.location;
+            return ran.output + "error at " + std::to_string(at.line) + ":" + std::to_string(at.column) + ": " + ran.error.message;
+        }
+        return ran.output;
+    }
+}
+
+TEST_CASE("folds operators on literals", "[optimizer]") {
+    REQUIRE( ops("x = 2 * 3 + -1", 1) == "LOADINT SETGLOBAL RETURN" );
+    REQUIRE( ops("x = 1.5 * 2 < 4 == !false", 1) == "LOADBOOL SETGLOBAL RETURN" );
+    REQUIRE( ops("x = \"a\" == \"a\"", 1) == "LOADBOOL SETGLOBAL RETURN" );
+
+    //left for the VM to report
+    REQUIRE( ops("x = 1 / 0", 1) == "LOADINT LOADINT DIV_I64 SETGLOBAL RETURN" );
+    REQUIRE( ops("x = 1 + \"a\"", 1) == "LOADINT LOADSTR ADD SETGLOBAL RETURN" );
+    REQUIRE( ops("x = 2 * 3", 0) == "LOADINT LOADINT MUL_I64 SETGLOBAL RETURN" );
+}
+
+TEST_CASE("propagates module constants", "[optimizer]") {
+    const std::string source =
+        "PI = 3.14159\n"
+        "fn area(float radius): float\n"
+        "    return 2.0 * radius * PI\n"
+        "end\n";
+    REQUIRE( ops(source, 2, 1) == "GUARD_F64 LOADK MUL_F64 LOADK MUL_F64 RETURN RETURN" );
+    REQUIRE( ops(source, 1, 1) == "GUARD_F64 LOADK MUL_F64 GETGLOBAL MUL RETURN RETURN" );
+
+    //assigned twice, or read before it is set
+    REQUIRE( ops("N = 1\nN = 2\nprint(N)", 2).find("GETGLOBAL") != std::string::npos );
+    REQUIRE( run("print(N)\nN = 1\n", 2) == "error: undefined name 'N'" );
+    REQUIRE( run("N = 10\nfn f(N) return N end\nprint(f(3), N)", 2) == "3 10" );
+}
+
+TEST_CASE("drops dead branches", "[optimizer]") {
+    REQUIRE( ops("if false then print(1) else x = 2 end", 1) == "LOADINT SETGLOBAL RETURN" );
+    REQUIRE( ops("while 1 > 2 do print(1) end", 1) == "RETURN" );
+
+    //x is still a local of f, because the dropped branch would have assigned it
+    REQUIRE( run("x = 5\nfn f()\n    if false then x = 1 end\n    return x\nend\nprint(f())", 1) == "nil" );
+}
+
+TEST_CASE("peephole cleans up jumps and loads", "[optimizer]") {
+    const std::string source =
+        "fn f()\n"
+        "    x = 0\n"
+        "    while x < 10 do\n"
+        "        x = x + 1\n"
+        "        if x == 5 then break end\n"
+        "    end\n"
+        "    return x\n"
+        "end\n";
+
+    //the typed local's zero and the first assignment collapse, the break becomes the
+    //loop's exit test
+    REQUIRE( ops(source, 0, 1) ==
+        "LOADINT LOADINT LOADINT LT_I64 JMPIFNOT LOADINT ADD_I64 LOADINT EQ_I64 JMPIFNOT JMP JMP RETURN RETURN" );
+    REQUIRE( ops(source, 1, 1) ==
+        "LOADINT LOADINT LT_I64 JMPIFNOT LOADINT ADD_I64 LOADINT EQ_I64 JMPIFNOT RETURN RETURN" );
+    REQUIRE( run(source + "print(f())", 1) == "5" );
+}
+
+TEST_CASE("peephole keeps a branch it can't invert in range", "[optimizer]") {
+    //if !x goto 2; goto far - inverted, the jump would be one past the longest there is
+    const std::size_t far = 2 + torq::MAX_SBX;
+    std::vector<torq::Instr> code = {
+        torq::make_asbx(torq::Op::JMPIFNOT, 0, 1),
+        torq::make_asbx(torq::Op::JMP, 0, torq::MAX_SBX),
+    };
+    while(code.size() < far)
+        code.push_back(torq::make_abc(torq::Op::ADD, 1, 2, 3));
+    code.push_back(torq::make_abc(torq::Op::RETURN, 0, 0, 0));
+    std::vector<uint32_t> offsets(code.size(), 0);
+
+    REQUIRE( torq::peephole(code, offsets) == 0 );
+    REQUIRE( torq::op_of(code[0]) == torq::Op::JMPIFNOT );
+    REQUIRE( torq::arg_sbx(code[0]) == 1 );
+    REQUIRE( torq::op_of(code[1]) == torq::Op::JMP );
+    REQUIRE( torq::arg_sbx(code[1]) == torq::MAX_SBX );
+}
+
+TEST_CASE("optimized programs behave the same", "[optimizer]") {
+    const char *programs[] = {
+        "PI = 3.14159\nfn area(float r) return 2.0 * r * PI end\nprint(\"%.3f\", area(12.67))",
+        "fn fib(int n): int\n    if n < 2 then return n end\n    return fib(n - 1) + fib(n - 2)\nend\nprint(fib(15))",
+        "total = 0\nfor i = 1, 10 do\n    if i % 2 == 0 then total = total + i else total = total - 1 end\nend\nprint(total)",
+        "s = \"\"\ni = 0\nwhile true do\n    i = i + 1\n    if i > 3 then break end\n    s = s + str(i)\nend\nprint(s)",
+        "print(9223372036854775807 + 1, -7 / 2, 7 % -3, 1 / 0.0, 2 * 0.5 == 1, \"b\" > \"a\")",
+        "K = [1, 2]\nappend(K, 3)\nprint(K, 1 / 0)",
+    };
+
+    for(const char *program : programs) {
+        INFO(program);
+        std::string expected = run(program, 0);
+        REQUIRE( run(program, 1) == expected );
+        REQUIRE( run(program, 2) == expected );
+    }
+}
+
+TEST_CASE("fuses sequences into superinstructions", "[optimizer]") {
+    for(const torq::Superinstruction &super : torq::superinstructions()) {
+        INFO(torq::op_name(super.op));
+        REQUIRE( torq::is_superinstruction(super.op) );
+        REQUIRE( torq::first_part(super.op) == super.parts[0] );
+        for(unsigned k = 0; k + 1 < super.length; k++)
+            REQUIRE( torq::is_step(super.parts[k]) );
+
+        //after an instruction that starts nothing, and with operands left alone
+        std::vector<torq::Instr> code = {torq::make_abc(torq::Op::RETURN, 0, 0, 0)};
+        for(unsigned k = 0; k < super.length; k++)
+            code.push_back(torq::make_abc(super.parts[k], k + 1, k + 2, k + 3));
+        std::vector<torq::Instr> before = code;
+
+        REQUIRE( torq::fuse(code) == 1 );
+        REQUIRE( code[0] == before[0] );
+        REQUIRE( torq::op_of(code[1]) == super.op );
+        REQUIRE( torq::arg_a(code[1]) == 1 );
+        REQUIRE( torq::arg_bx(code[1]) == torq::arg_bx(before[1]) );
+        for(unsigned k = 1; k < super.length; k++)
+            REQUIRE( code[1 + k] == before[1 + k] );
+
+        //already fused, or cut short
+        REQUIRE( torq::fuse(code) == 0 );
+        code = before;
+        code.pop_back();
+        torq::fuse(code);
+        REQUIRE( torq::op_of(code[1]) != super.op );
+    }
+}
+
+TEST_CASE("superinstructions behave the same", "[optimizer]") {
+    const char *programs[] = {
+        "fn sum(int n): int\n    int total = 0\n    for i = 1, n do\n        if i % 3 == 0 then total = total + i else total = total - 1 end\n    end\n    return total\nend\nprint(sum(1000))",
+        "fn f(int n, float x): float\n    float y = 0\n    for i = 1, n do\n        y = y * 0.5 + x * i - 1.0 / x\n    end\n    return y\nend\nprint(f(1000, 1.5))",
+        "a = 0\nb = 0.5\nwhile a < 1000 do\n    a = a + 1\n    b = b * 1.001\nend\nprint(a, b)",
+        "fn collatz(int n): int\n    int steps = 0\n    while n != 1 do\n        if n % 2 == 0 then n = n / 2 else n = 3 * n + 1 end\n        steps = steps + 1\n    end\n    return steps\nend\nprint(collatz(27))",
+        "flags = []\nfor i = 0, 100 do append(flags, true) end\nfor i = 2, 100 do\n    if flags[i] then\n        for j = 2, 100 / i do flags[i * j] = false end\n    end\nend\nprint(flags[97], flags[98])",
+
+        //errors inside a superinstruction are still at the part that failed
+        "fn f(int n, int d): int\n    int total = 0\n    for i = 1, n do\n        total = total + i % d + 1\n    end\n    return total\nend\nprint(f(10, 0))",
+        "fn f(n)\n    x = 0\n    while x < n do\n        x = x + 1\n    end\n    return x\nend\nprint(f(\"a\"))",
+        "fn f(float x): float\n    return x * 2.0\nend\nprint(f(\"a\"))",
+    };
+
+    for(const char *program : programs) {
+        INFO(program);
+        uint64_t unfused_dispatches, fused_dispatches;
+        std::string expected = run_fused(program, false, unfused_dispatches);
+        REQUIRE( run_fused(program, true, fused_dispatches) == expected );
+        REQUIRE( fused_dispatches <= unfused_dispatches );
+    }
+
+#if TORQ_STATS
+    //fewer dispatches for the loops they were picked for
+    if(!torq::superinstructions().empty()) {
+        uint64_t unfused_dispatches, fused_dispatches;
+        run_fused(programs[0], false, unfused_dispatches);
+        run_fused(programs[0], true, fused_dispatches);
+        REQUIRE( fused_dispatches < unfused_dispatches );
+    }
+#endif
+}
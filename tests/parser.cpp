@@ -0,0 +1,139 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../src/parser/lexer.hpp"
+#include "../src/parser/parser.hpp"
+
+namespace {
+    std::string parse(const std::string &source) {
+        torq::Lexer l(source);
+        torq::Parser p(l);
+        torq::Ast ast = p.parse();
+
+        for(auto &e : ast.errors)
+            INFO(e.message);
+        REQUIRE( ast.ok() );
+
+        return ast.dump();
+    }
+}
+
+TEST_CASE("parses the sample program", "[parser]") {
+    torq::Source s("../tests/data/data_002.tq");
+    torq::Lexer l(s);
+    torq::Parser p(l);
+    torq::Ast ast = p.parse();
+
+    REQUIRE( ast.ok() );
+    REQUIRE( ast.dump() ==
+        "(module (import std) (= PI 3.14159)"
+        " (fn area ((float radius)) float (block (return (* (* 2.0 radius) PI))))"
+        " (= radius 12.67)"
+        " (call print \"Area of circle = %5.3f\\n\" (call area radius)))" );
+}
+
+TEST_CASE("operator precedence", "[parser]") {
+    REQUIRE( parse("a + b * c - d") == "(module (- (+ a (* b c)) d))" );
+    REQUIRE( parse("(a + b) * -c % 2") == "(module (% (* (+ a b) (- c)) 2))" );
+    REQUIRE( parse("a + 1 >= b * 2 == !c") == "(module (== (>= (+ a 1) (* b 2)) (! c)))" );
+}
+
+TEST_CASE("calls, indexes and members", "[parser]") {
+    REQUIRE( parse("std.print(x[1], f()(2), [1, 2.5, \"s\"])") ==
+        "(module (call (. std print) (index x 1) (call (call f) 2) (list 1 2.5 \"s\")))" );
+    REQUIRE( parse("x[i + 1] = y") == "(module (= (index x (+ i 1)) y))" );
+}
+
+TEST_CASE("control flow", "[parser]") {
+    REQUIRE( parse("if a < b then\n x = 1\nelse if a > b then\n x = 2\nelse\n x = 3\nend") ==
+        "(module (if (< a b) (block (= x 1)) (if (> a b) (block (= x 2)) (block (= x 3)))))" );
+
+    REQUIRE( parse("while i < 10 do\n i = i + 1\n if i == 5 then break end\nend") ==
+        "(module (while (< i 10) (block (= i (+ i 1)) (if (== i 5) (block (break))))))" );
+
+    REQUIRE( parse("for i = 1, 10, 2 do\n total = total + i\nend") ==
+        "(module (for i 1 10 2 (block (= total (+ total i)))))" );
+}
+
+TEST_CASE("declarations and functions", "[parser]") {
+    REQUIRE( parse("int count = 0\nfloat scale\nstring name = \"x\"") ==
+        "(module (declare int count 0) (declare float scale) (declare string name \"x\"))" );
+
+    REQUIRE( parse("fn f(a, int b)\n return\nend\nfn g(): string; return \"g\" end") ==
+        "(module (fn f (a (int b)) any (block (return))) (fn g () string (block (return \"g\"))))" );
+}
+
+TEST_CASE("nodes live in one flat array", "[parser]") {
+    torq::Lexer l("fn f(a, b)\n return a + b * 2\nend\nf(1, 2)");
+    torq::Parser p(l);
+    torq::Ast ast = p.parse();
+
+    REQUIRE( ast.ok() );
+    REQUIRE( ast.nodes.size() == 16 );
+
+    const torq::Node &module = ast[ast.root];
+    REQUIRE( module.kind == torq::NodeKind::MODULE );
+    REQUIRE( ast.list(module).size() == 2 );
+
+    const torq::Node &fn = ast[ast.list(module)[0]];
+    REQUIRE( fn.kind == torq::NodeKind::FUNCTION );
+    REQUIRE( ast.list(fn).size() == 2 );
+    REQUIRE( ast.name(ast[ast.list(fn)[1]].symbol) == "b" );
+}
+
+TEST_CASE("reports errors and recovers at the next line", "[parser]") {
+    torq::Lexer l("x = (1 +\ny = 2\nfn (a) b c\n  q = 1\nend\nz = 0x\nend");
+    torq::Parser p(l);
+    torq::Ast ast = p.parse();
+
+    REQUIRE( ast.errors.size() == 4 );
+
+    REQUIRE( l.location(ast.errors[0].offset).line == 1 );
+    REQUIRE( l.location(ast.errors[1].offset).line == 3 );
+    REQUIRE( l.location(ast.errors[2].offset).line == 6 );
+    REQUIRE( ast.errors[2].message == "Unable to convert hex literal to integer" );
+    REQUIRE( l.location(ast.errors[3].offset).line == 7 );
+
+    REQUIRE( ast.dump().find("(= y 2)") != std::string::npos );
+    REQUIRE( ast.dump().find("(block (= q 1))") != std::string::npos );
+}
+
+TEST_CASE("reports nesting too deep instead of overflowing the stack", "[parser]") {
+    const std::size_t deep = 100000;
+
+    auto errors = [](const std::string &source) {
+        torq::Lexer l(source);
+        torq::Parser p(l);
+        torq::Ast ast = p.parse();
+        return ast.errors;
+    };
+
+    std::vector<std::string> sources = {
+        "x = " + std::string(deep, '(') + "1" + std::string(deep, ')'),
+        "x = " + std::string(deep, '-') + "1",
+        "x = " + std::string(deep, '[') + std::string(deep, ']'),
+    };
+
+    std::string blocks, chain = "if a then\n";
+    for(std::size_t i = 0; i < 2000; i++) {
+        blocks += "while a do\n";
+        chain += "else if a then\n";
+    }
+    for(std::size_t i = 0; i < 2000; i++)
+        blocks += "end\n";
+    sources.push_back(blocks);
+    sources.push_back(chain + "end\n");
+
+    for(const std::string &source : sources) {
+        auto found = errors(source);
+        REQUIRE( found.size() == 1 );
+        REQUIRE( found[0].message == "nesting too deep" );
+    }
+
+    //up to the limit is fine
+    std::size_t allowed = torq::Parser::MAX_DEPTH / 2;
+    REQUIRE( errors("x = " + std::string(allowed, '(') + "1" + std::string(allowed, ')')).empty() );
+}
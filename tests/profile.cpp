@@ -0,0 +1,127 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <sstream>
+#include <string>
+
+#include "helpers.hpp"
+
+namespace {
+    struct Result {
+        std::string output;
+        std::string folded;
+        std::string report;
+        std::string sequences;
+        uint64_t calls = 0;
+        uint64_t returns = 0;
+        uint64_t total = 0;
+        uint64_t samples = 0;
+        uint64_t instructions = 0;
+    };
+
+    Result profile(const std::string &source, bool fuse = true) {
+        torq::Program program;
+        program.name = "test.tq";
+        REQUIRE( helpers::compile(source, program, 1, fuse) );
+
+        std::ostringstream out, folded, report, sequences;
+        Result result;
+        {
+            torq::VM vm(out);
+            const torq::Profiler *profiler = vm.enable_profile();
+            REQUIRE( vm.run(program) );
+
+            profiler->write_folded(folded);
+            profiler->report(report);
+            profiler->write_sequences(sequences);
+            result.calls = profiler->count_of(torq::Op::CALL);
+            result.returns = profiler->count_of(torq::Op::RETURN);
+            for(int op = 0; op < static_cast<int>(torq::Op::COUNT); op++)
+                result.total += profiler->count_of(static_cast<torq::Op>(op));
+            result.samples = profiler->samples();
+            result.instructions = vm.instructions();
+        }
+        result.output = out.str();
+        result.folded = folded.str();
+        result.report = report.str();
+        result.sequences = sequences.str();
+        return result;
+    }
+}
+
+TEST_CASE("the profiler counts every opcode run", "[profile]") {
+    //dispatched one by one
+    Result result = profile(
+        "fn f(x)\n"
+        "    return x + 1\n"
+        "end\n"
+        "for i = 1, 10 do f(i) end\n"
+        "print(f(1))\n", false);
+
+    REQUIRE( result.output == "2" );
+    REQUIRE( result.calls == 12 );          //10 calls of f, then f and print
+    REQUIRE( result.returns == 12 );        //11 from f, 1 from the script
+#if TORQ_STATS
+    REQUIRE( result.total == result.instructions );
+#endif
+    REQUIRE( result.report.find("\nCALL ") != std::string::npos );
+}
+
+TEST_CASE("the profiler samples the call stack", "[profile]") {
+    //runs for a good many timer ticks of CPU time
+    Result result = profile(
+        "fn spin(n)\n"
+        "    total = 0\n"
+        "    for i = 1, n do total = total + i % 7 end\n"
+        "    return total\n"
+        "end\n"
+        "fn outer()\n"
+        "    t = 0\n"
+        "    while t < 20 do\n"
+        "        spin(200000)\n"
+        "        t = t + 1\n"
+        "    end\n"
+        "end\n"
+        "outer()\n");
+
+    REQUIRE( result.samples > 0 );
+
+    //each line is a stack, outermost first, and its count - which add up to the samples
+    std::istringstream lines(result.folded);
+    std::string line;
+    uint64_t counted = 0;
+    bool spin_seen = false;
+    while(std::getline(lines, line)) {
+        REQUIRE( line.starts_with("<main> (test.tq:13:") );
+        std::size_t space = line.rfind(' ');
+        REQUIRE( space != std::string::npos );
+        counted += std::stoull(line.substr(space + 1));
+        if(line.find(";outer (test.tq:9:") != std::string::npos && line.find(";spin (test.tq:") != std::string::npos)
+            spin_seen = true;
+    }
+    REQUIRE( counted == result.samples );
+    REQUIRE( spin_seen );
+
+    REQUIRE( result.report.starts_with("profile: " + std::to_string(result.samples) + " samples") );
+    REQUIRE( result.report.find("  spin (test.tq)\n") != std::string::npos );
+}
+
+TEST_CASE("the profiler counts instruction sequences", "[profile]") {
+    //as the code was before fusing, however it ran
+    const std::string source =
+        "fn f(int n): int\n"
+        "    int total = 0\n"
+        "    for i = 1, n do\n"
+        "        if i % 3 == 0 then total = total + i end\n"
+        "    end\n"
+        "    return total\n"
+        "end\n"
+        "print(f(300))\n";
+    Result unfused = profile(source, false);
+    Result fused = profile(source, true);
+
+    REQUIRE( unfused.output == "15150" );
+    REQUIRE( fused.sequences == unfused.sequences );
+    REQUIRE( unfused.sequences.find("\n300 LOADINT MOD_I64\n") != std::string::npos );
+    REQUIRE( unfused.sequences.find("\n300 MOD_I64 LOADINT EQ_I64\n") != std::string::npos );
+    REQUIRE( unfused.sequences.find("\n1 FORPREP_I64 ") != std::string::npos );
+}
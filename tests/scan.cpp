@@ -0,0 +1,131 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/parser/lexer.hpp"
+#include "../src/parser/scan.hpp"
+
+namespace {
+    const std::vector<torq::ScanLevel> levels = {
+        torq::ScanLevel::SCALAR, torq::ScanLevel::SSE2, torq::ScanLevel::AVX2
+    };
+
+    //restores the startup level, so other tests are unaffected
+    struct LevelGuard {
+        torq::ScanLevel saved = torq::scan_level();
+        ~LevelGuard() { torq::set_scan_level(saved); }
+    };
+}
+
+TEST_CASE("character classes", "[scan]") {
+    REQUIRE( torq::has_class('_', torq::CC_NAME_START) );
+    REQUIRE( torq::has_class('7', torq::CC_NAME) );
+    REQUIRE( !torq::has_class('7', torq::CC_NAME_START) );
+    REQUIRE( torq::has_class('F', torq::CC_HEX) );
+    REQUIRE( !torq::has_class('g', torq::CC_HEX) );
+    REQUIRE( !torq::has_class('2', torq::CC_BINARY) );
+    REQUIRE( torq::has_class('\t', torq::CC_SPACE) );
+    REQUIRE( !torq::has_class('\n', torq::CC_SPACE) );
+    REQUIRE( !torq::has_class(static_cast<char>(0xAE), torq::CC_NAME) );
+}
+
+TEST_CASE("scanners agree at every level", "[scan]") {
+    LevelGuard guard;
+
+    std::mt19937 rng(42);
+    const std::string alphabet = "abcXYZ_09 \t\n\"\\#()\xae";
+
+    for(int round = 0; round < 200; round++) {
+        std::string text;
+        std::size_t length = rng() % 100;
+        for(std::size_t i = 0; i < length; i++) {
+            //long runs of name characters, so the vector loops actually get used
+            text += (rng() % 4 == 0) ? alphabet[rng() % alphabet.size()] : 'q';
+        }
+
+        const char *begin = text.data();
+        const char *end = begin + text.size();
+
+        for(std::size_t from = 0; from <= text.size(); from += 7) {
+            torq::set_scan_level(torq::ScanLevel::SCALAR);
+            const char *name = torq::scan_name(begin + from, end);
+            const char *line = torq::scan_line(begin + from, end);
+            const char *str = torq::scan_string(begin + from, end);
+
+            for(torq::ScanLevel level : levels) {
+                torq::set_scan_level(level);
+                REQUIRE( torq::scan_name(begin + from, end) == name );
+                REQUIRE( torq::scan_line(begin + from, end) == line );
+                REQUIRE( torq::scan_string(begin + from, end) == str );
+            }
+        }
+    }
+}
+
+TEST_CASE("lexes long names, comments and strings at every level", "[scan]") {
+    LevelGuard guard;
+
+    std::string name(70, 'n');
+    std::string body(90, 's');
+    std::string source = name + " # " + std::string(100, 'c') + "\n\"" + body + "\\t" + body + "\" \"\"\"a\n" + body + "\"\"\" x";
+
+    for(torq::ScanLevel level : levels) {
+        torq::set_scan_level(level);
+        torq::Lexer l(source);
+
+        torq::Token t = l.next();
+        REQUIRE( t.type == torq::IDENTIFIER );
+        REQUIRE( l.text(t) == name );
+
+        t = l.next();
+        REQUIRE( t.type == torq::STRING_LIT );
+        REQUIRE( l.text(t) == body + "\t" + body );
+
+        t = l.next();
+        REQUIRE( t.type == torq::STRING_LIT );
+        REQUIRE( l.text(t) == "a\n" + body );
+
+        t = l.next();
+        REQUIRE( t.type == torq::IDENTIFIER );
+        REQUIRE( l.text(t) == "x" );
+
+        REQUIRE( l.next().type == torq::EOS );
+    }
+}
+
+TEST_CASE("lexes on other threads while the level changes", "[scan]") {
+    LevelGuard guard;
+
+    std::string source;
+    for(int i = 0; i < 200; i++)
+        source += std::string(40, 'n') + " = \"" + std::string(50, 's') + "\" # " + std::string(60, 'c') + "\n";
+
+    //Catch's REQUIREs aren't thread safe, so the threads only count what they got wrong
+    std::atomic<int> wrong = 0;
+    std::atomic<bool> done = false;
+    std::vector<std::thread> lexers;
+    for(int i = 0; i < 4; i++) {
+        lexers.emplace_back([&] {
+            while(!done) {
+                torq::Lexer l(source);
+                int tokens = 0;
+                while(l.next().type != torq::EOS)
+                    tokens++;
+                if(tokens != 600)
+                    wrong++;
+            }
+        });
+    }
+
+    for(int round = 0; round < 300; round++)
+        torq::set_scan_level(levels[round % levels.size()]);
+    done = true;
+    for(std::thread &t : lexers)
+        t.join();
+
+    REQUIRE( wrong == 0 );
+}
@@ -0,0 +1,64 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+#include <unistd.h>
+
+#include "../src/parser/lexer.hpp"
+#include "../src/parser/source.hpp"
+
+TEST_CASE("maps a source file", "[source]") {
+    torq::Source s("../tests/data/data_001.tq");
+
+    REQUIRE( s.good() );
+    REQUIRE( s.mapped() );
+    REQUIRE( s.view() == "()\n)(\n" );
+}
+
+TEST_CASE("reports a missing source file", "[source]") {
+    torq::Source s("../tests/data/does_not_exist.tq");
+
+    REQUIRE( !s.good() );
+    REQUIRE( s.size() == 0 );
+}
+
+TEST_CASE("reads pipes into a buffer", "[source]") {
+    int fds[2];
+    REQUIRE( pipe(fds) == 0 );
+
+    const char *text = "( )\n";
+    REQUIRE( write(fds[1], text, std::strlen(text)) == (ssize_t)std::strlen(text) );
+    close(fds[1]);
+
+    torq::Source s(fds[0]);
+    close(fds[0]);
+
+    REQUIRE( s.good() );
+    REQUIRE( !s.mapped() );
+    REQUIRE( s.view() == "( )\n" );
+}
+
+TEST_CASE("lexes a mapped source", "[source]") {
+    torq::Source s("../tests/data/data_001.tq");
+    torq::Lexer l(s);
+
+    torq::Token t = l.next();
+    REQUIRE( t.type == torq::LPAREN );
+
+    t = l.next();
+    REQUIRE( t.type == torq::RPAREN );
+
+    t = l.next();
+    REQUIRE( t.type == torq::ENDL );
+
+    t = l.next();
+    REQUIRE( t.type == torq::RPAREN );
+
+    t = l.next();
+    REQUIRE( t.type == torq::LPAREN );
+
+    t = l.next();
+    REQUIRE( t.type == torq::ENDL );
+
+    t = l.next();
+    REQUIRE( t.type == torq::EOS );
+}
@@ -0,0 +1,118 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "../src/compiler/loader.hpp"
+#include "../src/stats.hpp"
+#include "../src/vm/vm.hpp"
+
+namespace {
+    //a script importing one module, in a scratch directory
+    struct Project {
+        std::string root = "stats_test";
+
+        Project() {
+            std::filesystem::remove_all(root);
+            std::filesystem::create_directories(root);
+            std::ofstream(root + "/main.tq") << "import util\nfor i = 1, 10 do util.f(i) end\n";
+            std::ofstream(root + "/util.tq") << "fn f(x) return x * 2 end\n";
+        }
+        ~Project() { std::filesystem::remove_all(root); }
+    };
+
+    uint64_t run(const torq::ModuleLoader &loader) {
+        std::ostringstream out;
+        torq::VM vm(out);
+        for(const torq::LoadedModule *module : loader.modules_in_order()) {
+            bool ok = module->name.empty() ? vm.run(module->program) : vm.run_module(module->program, module->name);
+            REQUIRE( ok );
+        }
+        return vm.instructions();
+    }
+}
+
+#if TORQ_STATS
+
+TEST_CASE("stats count every module and phase", "[stats]") {
+    Project project;
+    torq::Stats &stats = torq::Stats::global();
+    stats.reset();
+    stats.enable();
+
+    torq::ModuleLoader loader(1, false, 2);
+    REQUIRE( loader.load(project.root + "/main.tq") );
+    stats.enable(false);
+
+    REQUIRE( stats.count(torq::Counter::MODULES) == 2 );
+    REQUIRE( stats.count(torq::Counter::CACHED_MODULES) == 0 );
+    REQUIRE( stats.count(torq::Counter::BYTES) == 68 );
+    REQUIRE( stats.count(torq::Counter::TOKENS) > 20 );
+    REQUIRE( stats.count(torq::Counter::NODES) > 10 );
+
+    std::size_t instructions = 0;
+    for(const torq::LoadedModule *module : loader.modules_in_order())
+        instructions += module->program.code.size();
+    REQUIRE( stats.count(torq::Counter::INSTRUCTIONS) == instructions );
+
+    for(torq::Phase phase : {torq::Phase::LEX, torq::Phase::PARSE, torq::Phase::COMPILE})
+        REQUIRE( stats.wall_ns(phase) > 0 );
+
+    //off again, nothing more is added
+    torq::ModuleLoader again(1, false, 1);
+    REQUIRE( again.load(project.root + "/main.tq") );
+    REQUIRE( stats.count(torq::Counter::MODULES) == 2 );
+    stats.reset();
+}
+
+TEST_CASE("the VM counts the instructions it runs", "[stats]") {
+    Project project;
+    torq::ModuleLoader loader(1, false, 1);
+    REQUIRE( loader.load(project.root + "/main.tq") );
+
+    //ten more calls of f, whatever the loop costs around them
+    uint64_t ten = run(loader);
+    std::ofstream(project.root + "/main.tq") << "import util\nfor i = 1, 20 do util.f(i) end\n";
+    torq::ModuleLoader twenty_loader(1, false, 1);
+    REQUIRE( twenty_loader.load(project.root + "/main.tq") );
+    uint64_t twenty = run(twenty_loader);
+
+    REQUIRE( ten > 0 );
+    REQUIRE( (twenty - ten) % 10 == 0 );
+    REQUIRE( twenty - ten >= 10 * 3 );
+}
+
+TEST_CASE("stats report as a table or JSON", "[stats]") {
+    torq::Stats &stats = torq::Stats::global();
+    stats.reset();
+    stats.enable();
+    stats.add(torq::Counter::TOKENS, 12);
+    stats.add_time(torq::Phase::RUN, 1500000, 1000000);
+    stats.enable(false);
+
+    std::ostringstream table, json;
+    stats.report(table, false);
+    stats.report(json, true);
+    stats.reset();
+
+    REQUIRE( table.str().find("run                   1.500        1.000\n") != std::string::npos );
+    REQUIRE( table.str().find("  parse ") != std::string::npos );
+    REQUIRE( table.str().find("tokens                   12\n") != std::string::npos );
+
+    REQUIRE( json.str().starts_with("{\"phases\": {\"total\": {\"wall_ms\": 0.000, \"cpu_ms\": 0.000}, ") );
+    REQUIRE( json.str().find("\"run\": {\"wall_ms\": 1.500, \"cpu_ms\": 1.000}") != std::string::npos );
+    REQUIRE( json.str().ends_with("\"tokens\": 12, \"nodes\": 0, \"instructions\": 0, \"executed\": 0}}\n") );
+}
+
+#else
+
+TEST_CASE("stats compile out", "[stats]") {
+    Project project;
+    torq::ModuleLoader loader(1, false, 1);
+    REQUIRE( loader.load(project.root + "/main.tq") );
+    REQUIRE( run(loader) == 0 );
+}
+
+#endif
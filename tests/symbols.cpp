@@ -0,0 +1,68 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+
+#include "../src/parser/lexer.hpp"
+#include "../src/parser/symbols.hpp"
+
+TEST_CASE("interns equal strings to one id", "[symbols]") {
+    torq::SymbolTable table;
+
+    torq::SymbolId a = table.intern("radius");
+    torq::SymbolId b = table.intern("area");
+    torq::SymbolId c = table.intern(std::string("radi") + "us");
+
+    REQUIRE( a == c );
+    REQUIRE( a != b );
+    REQUIRE( table.size() == 2 );
+    REQUIRE( table.name(a) == "radius" );
+    REQUIRE( table.name(b) == "area" );
+}
+
+TEST_CASE("finds only interned strings", "[symbols]") {
+    torq::SymbolTable table;
+    torq::SymbolId id = table.intern("PI");
+
+    torq::SymbolId found;
+    REQUIRE( table.find("PI", found) );
+    REQUIRE( found == id );
+    REQUIRE( !table.find("pi", found) );
+}
+
+TEST_CASE("keeps names stable while growing", "[symbols]") {
+    torq::SymbolTable table;
+
+    std::string_view first = table.name(table.intern("first"));
+    for(int i = 0; i < 5000; i++)
+        REQUIRE( table.intern("name_" + std::to_string(i)) == (torq::SymbolId)i + 1 );
+
+    REQUIRE( first == "first" );
+    REQUIRE( table.intern("name_4321") == 4322 );
+    REQUIRE( table.name(4322) == "name_4321" );
+
+    std::string big(100000, 'x');
+    REQUIRE( table.name(table.intern(big)) == big );
+}
+
+TEST_CASE("interns the empty string before anything else", "[symbols]") {
+    torq::SymbolTable table;
+
+    torq::SymbolId empty = table.intern("");
+    REQUIRE( table.name(empty) == "" );
+
+    torq::SymbolId a = table.intern("a");
+    REQUIRE( table.intern("") == empty );
+    REQUIRE( table.name(a) == "a" );
+    REQUIRE( table.size() == 2 );
+}
+
+TEST_CASE("lexer shares ids between repeated identifiers", "[symbols]") {
+    torq::Lexer l("radius area radius");
+
+    torq::Token a = l.next();
+    torq::Token b = l.next();
+    torq::Token c = l.next();
+
+    REQUIRE( a.symbol == c.symbol );
+    REQUIRE( a.symbol != b.symbol );
+}
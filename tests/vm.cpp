@@ -0,0 +1,324 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include "helpers.hpp"
+
+namespace {
+    std::string run(const std::string &source) {
+        torq::Program program;
+        REQUIRE( helpers::compile(source, program) );
+
+        helpers::Ran ran = helpers::run(program);
+        INFO(ran.error.message);
+        REQUIRE( ran.ok );
+        return ran.output;
+    }
+
+    torq::RuntimeError run_error(const std::string &source) {
+        torq::Program program;
+        REQUIRE( helpers::compile(source, program) );
+
+        helpers::Ran ran = helpers::run(program);
+        REQUIRE( !ran.ok );
+        return ran.error;
+    }
+}
+
+TEST_CASE("runs the sample program", "[vm]") {
+    torq::Source s("../tests/data/data_002.tq");
+    std::string source(s.view());
+    REQUIRE( run(source) == "Area of circle = 79.608\n" );
+}
+
+TEST_CASE("arithmetic keeps ints as ints", "[vm]") {
+    REQUIRE( run("print(1 + 2 * 3, 7 / 2, -7 % 3, 2 - 5)") == "7 3 -1 -3" );
+    REQUIRE( run("print(1 + 0.5, 7 / 2.0, 3 * 1.0)") == "1.5 3.5 3.0" );
+    REQUIRE( run("print(\"ab\" + \"cd\", [1] + [2, \"x\"])") == "abcd [1, 2, \"x\"]" );
+    REQUIRE( run("print(9223372036854775807 + 1)") == "-9223372036854775808" );
+}
+
+TEST_CASE("values are one nan-boxed word", "[vm]") {
+    REQUIRE( sizeof(torq::Value) == 8 );
+
+    torq::Value values[] = {
+        torq::Value(), torq::Value::boolean(false), torq::Value::boolean(true), torq::Value::small_int(-5),
+        torq::Value::number(-0.0), torq::Value::number(std::numeric_limits<double>::infinity()),
+        torq::Value::number(-std::numeric_limits<double>::quiet_NaN())
+    };
+    torq::ValueKind kinds[] = {
+        torq::ValueKind::NIL, torq::ValueKind::BOOL, torq::ValueKind::BOOL, torq::ValueKind::INT,
+        torq::ValueKind::FLOAT, torq::ValueKind::FLOAT, torq::ValueKind::FLOAT
+    };
+    for(std::size_t i = 0; i < std::size(values); i++) {
+        REQUIRE( values[i].kind() == kinds[i] );
+        REQUIRE( values[i].is_object() == false );
+    }
+
+    REQUIRE( !values[0].truthy() );
+    REQUIRE( !values[1].truthy() );
+    REQUIRE( values[2].truthy() );
+    REQUIRE( values[2].as_bool() );
+    REQUIRE( values[3].as_int() == -5 );
+    REQUIRE( std::signbit(values[4].as_float()) );
+    REQUIRE( !values[6].equals(values[6]) );
+    REQUIRE( torq::Value::small_int(torq::Value::MIN_SMALL_INT).as_int() == torq::Value::MIN_SMALL_INT );
+    REQUIRE( torq::Value::small_int(torq::Value::MAX_SMALL_INT).as_int() == torq::Value::MAX_SMALL_INT );
+}
+
+TEST_CASE("ints wider than 48 bits are boxed", "[vm]") {
+    REQUIRE( run("print(140737488355327, 140737488355327 + 1, -140737488355328 - 1)") ==
+        "140737488355327 140737488355328 -140737488355329" );
+    REQUIRE( run("print(-9223372036854775807 - 1, 9223372036854775807, 4611686018427387904 * 2)") ==
+        "-9223372036854775808 9223372036854775807 -9223372036854775808" );
+    REQUIRE( run("x = 1\nfor i = 1, 63 do x = x * 2 end\nprint(x, x / 4611686018427387904, x == 4611686018427387904 * 2)") ==
+        "-9223372036854775808 -2 true" );
+    REQUIRE( run("fn f(int a) return a + 1 end\nprint(f(281474976710656), [281474976710656][0] - 1)") ==
+        "281474976710657 281474976710655" );
+
+    torq::Program program;
+    REQUIRE( helpers::compile("big = 0\nfor i = 1, 1000 do big = 281474976710656 + i end", program) );
+    std::ostringstream out;
+    torq::VM vm(out);
+    REQUIRE( vm.run(program) );
+    REQUIRE( vm.collect() > 0 );
+    REQUIRE( to_string(vm.global("big")) == "281474976711656" );
+}
+
+TEST_CASE("comparisons and truthiness", "[vm]") {
+    REQUIRE( run("print(1 < 2, 2 <= 1, 3 > 2.5, 2 >= 2, 1 == 1.0, \"a\" != \"b\", \"abc\" < \"abd\")")
+        == "true false true true true true true" );
+    REQUIRE( run("print(!0, !false, !\"\")") == "false true false" );
+}
+
+TEST_CASE("executes control flow", "[vm]") {
+    REQUIRE( run(
+        "total = 0\n"
+        "for i = 1, 10 do\n"
+        "    if i % 2 == 0 then total = total + i end\n"
+        "end\n"
+        "print(total)") == "30" );
+
+    REQUIRE( run(
+        "for i = 10, 1, -3 do print(i) end") == "10741" );
+
+    REQUIRE( run(
+        "for x = 0.0, 1.0, 0.25 do print(\"%.2f \", x) end") == "0.00 0.25 0.50 0.75 1.00 " );
+
+    REQUIRE( run(
+        "n = 0\n"
+        "while true do\n"
+        "    n = n + 1\n"
+        "    if n == 5 then break end\n"
+        "end\n"
+        "print(n)") == "5" );
+
+    REQUIRE( run(
+        "fn grade(int s)\n"
+        "    if s > 90 then return \"a\" else if s > 80 then return \"b\" else return \"c\" end\n"
+        "end\n"
+        "print(grade(95), grade(85), grade(10))") == "a b c" );
+}
+
+TEST_CASE("functions and recursion", "[vm]") {
+    REQUIRE( run(
+        "fn fib(int n): int\n"
+        "    if n < 2 then return n end\n"
+        "    return fib(n - 1) + fib(n - 2)\n"
+        "end\n"
+        "print(fib(20))") == "6765" );
+
+    //locals shadow globals, and arguments can read the register being assigned
+    REQUIRE( run(
+        "x = 1\n"
+        "fn f(int x) x = x + 1 return x end\n"
+        "fn g(int x) x = f(x) return x end\n"
+        "print(g(10), x)") == "11 1" );
+
+    REQUIRE( run("fn nothing() end\nprint(nothing())") == "nil" );
+}
+
+TEST_CASE("cached global lookups see every change", "[vm]") {
+    //the same call sites before and after the function they call is replaced
+    REQUIRE( run(
+        "fn f() return 1 end\n"
+        "fn g() return 2 end\n"
+        "total = 0\n"
+        "for i = 1, 6 do\n"
+        "    total = total * 10 + f()\n"
+        "    if i == 3 then f = g end\n"
+        "end\n"
+        "print(total)") == "111222" );
+
+    //a name that failed to resolve is looked up again once it exists
+    REQUIRE( run(
+        "fn get() return later end\n"
+        "fn try() return get() end\n"
+        "later = 5\n"
+        "print(try())") == "5" );
+
+    //a global defined between runs of the same program
+    torq::Program program;
+    REQUIRE( helpers::compile("print(len(\"abc\"))", program) );
+    std::ostringstream out;
+    torq::VM vm(out);
+    REQUIRE( vm.run(program) );
+    vm.define("len", vm.global("str"));
+    REQUIRE( vm.run(program) );
+    vm.flush();
+    REQUIRE( out.str() == "3abc" );
+}
+
+TEST_CASE("lists, strings and builtins", "[vm]") {
+    REQUIRE( run(
+        "l = [1, 2, 3]\n"
+        "l[1] = 20\n"
+        "append(l, \"four\")\n"
+        "print(l, len(l), l[3], len(\"hello\"), \"hello\"[1])") == "[1, 20, 3, \"four\"] 4 four 5 e" );
+
+    REQUIRE( run("print(str(12) + \"!\", to_int(\"42\") + 1, to_int(3.9), to_float(2))") == "12! 43 3 2.0" );
+    REQUIRE( run("import std\nstd.print(\"%d|%5s|%-3d|%x|%%\", 42, \"ab\", 7, 255)") == "42|   ab|7  |ff|%" );
+}
+
+TEST_CASE("lists that contain themselves print as [...]", "[vm]") {
+    REQUIRE( run("l = [1]\nappend(l, l)\nprint(l)") == "[1, [...]]" );
+    REQUIRE( run("a = [1]\nb = [a, a]\nappend(a, b)\nprint(str(b))") == "[[1, [...]], [1, [...]]]" );
+
+    //the same list twice side by side isn't a cycle
+    REQUIRE( run("a = [1]\nprint([a, a])") == "[[1], [1]]" );
+
+    //nor is very deep nesting allowed to run out of stack
+    std::string deep = run("l = []\nfor i = 1, 100000 do l = [l] end\nprint(l)");
+    REQUIRE( deep.starts_with("[[[") );
+    REQUIRE( deep.find("[...]") != std::string::npos );
+}
+
+TEST_CASE("literal formats are parsed once, and format like any other", "[vm]") {
+    //the same conversions with the format as a literal and built at runtime
+    const std::string specs[] = {
+        "%d", "%5d", "%-5d|", "%05d", "%+d", "% d", "%.3d", "%x", "%X", "%08x", "%#x", "%o", "%c",
+        "%f", "%.2f", "%8.3f", "%-8.1f|", "%+.1f", "%010.2f", "%e", "%.3E", "%g", "%G", "%.0f", "%#.0f",
+        "%s", "%5s", "%-5s|", "%.2s", "%7.3s", "%05s", "100%% %d"
+    };
+    const std::string values[] = {"0", "42", "-7", "255", "1.5", "-0.0", "2.0 / 0.0", "-1e300", "0.000123456", "\"text\"", "true"};
+
+    for(const std::string &spec : specs) {
+        for(const std::string &value : values) {
+            std::string literal = "print(\"" + spec + "\", " + value + ")";
+            std::string built = "f = \"" + spec.substr(0, 1) + "\" + \"" + spec.substr(1) + "\"\nprint(f, " + value + ")";
+
+            torq::Program program;
+            REQUIRE( helpers::compile(literal, program) );
+            REQUIRE( program.formats.size() == 1 );
+
+            std::ostringstream a, b;
+            torq::VM first(a), second(b);
+            torq::Program other;
+            REQUIRE( helpers::compile(built, other) );
+            REQUIRE( other.formats.empty() );
+
+            bool ok = first.run(program);
+            REQUIRE( ok == second.run(other) );
+            INFO(spec << " " << value);
+            REQUIRE( a.str() == b.str() );
+            REQUIRE( first.error().message == second.error().message );
+        }
+    }
+
+    //and matches printf
+    for(const char *spec : {"%d", "%7d", "%-7d|", "%07d", "%+d", "% d", "%x", "%X", "%08X", "%o", "%-6o|"}) {
+        for(long long i : {0LL, 1LL, -1LL, 42LL, -4096LL, 140737488355327LL, -140737488355328LL}) {
+            std::string c_spec = spec;
+            c_spec.insert(c_spec.find_first_of("dxXo"), "ll");
+            char expected[64];
+            std::snprintf(expected, sizeof(expected), c_spec.c_str(), i);
+            REQUIRE( run("print(\"" + std::string(spec) + "\", " + std::to_string(i) + ")") == expected );
+        }
+    }
+    for(const char *spec : {"%f", "%.0f", "%.3f", "%12.4f", "%-12.2f|", "%+f", "% f", "%012.3f", "%e", "%.1E", "%g", "%.3g", "%G"}) {
+        for(double x : {0.0, -0.0, 1.0, -2.5, 0.1, 1e-7, 123456789.125, 1e21, -3.0e-300}) {
+            char expected[512], literal[64];
+            std::snprintf(expected, sizeof(expected), spec, x);
+            std::snprintf(literal, sizeof(literal), "%.17e", x);
+            INFO(spec << " " << literal);
+            REQUIRE( run("print(\"" + std::string(spec) + "\", " + literal + ")") == expected );
+        }
+    }
+
+    //matches printf where it can be compared directly
+    REQUIRE( run("print(\"[%5.3f] [%-6d] [%+.2e] [%x]\", 3.14159, -42, 12345.678, 3054)") == "[3.142] [-42   ] [+1.23e+04] [bee]" );
+    REQUIRE( run("print(\"%d%%\", 50)") == "50%" );
+
+    //errors come where they did when the format was parsed every call
+    REQUIRE( run_error("print(\"%d %q\", 1)").message == "not enough arguments for format string" );
+    REQUIRE( run_error("print(\"%d %q\", 1, 2)").message == "unknown format conversion '%q'" );
+    REQUIRE( run_error("print(\"%5.\", 1)").message == "format string ends in the middle of a conversion" );
+    REQUIRE( run_error("print(\"%d\", 1, 2)").message == "too many arguments for format string" );
+}
+
+TEST_CASE("typed declarations start at zero", "[vm]") {
+    REQUIRE( run("int i\nfloat f\nstring s\nprint(i, f, len(s))") == "0 0.0 0" );
+}
+
+TEST_CASE("typed code matches generic code", "[vm]") {
+    REQUIRE( run(
+        "fn f(int n, float x): float\n"
+        "    total = 0\n"
+        "    for i = 1, n do\n"
+        "        total = total + i % 3 - -i / 2\n"
+        "    end\n"
+        "    return total * x\n"
+        "end\n"
+        "print(f(10, 0.5), f(0, 1.0))") == "17.5 0.0" );
+
+    //an int stored into a float converts, loops over floats count in floats
+    REQUIRE( run("fn g()\n    float y = 3\n    for v = 0, 1, 0.5 do y = y + v end\n    return y\nend\nprint(g())") == "4.5" );
+    REQUIRE( run("fn h(int a, float b) return [a < b, a >= b, a == b, a != b, -a, -b] end\nprint(h(1, 2))") ==
+        "[true, false, false, true, -1, -2.0]" );
+    REQUIRE( run("fn k(string s): string return s + \"!\" end\nprint(k(\"hi\"))") == "hi!" );
+}
+
+TEST_CASE("typed edges check their values", "[vm]") {
+    REQUIRE( run_error("fn area(float r) return r * r end\narea(\"x\")").message == "expected a float, got string" );
+    REQUIRE( run("fn area(float r) return r * r end\nprint(area(3))") == "9.0" );
+    REQUIRE( run_error("fn f(int n) return n end\nf(1.5)").message == "expected an int, got float" );
+    REQUIRE( run_error("fn f()\n    string s = to_int(\"1\")\nend\nf()").message == "expected a string, got int" );
+    REQUIRE( run_error("fn f(int n) return n / 0 end\nf(1)").message == "division by zero" );
+}
+
+TEST_CASE("runtime errors carry a location", "[vm]") {
+    torq::RuntimeError e = run_error("x = 1\ny = x / 0\n");
+    REQUIRE( e.message == "division by zero" );
+    REQUIRE( e.location.line == 2 );
+    REQUIRE( e.location.column == 7 );
+
+    REQUIRE( run_error("print(undefined)").message == "undefined name 'undefined'" );
+    REQUIRE( run_error("x = 1 + \"a\"").message == "cannot add int and string" );
+    REQUIRE( run_error("[1, 2][2]").message == "list index 2 out of range" );
+    REQUIRE( run_error("fn f(a) end\nf(1, 2)").message == "f() takes 1 arguments, got 2" );
+    REQUIRE( run_error("fn f() f() end\nf()").message == "stack overflow" );
+    REQUIRE( run_error("import nothing").message == "no module named 'nothing'" );
+    REQUIRE( run_error("print(\"%d\", 1.5)").message == "%d expects an int, got float" );
+}
+
+TEST_CASE("collector frees unreachable objects", "[vm]") {
+    torq::Program program;
+    REQUIRE( helpers::compile(
+        "keep = [\"a\" + \"b\"]\n"
+        "for i = 1, 1000 do\n"
+        "    tmp = [i, str(i)]\n"
+        "end\n", program) );
+
+    std::ostringstream out;
+    torq::VM vm(out);
+    REQUIRE( vm.run(program) );
+
+    vm.collect();
+    REQUIRE( vm.collect() == 0 );
+    REQUIRE( to_string(vm.global("keep")) == "[\"ab\"]" );
+}
@@ -0,0 +1,214 @@
+//picks the superinstructions the interpreter is built with. Reads "count OP OP" and
+//"count OP OP OP" lines as written by torq --sequences (repeated lines add up, so files from
+//several runs can be concatenated), and writes the header bytecode.hpp includes.
+//
+//  superinstructions [--max N] output.hpp sequences.txt...
+//
+//Greedy: each round takes the sequence that saves the most dispatches given the ones already
+//taken, until N are taken or the best saves under 0.5% of all dispatches. Built with
+//TORQ_NO_SUPERINSTRUCTIONS, so it only knows the ops the compiler emits itself
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/vm/bytecode.hpp"
+
+using torq::Op;
+
+namespace {
+
+    constexpr std::size_t MAX_SUPERINSTRUCTIONS = 255 - torq::BASE_OPS;
+
+    const char *const names[] = {
+        #define TORQ_OPCODE_NAME(name, format) #name,
+        TORQ_OPCODES(TORQ_OPCODE_NAME)
+        #undef TORQ_OPCODE_NAME
+    };
+
+    bool op_named(const std::string &name, Op &op) {
+        for(std::size_t i = 0; i < torq::BASE_OPS; i++) {
+            if(name == names[i]) {
+                op = static_cast<Op>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    struct Candidate {
+        std::vector<Op> parts;
+        uint64_t count = 0;
+        bool taken = false;
+    };
+
+    std::string name_of(const Candidate &candidate) {
+        std::string name;
+        for(Op op : candidate.parts) {
+            if(!name.empty())
+                name += '_';
+            name += names[static_cast<std::size_t>(op)];
+        }
+        return name;
+    }
+
+    bool starts_with(const Candidate &longer, const Candidate &shorter) {
+        return std::equal(shorter.parts.begin(), shorter.parts.end(), longer.parts.begin());
+    }
+
+    //whether a run of a and a run of b could share an instruction, b starting anywhere from
+    //before a to inside it
+    bool overlap(const Candidate &a, const Candidate &b) {
+        const int na = static_cast<int>(a.parts.size()), nb = static_cast<int>(b.parts.size());
+        for(int shift = 1 - nb; shift < na; shift++) {
+            bool same = true;
+            for(int i = std::max(0, shift); same && (i < std::min(na, shift + nb)); i++)
+                same = a.parts[i] == b.parts[i - shift];
+            if(same)
+                return true;
+        }
+        return false;
+    }
+
+    //dispatches saved over the profile if candidate were taken next. Runs that overlap one of
+    //a taken sequence may already be fused, so its count is taken off, except that a triple
+    //extending a taken pair still saves one more
+    uint64_t saving(const Candidate &candidate, const std::vector<Candidate> &all) {
+        uint64_t count = candidate.count;
+        uint64_t per_run = candidate.parts.size() - 1;
+
+        for(const Candidate &other : all) {
+            if(!other.taken || (&other == &candidate))
+                continue;
+            if( (candidate.parts.size() > other.parts.size()) && starts_with(candidate, other) )
+                per_run = 1;
+            else if(overlap(candidate, other))
+                count -= std::min(count, other.count);
+        }
+        return count * per_run;
+    }
+
+    uint32_t fnv1a(const std::string &text) {
+        uint32_t hash = 2166136261u;
+        for(unsigned char c : text) {
+            hash ^= c;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+}
+
+
+int main(int argc, char *argv[]) {
+    std::size_t max = 32;
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if( (args.size() >= 2) && (args[0] == "--max") ) {
+        max = std::min<std::size_t>(std::strtoul(args[1].c_str(), nullptr, 10), MAX_SUPERINSTRUCTIONS);
+        args.erase(args.begin(), args.begin() + 2);
+    }
+    if(args.size() < 2) {
+        std::cerr << "usage: superinstructions [--max N] output.hpp sequences.txt...\n";
+        return 2;
+    }
+
+    //only sequences the interpreter can run as one: every part but the last a step
+    std::map<std::vector<Op>, uint64_t> counts;
+    uint64_t dispatches = 0;
+    for(std::size_t f = 1; f < args.size(); f++) {
+        std::ifstream in(args[f]);
+        if(!in) {
+            std::cerr << "superinstructions: cannot read " << args[f] << "\n";
+            return 1;
+        }
+
+        std::string line;
+        while(std::getline(in, line)) {
+            std::istringstream fields(line);
+            uint64_t count;
+            if(!(fields >> count))
+                continue;
+
+            std::vector<Op> parts;
+            std::string name;
+            bool known = true;
+            while(fields >> name) {
+                Op op = Op::COUNT;
+                known = known && op_named(name, op);
+                parts.push_back(op);
+            }
+            if( !known || (parts.size() < 2) || (parts.size() > 3) )
+                continue;
+
+            if(parts.size() == 2)
+                dispatches += count;
+            bool runnable = true;
+            for(std::size_t i = 0; i + 1 < parts.size(); i++)
+                runnable = runnable && torq::is_step(parts[i]);
+            if(runnable)
+                counts[parts] += count;
+        }
+    }
+
+    std::vector<Candidate> candidates;
+    for(const auto &[parts, count] : counts)
+        candidates.push_back({parts, count, false});
+
+    std::vector<const Candidate*> taken;
+    while(taken.size() < max) {
+        Candidate *best = nullptr;
+        uint64_t best_saving = 0;
+        for(Candidate &candidate : candidates) {
+            uint64_t s = candidate.taken ? 0 : saving(candidate, candidates);
+            if(s > best_saving) {
+                best = &candidate;
+                best_saving = s;
+            }
+        }
+        if(!best || (best_saving * 200 < dispatches))
+            break;
+        best->taken = true;
+        taken.push_back(best);
+    }
+
+    //longest first, the order the compiler tries them in
+    std::stable_sort(taken.begin(), taken.end(), [](const Candidate *a, const Candidate *b) {
+        return a->parts.size() > b->parts.size();
+    });
+
+    std::string list;
+    for(const Candidate *candidate : taken) {
+        std::string line = (candidate->parts.size() == 2) ? "    PAIR(" : "    TRIPLE(";
+        line += name_of(*candidate);
+        for(Op op : candidate->parts)
+            line += std::string(", ") + names[static_cast<std::size_t>(op)];
+        line += ") \\\n";
+        list += line;
+    }
+
+    char id[16];
+    std::snprintf(id, sizeof(id), "0x%08xu", fnv1a(list));
+
+    std::ofstream out(args[0]);
+    out << "//generated by tools/superinstructions.cpp - don't edit\n"
+           "#pragma once\n"
+           "\n"
+           "//which superinstructions a cache file's code may use\n"
+           "#define TORQ_SUPERINSTRUCTIONS_ID " << id << "\n"
+           "\n"
+           "#define TORQ_SUPERINSTRUCTIONS(PAIR, TRIPLE) \\\n"
+        << list << "\n";
+
+    if(!out) {
+        std::cerr << "superinstructions: cannot write " << args[0] << "\n";
+        return 1;
+    }
+    return 0;
+}